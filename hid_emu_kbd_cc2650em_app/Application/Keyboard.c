@@ -47,6 +47,7 @@
 
 #include <xdc/runtime/System.h>
 #include <stdbool.h>
+#include <string.h>
 #include <ti/sysbios/BIOS.h>
 #include <ti/sysbios/knl/Clock.h>
 #include <ti/sysbios/family/arm/m3/Hwi.h>
@@ -56,6 +57,23 @@
 
 #include <ti/drivers/PIN.h>
 #include <ti/drivers/pin/PINCC26XX.h>
+#ifdef KB_RX_GPTIMER
+#include <ti/drivers/timer/GPTimerCC26XX.h>
+#endif
+#ifdef KB_RX_SSI
+#include <ti/drivers/SPI.h>
+#include <ti/drivers/spi/SPICC26XXDMA.h>
+#include <ti/sysbios/knl/Swi.h>
+#endif
+#if defined(KB_TIMING_STATS) || defined(KB_TRACE)
+#include <ti/drivers/UART.h>
+#endif
+#ifdef KB_TIMING_STATS
+#include <inc/hw_types.h>
+#include <inc/hw_memmap.h>
+#include <inc/hw_cpu_dwt.h>
+#include <inc/hw_cpu_scs.h>
+#endif
 
 #ifdef USE_ICALL
 #include <icall.h>
@@ -75,28 +93,265 @@
 #define delay_us(i) ( CPUdelay(8*(i)) )
 #define delay_ms(i) ( CPUdelay(8000*(i)) )
 
+#ifdef KB_TIMING_STATS
+// Cycle counter
+#define statsCycles() ( HWREG(CPU_DWT_BASE + CPU_DWT_O_CYCCNT) )
+#endif
+
+#ifdef KB_TRACE
+// Trace timestamp, CPU cycles when the cycle counter runs, Clock ticks otherwise
+#ifdef KB_TIMING_STATS
+#define traceTime() ( statsCycles() )
+#else
+#define traceTime() ( Clock_getTicks() )
+#endif
+// Trace record from a port, mouse records are marked
+#define tracePortEvent(port, id, arg8, arg16)	\
+		traceEvent(((port)->type == PS2_PORT_MOUSE ? TRACE_MOUSE : 0) | (id), arg8, arg16)
+#else
+// Trace points compile away
+#define traceEvent(id, arg8, arg16)
+#define tracePortEvent(port, id, arg8, arg16)
+#endif
+
 /*********************************************************************
  * CONSTANTS
  */
 
-// Largest scan code value
-#define SCAN_CODE_SET_2_TO_HID_END		0x83
+// Largest scan code value (0x84 is Alt+PrintScreen)
+#define SCAN_CODE_SET_2_TO_HID_END		0x84
+
+// Largest scan code set 3 value
+#define SCAN_CODE_SET_3_TO_HID_END		0x8D
+
+// Largest valid scan code in the active set
+#ifdef KB_SCAN_CODE_SET_3
+#define SCAN_CODE_END					SCAN_CODE_SET_3_TO_HID_END
+#else
+#define SCAN_CODE_END					SCAN_CODE_SET_2_TO_HID_END
+#endif
+
+// Range covered by the extended scan code table
+#define SCAN_CODE_SET_2_EXT_FIRST		0x11
+#define SCAN_CODE_SET_2_EXT_LAST		0x7E
+
+// Keymap expansion into a designated table initializer
+#define KEYMAP_ENTRY(code, usage)		[(code)] = (usage),
+#define KEYMAP_EXT_ENTRY(code, usage)	[(code) - SCAN_CODE_SET_2_EXT_FIRST] = (usage),
+#define KEYMAP_CONSUMER_ENTRY(code, usage)	[(code)] = CONSUMER_KEY_##code,
 
 // Host to device
 #define BOARD_RESET_SEND_EVT			0xFF
-#define BOARD_RESPONSE_SEND_EVT			0x00
 #define BOARD_LED_CHANGE_SEND_EVT		0xED
 #define BOARD_ECHO_SEND_EVT				0xEE
 #define BOARD_RESEND_SEND_EVT			0xFE
+#define BOARD_SCAN_SET_CMD				0xF0
+#define BOARD_TYPEMATIC_RATE_CMD		0xF3
+#define BOARD_ALL_MAKE_BREAK_CMD		0xF8
+#define BOARD_ALL_TYPEMATIC_MAKE_BREAK_CMD	0xFA
+#define BOARD_KEY_MAKE_BREAK_CMD		0xFC
+#define BOARD_ENABLE_CMD				0xF4
 #define BOARD_ACK						0xFA
 #define BOARD_TEST_PASSED				0xAA
+#define BOARD_TEST_FAILED_1				0xFC
+#define BOARD_TEST_FAILED_2				0xFD
+
+// Host to mouse
+#define MOUSE_SAMPLE_RATE_CMD			0xF3
+#define MOUSE_GET_ID_CMD				0xF2
+#define MOUSE_ENABLE_CMD				0xF4
+#define MOUSE_ID_WHEEL					0x03	// IntelliMouse, 4 byte packets
+#define MOUSE_ID_5_BUTTONS				0x04	// IntelliMouse Explorer, 4 byte packets
+
+// Mouse packet, first byte
+#define MOUSE_BUTTONS_MASK				0x07
+#define MOUSE_ALWAYS_1					0x08	// packet sync
+#define MOUSE_X_SIGN					0x10
+#define MOUSE_Y_SIGN					0x20
+#define MOUSE_X_OVERFLOW				0x40
+#define MOUSE_Y_OVERFLOW				0x80
+
+// Build with KB_HOST_TYPEMATIC to leave autorepeat to the BLE host OS, like
+// any USB/BLE keyboard does. Typematic is turned off in set 3 and slowed down
+// to the minimum in set 2, and repeated makes of a held key are dropped
+// before they reach the application.
+#define KB_TYPEMATIC_SLOWEST			0x7F	// 1 s delay, 2 repeats per second
 
 // Keyboard connections
 #define KB_CLK							PINCC26XX_DIO14	//clock pin
 #define KB_DATA							PINCC26XX_DIO15	//data pin
 
-// Keyboard buffer
+// Build with KB_PS2_MOUSE to drive a PS/2 mouse from a second port. Both
+// ports run the same line engine, each with its own pins, timers and
+// command queue. Mouse packets are handed to the callback registered with
+// Keyboard_registerMouseCB.
+#ifdef KB_PS2_MOUSE
+#ifndef MS_CLK
+#define MS_CLK							PINCC26XX_DIO21	//mouse clock pin
+#endif
+#ifndef MS_DATA
+#define MS_DATA							PINCC26XX_DIO22	//mouse data pin
+#endif
+#endif
+
+// PS/2 port types
+#define PS2_PORT_KEYBOARD				0
+#define PS2_PORT_MOUSE					1
+
+// Receive engine
+// Data line is sampled this long after the falling edge of the clock line.
+// By default rxCallback busy waits for it. Build with KB_RX_GPTIMER to have a
+// GPTimer one-shot latch the data line instead, so the PIN interrupt returns
+// immediately.
+#define KB_RX_SAMPLE_DELAY_US			17
+#ifdef KB_RX_GPTIMER
+#define KB_RX_TIMER						Board_GPTIMER0A
+#define MS_RX_TIMER						Board_GPTIMER1A
+#define KB_RX_TIMER_CLOCK_MHZ			48
+#define KB_RX_SAMPLE_TICKS				(KB_RX_TIMER_CLOCK_MHZ * KB_RX_SAMPLE_DELAY_US)
+#endif
+
+// A frame is on the way, the lines belong to the device until it ends
+#ifdef KB_RX_GPTIMER
+#define rxFrameBusy(port)				( (port)->rxBit != 0 || (port)->rxSamplePending != 0 )
+#else
+#define rxFrameBusy(port)				( (port)->rxBit != 0 )
+#endif
+
+// Build with KB_RX_SSI to deserialize whole frames in the SSI peripheral in
+// slave mode, with uDMA moving each frame out of the RX FIFO. The board SPI
+// configuration selected by KB_RX_SPI must map MOSI to KB_DATA and CLK to
+// KB_CLK. KB_RX_SSI_CSN must be strapped low, since PS/2 has no frame select.
+#ifdef KB_RX_SSI
+#if defined(KB_RX_GPTIMER)
+#error "KB_RX_SSI and KB_RX_GPTIMER are mutually exclusive"
+#endif
+#if defined(KB_PS2_MOUSE)
+#error "KB_RX_SSI only serves the keyboard port, build KB_PS2_MOUSE without it"
+#endif
+#define KB_RX_SPI						Board_SPI1
+#define KB_RX_SSI_CSN					PINCC26XX_DIO13
+#define KB_RX_SSI_FRAME_BITS			11		// start, 8 data, parity, stop
+#define KB_RX_SSI_BIT_RATE				20000	// ignored in slave mode
+#endif
+
+// Host to device line timing. The timed phases run from a one-shot Clock
+// (lineClock) instead of busy waiting in the PIN callbacks.
+#define KB_TX_INHIBIT_US				100		// clock held low before request to send
+#define KB_RX_HOLD_US					105		// clock held low after each received frame
+#define KB_TX_RETRIES					2		// retransmissions when the device does not ACK
+
+// Line timer phases
+#define KB_LINE_TX_INHIBIT				0
+#define KB_LINE_RX_HOLD					1
+
+// Receiver recovery. A frame not finished within KB_RX_FRAME_TIMEOUT_US of
+// its start bit lost a clock edge and is dropped, so the next one starts
+// aligned. After KB_RX_ERROR_LIMIT bad frames in a row the device is
+// reset and initialized again.
+#define KB_RX_FRAME_TIMEOUT_US			2000	// 11 bits at 10 kHz, with margin
+#define KB_RX_ERROR_LIMIT				5
+
+// A device that fails its reset after having worked is reset again after
+// a delay, doubled on each failure up to the maximum. Only a keyboard
+// failing at power up stops the firmware.
+#define KB_REINIT_BACKOFF_MS			1000
+#define KB_REINIT_BACKOFF_MAX_MS		16000
+
+// Host to device command queue (size must be a power of two not larger than
+// 128). Commands are sent one at a time whenever the host holds the clock
+// line, each one waits for its response before the next one goes out.
+#define KB_CMD_QUEUE_SIZE				32
+#define KB_CMD_QUEUE_MASK				(KB_CMD_QUEUE_SIZE - 1)
+#define KB_CMD_RETRIES					2		// retransmissions after FE or a timeout
+#define KB_CMD_ACK_TIMEOUT_MS			25		// frame out plus 20 ms device response time
+#define KB_CMD_BAT_TIMEOUT_MS			1000	// self test takes up to 750 ms
+
+// Command flags, every command expects an ACK first
+#define KB_CMD_BAT						0x01	// ACK is followed by the self test result
+#define KB_CMD_ID						0x02	// ACK (and self test result) is followed by the port ID bytes
+#define KB_CMD_LED						0x04	// byte is replaced by the latest LED state when sent
+#define KB_CMD_ARG						0x80	// argument of the preceding command, dropped with it
+
+// Command states
+#define KB_CMD_IDLE						0		// queue head, if any, not sent yet
+#define KB_CMD_WAIT_ACK					1
+#define KB_CMD_WAIT_BAT					2
+#define KB_CMD_WAIT_ID					3
+#define KB_CMD_RETRY					4		// queue head must be sent again
+
+// Diagnostics UART, shared by KB_TIMING_STATS and KB_TRACE
+#if defined(KB_TIMING_STATS) || defined(KB_TRACE)
+#ifndef KB_DIAG_UART
+#define KB_DIAG_UART					Board_UART
+#endif
+#define KB_DIAG_UART_BAUD				115200
+#endif
+
+// Build with KB_TIMING_STATS to timestamp PS/2 clock edges with the DWT cycle
+// counter and collect link statistics (see keyboardStats_t). Key events then
+// carry the time their scan code was received, and the application hands it
+// back through Keyboard_keyReported once the report is sent. They are read
+// over GATT (kbddiagservice) or dumped on KB_DIAG_UART when
+// KB_STATS_QUERY_CHAR is received.
+#ifdef KB_TIMING_STATS
+#define KB_STATS_CPU_MHZ				48
+#define KB_STATS_QUERY_CHAR				'?'
+#define KB_STATS_LINE_LEN				128
+#endif
+
+// Build with KB_TRACE to record link events into a binary trace ring from
+// interrupt context. A low priority task drains it to KB_DIAG_UART, each
+// record framed as
+//   0xA5, id, arg8, arg16 (LE), timestamp (32 bit LE)
+// The TRACE_START record carries the timestamp unit: arg8 is
+// TRACE_TIME_CLOCK (arg16 = microseconds per tick) or TRACE_TIME_CYCLES
+// (arg16 = CPU MHz). With KB_TIMING_STATS the statistics dump is written by
+// the same task as plain ASCII between records. tests/tracedump decodes a
+// capture of the UART.
+#ifdef KB_TRACE
+#define KB_TRACE_SIZE					32		// records, power of two not larger than 128
+#define KB_TRACE_MASK					(KB_TRACE_SIZE - 1)
+#define KB_TRACE_SYNC					0xA5
+#define KB_TRACE_FRAME_LEN				9		// sync + record
+#define KB_TRACE_BATCH					8		// records per UART write
+#define KB_TRACE_DRAIN_MS				10
+#define KB_TRACE_TASK_PRIORITY			1
+#ifndef KB_TRACE_TASK_STACK_SIZE
+#define KB_TRACE_TASK_STACK_SIZE		644
+#endif
+
+// Trace record ids, 0 marks a slot not written yet
+#define TRACE_START						0x01	// arg8: timestamp source, arg16: unit
+#define TRACE_RX_BYTE					0x02	// arg8: received byte
+#define TRACE_RX_ERROR					0x03	// arg8: received byte, arg16: TRACE_RX_ERR_*
+#define TRACE_TX_BYTE					0x04	// arg8: byte sent to the device
+#define TRACE_TX_NOACK					0x05	// arg8: byte not ACKed, arg16: retry count
+#define TRACE_BUFFER_FULL				0x06	// arg8: dropped byte, arg16: overflow count
+#define TRACE_LOST						0x07	// arg16: records dropped, trace ring full
+#define TRACE_CMD_FAIL					0x08	// arg8: command dropped, arg16: failure count
+#define TRACE_RX_ABORT					0x09	// arg8: bit reached, arg16: aborted frames
+#define TRACE_REINIT					0x0A	// arg16: device resets
+
+#define TRACE_RX_ERR_FRAME				1		// bad start bit or parity
+#define TRACE_RX_ERR_CODE				2		// not a valid scan code
+
+// Set in the id of records from the mouse port
+#define TRACE_MOUSE						0x80
+
+#define TRACE_TIME_CLOCK				0
+#define TRACE_TIME_CYCLES				1
+#endif
+
+// Keyboard buffer (size must be a power of two not larger than 128, so that
+// the free running 8 bit indexes wrap consistently)
 #define BOARD_KB_BUFFER_SIZE			128
+#define BOARD_KB_BUFFER_MASK			(BOARD_KB_BUFFER_SIZE - 1)
+
+#ifdef KB_PS2_MOUSE
+// Mouse packet length, 3 bytes unless the mouse identified as wheel mouse
+#define MOUSE_PACKET_MAX				4
+#endif
 
 // Task configuration
 #define BOARD_TASK_PRIORITY				2
@@ -107,7 +362,53 @@
 // Keyboard scan code special values
 #define BREAK_CODE	0xF0
 #define EXT_CODE	0xE0
+#define PAUSE_CODE	0xE1
 #define RESEND_CODE	0xFE
+#define PAUSE_HID	0x48
+
+// Scan code decoder states. Pause is the only E1 sequence
+// (E1 14 77 E1 F0 14 F0 77), it has no break sequence and is counted off
+// byte by byte. PrintScreen (E0 12 E0 7C) needs no state of its own, E0 12
+// is a fake shift with no HID usage and is dropped on lookup. Set 3 only
+// uses the F0 prefix, so its stream never leaves DEC_IDLE and DEC_BREAK.
+#define DEC_IDLE						0
+#define DEC_EXT							1		// after E0
+#define DEC_BREAK						2		// after F0
+#define DEC_EXT_BREAK					3		// after E0 F0
+#define DEC_PAUSE_1						4		// after E1, 7 bytes to go
+#define DEC_PAUSE_7						10		// last byte of Pause
+#define DEC_STATES						11
+
+// Scan code decoder byte classes
+#define DEC_CLASS_CODE					0
+#define DEC_CLASS_E0					1
+#define DEC_CLASS_F0					2
+#define DEC_CLASS_E1					3
+#define DEC_CLASSES						4
+
+// Scan code decoder actions, taken on the byte that completes a sequence
+#define DEC_ACT_NONE					0
+#define DEC_ACT_MAKE					1
+#define DEC_ACT_BREAK					2
+#define DEC_ACT_EXT_MAKE				3
+#define DEC_ACT_EXT_BREAK				4
+#define DEC_ACT_PAUSE					5
+
+// Transition table entry: [action:4][next state:4]
+#define DEC_ENTRY(act, next)			(((act) << 4) | (next))
+#define DEC_ACTION(entry)				((entry) >> 4)
+#define DEC_NEXT(entry)					((entry) & 0x0F)
+
+// Row of a state whose prefixes start a new sequence
+#define DEC_ROW(act)					{ DEC_ENTRY(act, DEC_IDLE),	\
+										  DEC_ENTRY(DEC_ACT_NONE, DEC_EXT),	\
+										  DEC_ENTRY(DEC_ACT_NONE, DEC_BREAK),	\
+										  DEC_ENTRY(DEC_ACT_NONE, DEC_PAUSE_1) }
+// Row of a Pause state, every byte counts
+#define DEC_PAUSE_ROW(next)				{ DEC_ENTRY(DEC_ACT_NONE, next),	\
+										  DEC_ENTRY(DEC_ACT_NONE, next),	\
+										  DEC_ENTRY(DEC_ACT_NONE, next),	\
+										  DEC_ENTRY(DEC_ACT_NONE, next) }
 
 // Modifier keys (scan code - set 2)
 #define L_CTRL							0x14
@@ -119,6 +420,22 @@
 #define L_GUI							0x1F	//EXT_CODE
 #define R_GUI							0x27	//EXT_CODE
 
+// Modifier keys (scan code - set 3)
+#define S3_L_CTRL						0x11
+#define S3_R_CTRL						0x58
+#define S3_L_SHIFT						0x12
+#define S3_R_SHIFT						0x59
+#define S3_L_ALT						0x19
+#define S3_R_ALT						0x39
+#define S3_L_GUI						0x8B
+#define S3_R_GUI						0x8C
+
+// Lock keys (scan code - set 3)
+#define S3_CAPS_LOCK					0x14
+#define S3_NUM_LOCK						0x76
+#define S3_SCROLL_LOCK					0x5F
+#define S3_PAUSE						0x62
+
 // LED state bitmap
 #define USB_LED_NUM_LOCK		        0x01
 #define USB_LED_CAPS_LOCK				0x02
@@ -127,20 +444,285 @@
 #define PS2_LED_NUM_LOCK				0x02
 #define PS2_LED_CAPS_LOCK				0x04
 
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+// Host to device command, one queue entry
+typedef struct
+{
+	uint8_t cmd;
+	uint8_t flags;		// KB_CMD_* flags
+} kbCommand_t;
+
+// PS/2 port, the line engine state of one attached device
+typedef struct
+{
+	uint8_t type;						// PS2_PORT_*
+	uint8_t idLength;					// ID bytes answered after KB_CMD_ID
+	PIN_Id clkPin;
+	PIN_Id dataPin;
+
+	// PIN configuration
+	PIN_Config pinsCfg[3];
+	PIN_State pins;
+	PIN_Handle pinsHandle;
+
+#ifdef KB_RX_GPTIMER
+	// Data line sample timer, and a sample not taken yet. A frame is on the
+	// way from the start bit edge, before its sample advances rxBit.
+	uint8_t rxTimerIndex;
+	GPTimerCC26XX_Handle rxSampleTimer;
+	volatile uint8_t rxSamplePending;
+#endif
+
+	// Receive buffer
+	// Single producer (rxCallback, interrupt context) / single consumer
+	// (taskFxn). Write position is only modified by the producer and read
+	// position only by the consumer. Both are free running and masked on
+	// access. All members are volatile so the compiler keeps the data store
+	// ahead of the index update; the Cortex-M3 core does not reorder stores
+	// to normal memory on its own.
+	volatile uint8_t buffer[BOARD_KB_BUFFER_SIZE];
+	volatile uint8_t bufferWritePos;
+	volatile uint8_t bufferReadPos;
+
+	// Number of bytes dropped because the buffer was full
+	volatile uint16_t bufferOverflows;
+
+	// Line timer
+	Clock_Struct lineClock;
+	volatile uint8_t linePhase;
+
+	// Host holds or drives the lines, from the end of a received frame or a
+	// line acquisition until reception is enabled again
+	volatile uint8_t lineHeld;
+
+#ifndef KB_RX_SSI
+	// Device to Host frame bit being received, 0 between frames, and the
+	// frame collected so far
+	volatile uint_t rxBit;
+	uint_t rxParity;
+	uint_t rxResendRequest;
+	uint8_t rxKey;
+
+	// Frame watchdog, runs from start bit to stop bit
+	Clock_Struct rxFrameClock;
+#endif
+
+	// Last frame was bad, ask the device to send it again
+	volatile uint8_t rxResendPending;
+
+	// Bad frames since the last good one
+	uint8_t rxErrorRun;
+
+	// Number of frames dropped by the watchdog, and of device resets
+	volatile uint16_t rxAbortedFrames;
+	volatile uint16_t reinits;
+
+	// Delay of the next reset after a failed one, 0 once the device is up
+	Clock_Struct reinitClock;
+	uint16_t reinitBackoff;
+
+	// Host to Device frame being sent, from startTx until stopTx or txAbort
+	volatile uint8_t txActive;
+	uint8_t txByte;
+	uint_t txBit;
+	uint_t txParity;
+	uint_t txRetries;
+
+	// Number of Host to Device frames the device did not ACK
+	volatile uint16_t txAckErrors;
+
+	// Command queue
+	// Producers (application task, receive path) push whole commands with
+	// interrupts disabled. The consumer is the line code, which only runs in
+	// one callback at a time.
+	kbCommand_t cmdQueue[KB_CMD_QUEUE_SIZE];
+	volatile uint8_t cmdWritePos;
+	volatile uint8_t cmdReadPos;
+	volatile uint8_t cmdState;
+	uint8_t cmdRetries;
+	uint8_t cmdIdBytes;
+
+	// Response timeout of the command in flight
+	Clock_Struct cmdClock;
+
+	// ID bytes read by the last KB_CMD_ID command
+	uint8_t id[2];
+
+	// Number of commands dropped after all retries, or for a full queue
+	volatile uint16_t cmdFailures;
+	volatile uint16_t cmdQueueFull;
+} ps2Port_t;
+
 /*********************************************************************
  * FUNCTIONS DECLARATION
  */
 
+#ifndef KB_RX_SSI
 static void rxCallback(PIN_Handle hPin, PIN_Id pinId);
+static void rxProcessBit(ps2Port_t *port, uint_t dataValue);
+static void rxFrameTimeoutCallback(UArg arg);
+#endif
+static void rxFrameComplete(ps2Port_t *port, uint8_t key, uint_t error);
+#ifdef KB_RX_GPTIMER
+static void rxSampleCallback(GPTimerCC26XX_Handle handle, GPTimerCC26XX_IntMask interruptMask);
+#endif
 static void txCallback(PIN_Handle hPin, PIN_Id pinId);
+#ifndef KB_RX_SSI
+static void rxReleaseClock(ps2Port_t *port);
+#endif
+static void lineClockCallback(UArg arg);
+static bool cmdService(ps2Port_t *port);
+#ifdef KB_TIMING_STATS
+static void statsHistAdd(uint16_t *hist, uint32_t bucket);
+static uint32_t statsLog2(uint32_t value);
+#ifndef KB_RX_SSI
+static void statsRxEdge(uint_t bit);
+#endif
+static void statsPrint(void);
+#endif
+#ifdef KB_TRACE
+static void traceEvent(uint8_t id, uint8_t arg8, uint16_t arg16);
+#endif
 
 /*******************************************************************************
  * VARIABLES
  */
 
-// Keyboard buffer
-uint8_t board_kb_buffer[BOARD_KB_BUFFER_SIZE] = { 0 };
-uint8_t buffer_write_pos = 0;
+// Keyboard port
+ps2Port_t keyboardPort =
+{
+		.type = PS2_PORT_KEYBOARD,
+		.idLength = 2,
+		.clkPin = KB_CLK,
+		.dataPin = KB_DATA,
+		.pinsCfg =
+		{
+				KB_CLK	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
+				KB_DATA	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
+				PIN_TERMINATE
+		},
+#ifdef KB_RX_GPTIMER
+		.rxTimerIndex = KB_RX_TIMER,
+#endif
+#ifndef KB_RX_SSI
+		.rxParity = 1,
+#endif
+		.txParity = 1,
+		.cmdState = KB_CMD_IDLE
+};
+
+#ifdef KB_PS2_MOUSE
+// Mouse port
+ps2Port_t mousePort =
+{
+		.type = PS2_PORT_MOUSE,
+		.idLength = 1,
+		.clkPin = MS_CLK,
+		.dataPin = MS_DATA,
+		.pinsCfg =
+		{
+				MS_CLK	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
+				MS_DATA	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
+				PIN_TERMINATE
+		},
+#ifdef KB_RX_GPTIMER
+		.rxTimerIndex = MS_RX_TIMER,
+#endif
+		.rxParity = 1,
+		.txParity = 1,
+		.cmdState = KB_CMD_IDLE
+};
+
+// Pointer to application mouse callback
+mouseMovedCB_t appMouseHandler = NULL;
+
+// Mouse packet being collected by taskFxn
+uint8_t mousePacket[MOUSE_PACKET_MAX];
+uint8_t mousePacketLength = 0;
+
+// Queued after the mouse passed its self test: the IntelliMouse knock
+// (sample rates 200, 100, 80) turns on the wheel, the ID read back tells
+// whether it did. Then settle at 100 samples/s and start streaming.
+const kbCommand_t mouseInitSequence[] =
+{
+		{ MOUSE_SAMPLE_RATE_CMD, 0 }, { 200, KB_CMD_ARG },
+		{ MOUSE_SAMPLE_RATE_CMD, 0 }, { 100, KB_CMD_ARG },
+		{ MOUSE_SAMPLE_RATE_CMD, 0 }, { 80, KB_CMD_ARG },
+		{ MOUSE_GET_ID_CMD, KB_CMD_ID },
+		{ MOUSE_SAMPLE_RATE_CMD, 0 }, { 100, KB_CMD_ARG },
+		{ MOUSE_ENABLE_CMD, 0 }
+};
+
+// Reset, answered by ACK, the self test result and the mouse ID
+const kbCommand_t mouseResetCommand = { BOARD_RESET_SEND_EVT, KB_CMD_BAT | KB_CMD_ID };
+#endif
+
+#ifdef KB_TIMING_STATS
+// PS/2 link statistics
+keyboardStats_t keyboardStats;
+
+// Cycle counter at the clock edge being processed, previous edge, and the
+// start and stop bit edges of the last frame
+uint32_t statsEdgeTime;
+uint32_t statsLastEdge;
+uint32_t statsFrameStart;
+uint32_t statsFrameEnd;
+uint8_t statsFrameEndValid = 0;
+
+// Cycle counter when the queued LED command was requested, and when the
+// LED state being sent was requested
+uint32_t statsLedQueued;
+uint32_t statsLedSent;
+
+// Cycle counter at the stop bit of each byte in the keyboard buffer, and of
+// the byte the decoder is working on
+uint32_t statsKeyTimeBuffer[BOARD_KB_BUFFER_SIZE];
+uint32_t statsKeyTime;
+
+// Statistics query
+uint8_t statsUartRx;
+volatile uint8_t statsQueryPending = 0;
+char statsLine[KB_STATS_LINE_LEN];
+#endif
+
+#if defined(KB_TIMING_STATS) || defined(KB_TRACE)
+// Diagnostics UART
+UART_Handle diagUart;
+#endif
+
+#ifdef KB_TRACE
+// Trace record, 8 bytes
+typedef struct
+{
+	uint8_t id;
+	uint8_t arg8;
+	uint16_t arg16;
+	uint32_t time;
+} traceRecord_t;
+
+// Trace ring
+// Multiple producers (PIN, timer and Swi callbacks) / single consumer
+// (traceTaskFxn). A producer reserves its slot with interrupts disabled,
+// fills it in, then commits it by writing the id last. The consumer stops at
+// the first uncommitted slot and clears each id after reading it.
+traceRecord_t traceRing[KB_TRACE_SIZE];
+volatile uint8_t traceWritePos = 0;
+volatile uint8_t traceReadPos = 0;
+
+// Number of records dropped since the last TRACE_LOST record
+volatile uint16_t traceLostCount = 0;
+
+// Framed records being written to the UART
+uint8_t traceFrames[KB_TRACE_BATCH * KB_TRACE_FRAME_LEN];
+
+// Task configuration
+Task_Params traceTaskParams;
+Task_Struct traceTask;
+Char traceTaskStack[KB_TRACE_TASK_STACK_SIZE];
+#endif
 
 // Task configuration
 Task_Params keyboardTaskParams;
@@ -151,11 +733,101 @@ Char keyboardTaskStack[BOARD_TASK_STACK_SIZE];
 Semaphore_Struct boardSemaphore;
 Semaphore_Handle boardSemaphoreHandle;
 
-// Host to device
-uint8_t tx_byte;
+#ifndef KB_SCAN_CODE_SET_3
+// Scan Code set 2 to USB HID tables, kept in flash. Unlisted codes are 0.
+const uint8_t ps2ToUsbTable[SCAN_CODE_SET_2_TO_HID_END + 1] =
+{
+		SCAN_CODE_SET_2_KEYMAP(KEYMAP_ENTRY)
+};
+const uint8_t ps2ExtToUsbTable[SCAN_CODE_SET_2_EXT_LAST - SCAN_CODE_SET_2_EXT_FIRST + 1] =
+{
+		SCAN_CODE_SET_2_EXT_KEYMAP(KEYMAP_EXT_ENTRY)
+};
+// Extended scan code to consumer key
+const uint8_t ps2ExtToConsumerTable[SCAN_CODE_SET_2_CONSUMER_LAST + 1] =
+{
+		SCAN_CODE_SET_2_CONSUMER_KEYMAP(KEYMAP_CONSUMER_ENTRY)
+};
+#else
+// Scan Code set 3 to USB HID table
+const uint8_t ps2Set3ToUsbTable[SCAN_CODE_SET_3_TO_HID_END + 1] =
+{
+		SCAN_CODE_SET_3_KEYMAP(KEYMAP_ENTRY)
+};
+
+#ifdef KB_HOST_TYPEMATIC
+// Queued after the keyboard passed its self test: select set 3 and make
+// every key make/break without typematic
+const kbCommand_t scanSet3InitSequence[] =
+{
+		{ BOARD_SCAN_SET_CMD, 0 }, { 0x03, KB_CMD_ARG },
+		{ BOARD_ALL_MAKE_BREAK_CMD, 0 }
+};
+#else
+// Queued after the keyboard passed its self test: select set 3, make every
+// key typematic make/break, then drop typematic from modifiers and lock
+// keys. The key list ends at the enable command.
+const kbCommand_t scanSet3InitSequence[] =
+{
+		{ BOARD_SCAN_SET_CMD, 0 }, { 0x03, KB_CMD_ARG },
+		{ BOARD_ALL_TYPEMATIC_MAKE_BREAK_CMD, 0 },
+		{ BOARD_KEY_MAKE_BREAK_CMD, 0 },
+		{ S3_L_CTRL, KB_CMD_ARG }, { S3_R_CTRL, KB_CMD_ARG },
+		{ S3_L_SHIFT, KB_CMD_ARG }, { S3_R_SHIFT, KB_CMD_ARG },
+		{ S3_L_ALT, KB_CMD_ARG }, { S3_R_ALT, KB_CMD_ARG },
+		{ S3_L_GUI, KB_CMD_ARG }, { S3_R_GUI, KB_CMD_ARG },
+		{ S3_CAPS_LOCK, KB_CMD_ARG }, { S3_NUM_LOCK, KB_CMD_ARG },
+		{ S3_SCROLL_LOCK, KB_CMD_ARG }, { S3_PAUSE, KB_CMD_ARG },
+		{ BOARD_ENABLE_CMD, 0 }
+};
+#endif
+#endif
+
+#ifdef KB_HOST_TYPEMATIC
+#ifndef KB_SCAN_CODE_SET_3
+// Queued after the keyboard passed its self test: set 2 typematic cannot be
+// turned off, so slow it down as far as it goes
+const kbCommand_t typematicInitSequence[] =
+{
+		{ BOARD_TYPEMATIC_RATE_CMD, 0 }, { KB_TYPEMATIC_SLOWEST, KB_CMD_ARG }
+};
+#endif
+
+// Held keys bitmap, indexed by [extended][scan code]
+static uint8_t keysHeld[2][256 / 8];
+
+// Set when the keyboard is reset or plugged in again: its keys are all up,
+// the task clears the bitmap before the next key
+static volatile uint8_t keysHeldReset = 0;
+
+// Number of typematic repeats dropped
+uint16_t typematicDropCount = 0;
+#endif
 
-// Scan Code set 2 to USB HID table
-uint8_t ps2ToUsbTable[256][2] = SCAN_CODE_SET_2_TO_HID;
+// Scan code set 2 decoder transition table, indexed by [state][byte class]
+const uint8_t decoderTable[DEC_STATES][DEC_CLASSES] =
+{
+		/* DEC_IDLE */		DEC_ROW(DEC_ACT_MAKE),
+		/* DEC_EXT */		{ DEC_ENTRY(DEC_ACT_EXT_MAKE, DEC_IDLE),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_EXT),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_EXT_BREAK),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_PAUSE_1) },
+		/* DEC_BREAK */		DEC_ROW(DEC_ACT_BREAK),
+		/* DEC_EXT_BREAK */	{ DEC_ENTRY(DEC_ACT_EXT_BREAK, DEC_IDLE),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_EXT),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_EXT_BREAK),
+							  DEC_ENTRY(DEC_ACT_NONE, DEC_PAUSE_1) },
+		/* DEC_PAUSE_1 */	DEC_PAUSE_ROW(DEC_PAUSE_1 + 1),
+		/* DEC_PAUSE_2 */	DEC_PAUSE_ROW(DEC_PAUSE_1 + 2),
+		/* DEC_PAUSE_3 */	DEC_PAUSE_ROW(DEC_PAUSE_1 + 3),
+		/* DEC_PAUSE_4 */	DEC_PAUSE_ROW(DEC_PAUSE_1 + 4),
+		/* DEC_PAUSE_5 */	DEC_PAUSE_ROW(DEC_PAUSE_1 + 5),
+		/* DEC_PAUSE_6 */	DEC_PAUSE_ROW(DEC_PAUSE_7),
+		/* DEC_PAUSE_7 */	{ DEC_ENTRY(DEC_ACT_PAUSE, DEC_IDLE),
+							  DEC_ENTRY(DEC_ACT_PAUSE, DEC_IDLE),
+							  DEC_ENTRY(DEC_ACT_PAUSE, DEC_IDLE),
+							  DEC_ENTRY(DEC_ACT_PAUSE, DEC_IDLE) },
+};
 
 // Task configuration
 Task_Params keyboardTaskParams;
@@ -169,29 +841,40 @@ Semaphore_Handle boardSemaphoreHandle;
 // Pointer to application callback
 keysPressedCB_t appKeyChangeHandler = NULL;
 
+// Pointer to application batch callback, and the batch being collected
+keysBatchCB_t appKeyBatchHandler = NULL;
+keyEvent_t keyBatch[KB_BATCH_MAX_EVENTS];
+uint8_t keyBatchCount = 0;
+
 // Memory for the GPIO module to construct a Hwi
 Hwi_Struct callbackHwiKeys;
 
-// PIN configuration
-PIN_Config keyboardPinsCfg[] =
-{
-		KB_CLK	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
-		KB_DATA	| PIN_GPIO_OUTPUT_DIS	| PIN_INPUT_DIS	| PIN_PULLUP,
-		PIN_TERMINATE
-};
-PIN_State	keyboardPins;
-PIN_Handle	keyboardPinsHandler;
+#ifdef KB_RX_SSI
+// SSI receiver
+SPI_Handle rxSpiHandle = NULL;
+SPI_Transaction rxSpiTransaction;
+uint16_t rxSpiFrame;
 
-// TX request
-uint8_t txRequestPending = 0;
-uint8_t	txRequestEvent;
-uint8_t txRequestResponse;
+// Switches the lines between SSI and GPIO outside of driver callbacks
+Swi_Struct rxSsiSwi;
+volatile uint8_t rxSsiOpenRequest = 0;
 
+// Number of frames rejected for bad start, parity or stop bit
+volatile uint16_t rxSsiFrameErrors = 0;
+#endif
 
-// LED change request
-uint8_t pendingLedRequest = 0;
+// LED state, sent by the LED command still queued if cmdLedQueued is set
 uint8_t latestLedState;
-uint8_t rxTxBusy = 1;
+uint8_t cmdLedQueued = 0;
+
+// Reset, answered by ACK and the self test result
+const kbCommand_t resetCommand = { BOARD_RESET_SEND_EVT, KB_CMD_BAT };
+
+// Set LEDs, the state byte is filled in when sent
+const kbCommand_t ledCommand[] =
+{
+		{ BOARD_LED_CHANGE_SEND_EVT, 0 }, { 0, KB_CMD_ARG | KB_CMD_LED }
+};
 
 /*********************************************************************
  * PRIVATE FUNCTIONS
@@ -200,61 +883,208 @@ uint8_t rxTxBusy = 1;
 /*********************************************************************
  * @fn      bufferRead
  *
- * @brief   read one scan code from buffer
+ * @brief   read one byte from a port buffer, never blocks
  *
- * @ret		scan code
+ * @param   port:	PS/2 port
+ * 			key:	where to store the byte
+ *
+ * @ret		true if a byte was read, false if buffer is empty
  */
-uint8_t bufferRead(){
-	static uint8_t buffer_read_pos = 0;
+bool bufferRead(ps2Port_t *port, uint8_t *key){
+	uint8_t read_pos = port->bufferReadPos;
+
+	if (read_pos == port->bufferWritePos) {
+		return false;
+	}
 
-	while(buffer_read_pos==buffer_write_pos);
-	uint8_t key = board_kb_buffer[buffer_read_pos];
-	buffer_read_pos = (buffer_read_pos + 1) % BOARD_KB_BUFFER_SIZE;
+	*key = port->buffer[read_pos & BOARD_KB_BUFFER_MASK];
+#ifdef KB_TIMING_STATS
+	if (port->type == PS2_PORT_KEYBOARD) {
+		statsKeyTime = statsKeyTimeBuffer[read_pos & BOARD_KB_BUFFER_MASK];
+	}
+#endif
+	port->bufferReadPos = read_pos + 1;
 
-	return key;
+	return true;
 }
 
 /*********************************************************************
  * @fn      bufferWrite
  *
- * @brief   write one scan code from buffer
+ * @brief   write one byte to a port buffer
+ *
+ * @param   port:	PS/2 port
+ * 			key:	byte to write
  *
- * @param   key:	scan code to write
+ * @ret		true if written, false if buffer is full and key was dropped
  */
-void bufferWrite(uint8_t key){
-	board_kb_buffer[buffer_write_pos] = key;
-	buffer_write_pos = (buffer_write_pos + 1) % BOARD_KB_BUFFER_SIZE;
+bool bufferWrite(ps2Port_t *port, uint8_t key){
+	uint8_t write_pos = port->bufferWritePos;
+
+	if ((uint8_t)(write_pos - port->bufferReadPos) >= BOARD_KB_BUFFER_SIZE) {
+		port->bufferOverflows++;
+		tracePortEvent(port, TRACE_BUFFER_FULL, key, port->bufferOverflows);
+		return false;
+	}
+
+	port->buffer[write_pos & BOARD_KB_BUFFER_MASK] = key;
+#ifdef KB_TIMING_STATS
+	if (port->type == PS2_PORT_KEYBOARD) {
+		statsKeyTimeBuffer[write_pos & BOARD_KB_BUFFER_MASK] = statsEdgeTime;
+	}
+#endif
+	port->bufferWritePos = write_pos + 1;
+
+	return true;
 }
 
+#ifdef KB_TRACE
 /*********************************************************************
- * @fn      startTx
+ * @fn      traceEvent
+ *
+ * @brief   record one event in the trace ring, callable from any context
+ *
+ * @param   id:		TRACE_* record id
+ * 			arg8:	8 bit argument
+ * 			arg16:	16 bit argument
+ */
+static void traceEvent(uint8_t id, uint8_t arg8, uint16_t arg16) {
+	traceRecord_t *record;
+	uint8_t write_pos;
+	UInt key;
+
+	key = Hwi_disable();
+	write_pos = traceWritePos;
+	if ((uint8_t)(write_pos - traceReadPos) >= KB_TRACE_SIZE) {
+		traceLostCount++;
+		Hwi_restore(key);
+		return;
+	}
+	traceWritePos = write_pos + 1;
+	Hwi_restore(key);
+
+	record = &traceRing[write_pos & KB_TRACE_MASK];
+	record->arg8 = arg8;
+	record->arg16 = arg16;
+	record->time = traceTime();
+	*(volatile uint8_t *)&record->id = id;
+}
+#endif
+
+/*********************************************************************
+ * @fn      portFromPins
+ *
+ * @brief   find the port a PIN callback was raised for
  *
- * @brief   start Host to Device transfer
+ * @param   hPin:	PIN handle of the callback
+ *
+ * @ret		PS/2 port
+ */
+static ps2Port_t *portFromPins(PIN_Handle hPin) {
+#ifdef KB_PS2_MOUSE
+	if (hPin == mousePort.pinsHandle) {
+		return &mousePort;
+	}
+#endif
+	return &keyboardPort;
+}
+
+/*********************************************************************
+ * @fn      holdClock
+ *
+ * @brief   inhibit communication by driving the clock line low
+ *
+ * @param   port:	PS/2 port
  */
-void startTx() {
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_DATA	| PIN_INPUT_DIS);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_DATA	| PIN_GPIO_OUTPUT_EN);
+static void holdClock(ps2Port_t *port) {
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->clkPin	| PIN_INPUT_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->clkPin	| PIN_GPIO_OUTPUT_EN);
+	PINCC26XX_setOutputValue(port->clkPin, 0);
+}
 
-	delay_us(100);
+/*********************************************************************
+ * @fn      startTx
+ *
+ * @brief   start Host to Device transfer, the clock line must already be
+ * 			held low. Request to send follows from lineClockCallback.
+ *
+ * @param   port:	PS/2 port
+ */
+void startTx(ps2Port_t *port) {
+	tracePortEvent(port, TRACE_TX_BYTE, port->txByte, 0);
+	port->txActive = 1;
+	port->linePhase = KB_LINE_TX_INHIBIT;
+	Util_restartClockMicro(&port->lineClock, KB_TX_INHIBIT_US);
+}
 
-	PINCC26XX_setOutputValue(KB_DATA, 0);
+/*********************************************************************
+ * @fn      requestToSend
+ *
+ * @brief   pull data line low and release clock line, the device then
+ * 			clocks the frame in through txCallback
+ *
+ * @param   port:	PS/2 port
+ */
+static void requestToSend(ps2Port_t *port) {
+	PINCC26XX_setOutputValue(port->dataPin, 0);
+	PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->dataPin	| PIN_INPUT_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->dataPin	| PIN_GPIO_OUTPUT_EN);
 
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_CLK	| PIN_GPIO_OUTPUT_DIS);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_CLK	| PIN_INPUT_EN);
+	PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->clkPin	| PIN_GPIO_OUTPUT_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->clkPin	| PIN_INPUT_EN);
 
-	PIN_registerIntCb(keyboardPinsHandler, &txCallback);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_NEGEDGE);
+	PIN_registerIntCb(port->pinsHandle, &txCallback);
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_NEGEDGE);
 }
 
 /*********************************************************************
  * @fn      stopTx
  *
  * @brief   stop Host to Device transfer
+ *
+ * @param   port:	PS/2 port
+ */
+void stopTx(ps2Port_t *port){
+	port->txActive = 0;
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_DIS);
+#ifdef KB_RX_SSI
+	rxSsiOpenRequest = 1;
+	Swi_post(Swi_handle(&rxSsiSwi));
+#else
+	port->lineHeld = 0;
+	PIN_registerIntCb(port->pinsHandle, &rxCallback);
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_NEGEDGE);
+#endif
+}
+
+/*********************************************************************
+ * @fn      txAbort
+ *
+ * @brief   give up a Host to Device transfer the device never clocked in.
+ * 			Data line is released and the clock line held low, as
+ * 			before startTx, so the transfer can be started again.
+ *
+ * @param   port:	PS/2 port
  */
-void stopTx(){
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_DIS);
-	PIN_registerIntCb(keyboardPinsHandler, &rxCallback);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_NEGEDGE);
+static void txAbort(ps2Port_t *port) {
+	UInt key;
+
+	key = Hwi_disable();
+	Clock_stop(Clock_handle(&port->lineClock));
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_DIS);
+	PINCC26XX_clrPendInterrupt(port->clkPin);
+	PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->dataPin | PIN_GPIO_OUTPUT_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->dataPin | PIN_INPUT_EN);
+	holdClock(port);
+	port->txBit = 0;
+	port->txParity = 1;
+	port->txRetries = 0;
+	port->txActive = 0;
+	port->lineHeld = 0;
+	Hwi_restore(key);
+
+	tracePortEvent(port, TRACE_TX_NOACK, port->txByte, KB_TX_RETRIES + 1);
 }
 
 /*********************************************************************
@@ -289,305 +1119,1668 @@ uint8_t usbToPS2LedState(uint8_t usb_state) {
 }
 
 /*********************************************************************
- * @fn      rxRestoreClock
- *
- * @brief   restore clock line for Device to Host transfer
- */
-void rxRestoreClock(){
-	PINCC26XX_setOutputValue(KB_CLK, 1);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_CLK	| PIN_GPIO_OUTPUT_DIS);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_CLK	| PIN_INPUT_EN);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_NEGEDGE);
-}
-
-/*********************************************************************
- * @fn      keyboardTx
+ * @fn      cmdPush
  *
- * @brief   initiate Host to Device transfer
+ * @brief   append a command and its arguments to a port command queue,
+ * 			callable from any context
  *
- * @param   event:		BOARD_RESPONSE_SEND_EVT-	response for previous request
- * 						BOARD_LED_CHANGE_SEND_EVT-	change LED state request
- * 						BOARD_RESEND_SEND_EVT-		resend last scan code request
- * 						BOARD_RESET_SEND_EVT-		reset keyboard request
+ * @param   port:	PS/2 port
+ * 			cmds:	command entries
+ * 			count:	number of entries
  *
- * @param   response:	case event is BOARD_RESPONSE_SEND_EVT-		the scan code response
- * 						case event is BOARD_LED_CHANGE_SEND_EVT-	the requested LED state
- * 						otherwise ignored
+ * @ret		true if queued, false if the queue has no room for all of them
  */
-void keyboardTx(uint8_t event, uint8_t response){
-	static uint8_t led_state, cur_event = 0, response_num;
-
-
-	if (event != BOARD_RESPONSE_SEND_EVT){
-		cur_event = event;
-		led_state = response;
+static bool cmdPush(ps2Port_t *port, const kbCommand_t *cmds, uint8_t count) {
+	uint8_t write_pos, i;
+	UInt key;
+
+	key = Hwi_disable();
+	write_pos = port->cmdWritePos;
+	if ((uint8_t)(write_pos - port->cmdReadPos) > KB_CMD_QUEUE_SIZE - count) {
+		port->cmdQueueFull++;
+		Hwi_restore(key);
+		return false;
 	}
 
-	switch (cur_event){
-		case BOARD_LED_CHANGE_SEND_EVT:
-			if (event == cur_event){
-				response_num = 0;
-				tx_byte = BOARD_LED_CHANGE_SEND_EVT;
-				startTx();
-			} else if (event == BOARD_RESPONSE_SEND_EVT){
-				if (response_num == 0 && response == BOARD_ACK) {
-					response_num++;
-					tx_byte = usbToPS2LedState(led_state);
-					startTx();
-				} else if (response_num == 1 && response == BOARD_ACK) {
-					rxRestoreClock();
-				} else {
-
-				}
-			}
-			break;
-
-		case BOARD_RESET_SEND_EVT:
-			if (event == cur_event){
-				response_num = 0;
-				tx_byte = BOARD_RESET_SEND_EVT;
-				startTx();
-			} else if (event == BOARD_RESPONSE_SEND_EVT){
-				if(response_num == 0 && response == BOARD_ACK){
-					response_num++;
-					rxRestoreClock();
-				} else if (response_num == 1 && response == BOARD_TEST_PASSED) {
-					LED_changeState(Board_LED0, 0);
-					rxRestoreClock();
-				} else {
-					System_abort("Failed initializing keyboard\n");
-				}
-			}
-			break;
-
-		case BOARD_RESEND_SEND_EVT:
-			if (event == cur_event){
-				tx_byte = BOARD_RESEND_SEND_EVT;
-				startTx();
-			}
-			break;
+	for (i = 0; i < count; i++) {
+		port->cmdQueue[(uint8_t)(write_pos + i) & KB_CMD_QUEUE_MASK] = cmds[i];
 	}
+	port->cmdWritePos = write_pos + count;
+	Hwi_restore(key);
 
-
+	return true;
 }
 
 /*********************************************************************
- * @fn      isModifier
+ * @fn      cmdReady
  *
- * @brief   is the scan code represent modifier key
+ * @brief   is there a frame waiting for the host to take the line
  *
- * @param   key:		scan code
- * 			extended:	is the scan code extended
+ * @param   port:	PS/2 port
  *
- * @ret		is the scan code represent modifier key
+ * @ret		true if cmdService would start a transfer
  */
-uint8_t isModifier(uint8_t key, uint8_t extended) {
-	if (extended == 1) {
-		if (key == L_GUI || key == R_CTRL || key == R_ALT || key == R_GUI) {
-			return 1;
-		}
-	} else {
-		if (key == L_SHIFT || key == L_CTRL || key == L_ALT || key == R_SHIFT) {
-			return 1;
-		}
-	}
-	return 0;
+static bool cmdReady(ps2Port_t *port) {
+	return port->rxResendPending == 1 || port->cmdState == KB_CMD_RETRY ||
+		   (port->cmdState == KB_CMD_IDLE && port->cmdReadPos != port->cmdWritePos);
 }
 
 /*********************************************************************
- * @fn      taskFxn
+ * @fn      cmdComplete
  *
- * @brief   main loop of program
- * 			handling scan codes received from keyboard and sends it to HID handler
+ * @brief   the command at the queue head got its full response
  *
- * @param   a0:		D/C
- * 			a1:		D/C
+ * @param   port:	PS/2 port
  */
-void taskFxn(UArg a0, UArg a1) {
-	uint8_t HID_key, key, event, extended;
-
-	// Application main loop.
-	for (;;) {
-		Semaphore_pend(boardSemaphoreHandle, BIOS_WAIT_FOREVER);
-
-		event = 0;
-		extended = 0;
-
-		key = bufferRead();
-		if (key == EXT_CODE) {
-			key = bufferRead();
-			extended = 1;
-		}
+static void cmdComplete(ps2Port_t *port) {
+	Clock_stop(Clock_handle(&port->cmdClock));
+	port->cmdReadPos++;
+	port->cmdState = KB_CMD_IDLE;
+}
 
-		if (key == BREAK_CODE) {
-			key = bufferRead();
-			event |= BOARD_BREAK_CODE_EVT;
+/*********************************************************************
+ * @fn      cmdFail
+ *
+ * @brief   drop the command at the queue head along with its arguments
+ *
+ * @param   port:	PS/2 port
+ */
+static void cmdFail(ps2Port_t *port) {
+	kbCommand_t *head = &port->cmdQueue[port->cmdReadPos & KB_CMD_QUEUE_MASK];
+
+	if (head->flags & KB_CMD_BAT) {
+		if (port->reinits > 0) {
+			// Device worked before, it may come back
+			if (port->reinitBackoff == 0) {
+				port->reinitBackoff = KB_REINIT_BACKOFF_MS;
+			} else if (port->reinitBackoff < KB_REINIT_BACKOFF_MAX_MS) {
+				port->reinitBackoff *= 2;
+			}
+			Util_restartClock(&port->reinitClock, port->reinitBackoff);
+		} else if (port->type == PS2_PORT_KEYBOARD) {
+			// The mouse is optional, a port without one just stays silent
+			System_abort("Failed initializing keyboard\n");
 		}
+	}
 
-		HID_key = ps2ToUsbTable[key][extended];
-
-		event |= isModifier(key, extended) ? BOARD_MOD_CHANGE_EVT : BOARD_KEY_CHANGE_EVT;
+	port->cmdFailures++;
+	tracePortEvent(port, TRACE_CMD_FAIL, head->cmd, port->cmdFailures);
 
-		if (HID_key != 0) {
-			(*appKeyChangeHandler)(event, HID_key);
+	do {
+		if (head->flags & KB_CMD_LED) {
+			cmdLedQueued = 0;
 		}
-	}
+		port->cmdReadPos++;
+		head = &port->cmdQueue[port->cmdReadPos & KB_CMD_QUEUE_MASK];
+	} while (port->cmdReadPos != port->cmdWritePos && (head->flags & KB_CMD_ARG));
+
+	port->cmdState = KB_CMD_IDLE;
 }
 
 /*********************************************************************
- * @fn      createTask
+ * @fn      cmdRetry
  *
- * @brief   create task for handling pressed keys
+ * @brief   have the command at the queue head sent again, or drop it
+ * 			once out of retries
+ *
+ * @param   port:	PS/2 port
  */
-void createTask(void) {
-	// Configure task
-	Task_Params_init(&keyboardTaskParams);
-	keyboardTaskParams.stack = keyboardTaskStack;
-	keyboardTaskParams.stackSize = BOARD_TASK_STACK_SIZE;
-	keyboardTaskParams.priority = BOARD_TASK_PRIORITY;
+static void cmdRetry(ps2Port_t *port) {
+	Clock_stop(Clock_handle(&port->cmdClock));
 
-	Task_construct(&keyboardTask, taskFxn, &keyboardTaskParams, NULL);
+	if (port->cmdRetries < KB_CMD_RETRIES) {
+		port->cmdRetries++;
+		port->cmdState = KB_CMD_RETRY;
+	} else {
+		cmdFail(port);
+	}
 }
 
 /*********************************************************************
- * @fn      createSemaphore
+ * @fn      cmdPushLed
  *
- * @brief   create semaphore for taskFxn
+ * @brief   queue an LED command unless one is queued already, a queued
+ * 			LED command sends the latest state
  */
-void createSemaphore(void) {
-	Semaphore_Params semParams;
-
-	// Configure semaphore
-	Semaphore_Params_init(&semParams);
-	Semaphore_construct(&boardSemaphore, 0, &semParams);
-	boardSemaphoreHandle = Semaphore_handle(&boardSemaphore);
+static void cmdPushLed(void) {
+	UInt key;
+
+	key = Hwi_disable();
+	if (cmdLedQueued == 0 && cmdPush(&keyboardPort, ledCommand, 2)) {
+		cmdLedQueued = 1;
+#ifdef KB_TIMING_STATS
+		statsLedQueued = statsCycles();
+#endif
+	}
+	Hwi_restore(key);
 }
 
 /*********************************************************************
- * @fn      resetKeyboard
+ * @fn      portReady
  *
- * @brief   send reset request for keyboard
+ * @brief   the device passed its self test, queue its configuration
+ *
+ * @param   port:	PS/2 port
  */
-void resetKeyboard() {
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_CLK	| PIN_GPIO_OUTPUT_EN);
-	PINCC26XX_setOutputValue(KB_CLK, 0);
-	keyboardTx(BOARD_RESET_SEND_EVT,0);
-}
+static void portReady(ps2Port_t *port) {
+	port->reinitBackoff = 0;
+
+#ifdef KB_PS2_MOUSE
+	if (port->type == PS2_PORT_MOUSE) {
+		cmdPush(port, mouseInitSequence, sizeof(mouseInitSequence) / sizeof(kbCommand_t));
+		return;
+	}
+#endif
+
+	LED_changeState(Board_LED0, 0);
+#ifdef KB_HOST_TYPEMATIC
+	keysHeldReset = 1;
+#endif
+#if defined(KB_SCAN_CODE_SET_3)
+	cmdPush(port, scanSet3InitSequence, sizeof(scanSet3InitSequence) / sizeof(kbCommand_t));
+#elif defined(KB_HOST_TYPEMATIC)
+	cmdPush(port, typematicInitSequence, sizeof(typematicInitSequence) / sizeof(kbCommand_t));
+#endif
+	// LEDs are off after a reset
+	cmdPushLed();
+}
+
+/*********************************************************************
+ * @fn      portResetCommand
+ *
+ * @brief   reset command of the device attached to a port
+ *
+ * @param   port:	PS/2 port
+ *
+ * @ret		command entry
+ */
+static const kbCommand_t *portResetCommand(ps2Port_t *port) {
+#ifdef KB_PS2_MOUSE
+	if (port->type == PS2_PORT_MOUSE) {
+		return &mouseResetCommand;
+	}
+#endif
+	return &resetCommand;
+}
+
+/*********************************************************************
+ * @fn      portReinit
+ *
+ * @brief   drop all pending commands and queue a device reset, it is
+ * 			sent the next time the host takes the line
+ *
+ * @param   port:	PS/2 port
+ */
+static void portReinit(ps2Port_t *port) {
+	UInt key;
+
+	key = Hwi_disable();
+	Clock_stop(Clock_handle(&port->cmdClock));
+	Clock_stop(Clock_handle(&port->reinitClock));
+	port->cmdReadPos = port->cmdWritePos;
+	port->cmdState = KB_CMD_IDLE;
+	if (port->type == PS2_PORT_KEYBOARD) {
+		cmdLedQueued = 0;
+#ifdef KB_HOST_TYPEMATIC
+		keysHeldReset = 1;
+#endif
+	}
+	port->rxResendPending = 0;
+	port->rxErrorRun = 0;
+	port->reinits++;
+	cmdPush(port, portResetCommand(port), 1);
+	Hwi_restore(key);
+
+	tracePortEvent(port, TRACE_REINIT, 0, port->reinits);
+	if (port->type == PS2_PORT_KEYBOARD) {
+		LED_changeState(Board_LED0, 1);
+	}
+}
+
+/*********************************************************************
+ * @fn      rxError
+ *
+ * @brief   account for a bad frame, ask for it again or reset the
+ * 			device if the link does not recover
+ *
+ * @param   port:	PS/2 port
+ */
+static void rxError(ps2Port_t *port) {
+	if (++port->rxErrorRun >= KB_RX_ERROR_LIMIT) {
+		portReinit(port);
+	} else {
+		port->rxResendPending = 1;
+	}
+}
+
+/*********************************************************************
+ * @fn      cmdResponse
+ *
+ * @brief   match a received byte against the response the command in
+ * 			flight is waiting for
+ *
+ * @param   port:	PS/2 port
+ * 			key:	received byte
+ *
+ * @ret		true if the byte was consumed as a response
+ */
+static bool cmdResponse(ps2Port_t *port, uint8_t key) {
+	uint8_t flags = port->cmdQueue[port->cmdReadPos & KB_CMD_QUEUE_MASK].flags;
+
+	switch (port->cmdState) {
+		case KB_CMD_WAIT_ACK:
+			if (key == RESEND_CODE) {
+				cmdRetry(port);
+			} else if (key != BOARD_ACK) {
+				return false;
+			} else if (flags & KB_CMD_BAT) {
+				port->cmdState = KB_CMD_WAIT_BAT;
+				Util_restartClock(&port->cmdClock, KB_CMD_BAT_TIMEOUT_MS);
+			} else if (flags & KB_CMD_ID) {
+				port->cmdState = KB_CMD_WAIT_ID;
+				port->cmdIdBytes = 0;
+				Util_restartClock(&port->cmdClock, KB_CMD_ACK_TIMEOUT_MS);
+			} else {
+#ifdef KB_TIMING_STATS
+				if (flags & KB_CMD_LED) {
+					statsHistAdd(keyboardStats.ledLatencyHist, (statsCycles() - statsLedSent) / (KB_STATS_CPU_MHZ * KB_STATS_LED_BUCKET_US));
+				}
+#endif
+				cmdComplete(port);
+			}
+			return true;
+
+		case KB_CMD_WAIT_BAT:
+			if (key == BOARD_TEST_PASSED) {
+				if (flags & KB_CMD_ID) {
+					// Mouse, the ID follows the self test result
+					port->cmdState = KB_CMD_WAIT_ID;
+					port->cmdIdBytes = 0;
+					Util_restartClock(&port->cmdClock, KB_CMD_ACK_TIMEOUT_MS);
+				} else {
+					cmdComplete(port);
+					portReady(port);
+				}
+			} else if (key == BOARD_TEST_FAILED_1 || key == BOARD_TEST_FAILED_2) {
+				cmdRetry(port);
+			} else {
+				return false;
+			}
+			return true;
+
+		case KB_CMD_WAIT_ID:
+			port->id[port->cmdIdBytes++] = key;
+			if (port->cmdIdBytes == port->idLength) {
+				cmdComplete(port);
+				if (flags & KB_CMD_BAT) {
+					portReady(port);
+				}
+			}
+			return true;
+	}
+
+	return false;
+}
+
+/*********************************************************************
+ * @fn      cmdService
+ *
+ * @brief   start the next Host to Device transfer, the clock line must
+ * 			already be held low
+ *
+ * @param   port:	PS/2 port
+ *
+ * @ret		true if a transfer was started, false if the line can be released
+ */
+static bool cmdService(ps2Port_t *port) {
+	kbCommand_t *head;
+
+	if (port->rxResendPending == 1) {
+		// Device answers with the bad frame again, not with an ACK
+		port->rxResendPending = 0;
+#ifdef KB_TIMING_STATS
+		if (port->type == PS2_PORT_KEYBOARD) {
+			keyboardStats.resendsSent++;
+		}
+#endif
+		port->txByte = BOARD_RESEND_SEND_EVT;
+		// Bound the transfer, unless a command response is timed already
+		if (!Util_isActive(&port->cmdClock)) {
+			Util_restartClock(&port->cmdClock, KB_CMD_ACK_TIMEOUT_MS);
+		}
+		startTx(port);
+		return true;
+	}
+
+	if (!cmdReady(port)) {
+		return false;
+	}
+
+	if (port->cmdState == KB_CMD_IDLE) {
+		port->cmdRetries = 0;
+	}
+
+	head = &port->cmdQueue[port->cmdReadPos & KB_CMD_QUEUE_MASK];
+	if (head->flags & KB_CMD_LED) {
+		port->txByte = usbToPS2LedState(latestLedState);
+		cmdLedQueued = 0;
+#ifdef KB_TIMING_STATS
+		statsLedSent = statsLedQueued;
+#endif
+	} else {
+		port->txByte = head->cmd;
+	}
+
+	port->cmdState = KB_CMD_WAIT_ACK;
+	Util_restartClock(&port->cmdClock, KB_CMD_ACK_TIMEOUT_MS);
+	startTx(port);
+	return true;
+}
 
+/*********************************************************************
+ * @fn      lineAcquire
+ *
+ * @brief   take the lines for a pending transfer when the bus is idle. If
+ * 			a frame is on the way, the transfer starts when it ends.
+ * 			Callable from task context, the receive callbacks are kept
+ * 			out once the line is held.
+ *
+ * @param   port:	PS/2 port
+ */
+static void lineAcquire(ps2Port_t *port) {
+	UInt key;
+
+	key = Hwi_disable();
+#ifdef KB_RX_SSI
+	if (port->lineHeld == 1 || !cmdReady(port)) {
+		Hwi_restore(key);
+		return;
+	}
+	port->lineHeld = 1;
+	Hwi_restore(key);
+
+	rxSsiOpenRequest = 0;
+	Swi_post(Swi_handle(&rxSsiSwi));
+#else
+	if (port->lineHeld == 1 || rxFrameBusy(port) || !cmdReady(port)) {
+		Hwi_restore(key);
+		return;
+	}
+	port->lineHeld = 1;
+	holdClock(port);
+	Hwi_restore(key);
+
+	cmdService(port);
+#endif
+}
+
+/*********************************************************************
+ * @fn      lineRelease
+ *
+ * @brief   hand the held lines back to the device for reception
+ *
+ * @param   port:	PS/2 port
+ */
+static void lineRelease(ps2Port_t *port) {
+#ifdef KB_RX_SSI
+	rxSsiOpenRequest = 1;
+	Swi_post(Swi_handle(&rxSsiSwi));
+#else
+	rxReleaseClock(port);
+#endif
+}
+
+/*********************************************************************
+ * @fn      cmdTimeoutCallback
+ *
+ * @brief   the command in flight got no response in time, or the
+ * 			device never clocked in the frame sent to it
+ *
+ * @param   arg:	PS/2 port
+ */
+static void cmdTimeoutCallback(UArg arg) {
+	ps2Port_t *port = (ps2Port_t *)arg;
+	bool aborted = false;
+
+	// Without a clocking device the frame would keep the lines forever
+	if (port->txActive == 1) {
+		txAbort(port);
+		aborted = true;
+	}
+
+	// The response may have completed the command while this was pending
+	if (port->cmdState != KB_CMD_IDLE && port->cmdState != KB_CMD_RETRY) {
+		cmdRetry(port);
+	}
+
+	if (aborted && !cmdReady(port)) {
+		lineRelease(port);
+	} else {
+		lineAcquire(port);
+	}
+}
+
+/*********************************************************************
+ * @fn      reinitCallback
+ *
+ * @brief   reset the device again after a failed reset
+ *
+ * @param   arg:	PS/2 port
+ */
+static void reinitCallback(UArg arg) {
+	ps2Port_t *port = (ps2Port_t *)arg;
+
+	portReinit(port);
+	lineAcquire(port);
+}
+
+/*********************************************************************
+ * @fn      isModifier
+ *
+ * @brief   is the scan code represent modifier key
+ *
+ * @param   key:		scan code
+ * 			extended:	is the scan code extended
+ *
+ * @ret		is the scan code represent modifier key
+ */
+uint8_t isModifier(uint8_t key, uint8_t extended) {
+#ifdef KB_SCAN_CODE_SET_3
+	if (key == S3_L_CTRL || key == S3_R_CTRL || key == S3_L_SHIFT || key == S3_R_SHIFT ||
+		key == S3_L_ALT || key == S3_R_ALT || key == S3_L_GUI || key == S3_R_GUI) {
+		return 1;
+	}
+	return 0;
+#else
+	if (extended == 1) {
+		if (key == L_GUI || key == R_CTRL || key == R_ALT || key == R_GUI) {
+			return 1;
+		}
+	} else {
+		if (key == L_SHIFT || key == L_CTRL || key == L_ALT || key == R_SHIFT) {
+			return 1;
+		}
+	}
+	return 0;
+#endif
+}
+
+/*********************************************************************
+ * @fn      ps2ToUsb
+ *
+ * @brief   translate scan code to USB HID usage
+ *
+ * @param   key:		scan code
+ * 			extended:	is the scan code extended
+ *
+ * @ret		HID usage (modifier bit for modifier keys), 0 if unmapped
+ */
+static uint8_t ps2ToUsb(uint8_t key, uint8_t extended) {
+#ifdef KB_SCAN_CODE_SET_3
+	if (key > SCAN_CODE_SET_3_TO_HID_END) {
+		return 0;
+	}
+	return ps2Set3ToUsbTable[key];
+#else
+	if (extended == 1) {
+		if (key < SCAN_CODE_SET_2_EXT_FIRST || key > SCAN_CODE_SET_2_EXT_LAST) {
+			return 0;
+		}
+		return ps2ExtToUsbTable[key - SCAN_CODE_SET_2_EXT_FIRST];
+	}
+
+	if (key > SCAN_CODE_SET_2_TO_HID_END) {
+		return 0;
+	}
+	return ps2ToUsbTable[key];
+#endif
+}
+
+#ifndef KB_SCAN_CODE_SET_3
+/*********************************************************************
+ * @fn      ps2ToConsumer
+ *
+ * @brief   translate an extended scan code to a consumer key
+ *
+ * @param   key:		scan code
+ *
+ * @ret		CONSUMER_KEY_* of the key, 0 if not a consumer key
+ */
+static uint8_t ps2ToConsumer(uint8_t key) {
+	if (key > SCAN_CODE_SET_2_CONSUMER_LAST) {
+		return 0;
+	}
+	return ps2ExtToConsumerTable[key];
+}
+#endif
+
+#ifdef KB_HOST_TYPEMATIC
+/*********************************************************************
+ * @fn      updateKeyHeld
+ *
+ * @brief   track held keys, so typematic repeats can be told apart
+ *
+ * @param   key:		scan code
+ * 			extended:	is the scan code extended
+ * 			release:	is it a break code
+ *
+ * @ret		true if the key changed state, false for a repeated make
+ */
+static bool updateKeyHeld(uint8_t key, uint8_t extended, uint8_t release) {
+	uint8_t *byte = &keysHeld[extended][key >> 3];
+	uint8_t mask = 1 << (key & 0x7);
+
+	// A key held across a reset makes again, that is not a repeat
+	if (keysHeldReset == 1) {
+		keysHeldReset = 0;
+		memset(keysHeld, 0, sizeof(keysHeld));
+	}
+
+	if (release) {
+		*byte &= ~mask;
+		return true;
+	}
+
+	if (*byte & mask) {
+		typematicDropCount++;
+		return false;
+	}
+
+	*byte |= mask;
+	return true;
+}
+#endif
+
+/*********************************************************************
+ * @fn      flushKeys
+ *
+ * @brief   hand the collected key events over to the application
+ */
+static void flushKeys(void) {
+	if (keyBatchCount != 0) {
+		(*appKeyBatchHandler)(keyBatchCount, keyBatch);
+		keyBatchCount = 0;
+	}
+}
+
+/*********************************************************************
+ * @fn      emitKey
+ *
+ * @brief   pass one key event to the application, or collect it for the
+ * 			next batch
+ *
+ * @param   event:	BOARD_*_EVT bitmask
+ * 			key:	HID usage
+ */
+static void emitKey(uint8_t event, uint8_t key) {
+	uint32_t time = 0;
+
+#ifdef KB_TIMING_STATS
+	// The byte completing the sequence is the one just read
+	time = statsKeyTime;
+#endif
+
+	if (appKeyBatchHandler == NULL) {
+		(*appKeyChangeHandler)(event, key, time);
+		return;
+	}
+
+	keyBatch[keyBatchCount].event = event;
+	keyBatch[keyBatchCount].key = key;
+	keyBatch[keyBatchCount].time = time;
+	if (++keyBatchCount == KB_BATCH_MAX_EVENTS) {
+		flushKeys();
+	}
+}
+
+/*********************************************************************
+ * @fn      reportKey
+ *
+ * @brief   look up a decoded scan code and report it to the application
+ *
+ * @param   key:		scan code
+ * 			extended:	is the scan code extended
+ * 			release:	is it a break code
+ */
+static void reportKey(uint8_t key, uint8_t extended, uint8_t release) {
+	uint8_t HID_key, event;
+
+	HID_key = ps2ToUsb(key, extended);
+	event = isModifier(key, extended) ? BOARD_MOD_CHANGE_EVT : BOARD_KEY_CHANGE_EVT;
+#ifndef KB_SCAN_CODE_SET_3
+	if (HID_key == 0 && extended) {
+		HID_key = ps2ToConsumer(key);
+		event = BOARD_CONSUMER_CHANGE_EVT;
+	}
+#endif
+	if (HID_key == 0) {
+		return;
+	}
+
+#ifdef KB_HOST_TYPEMATIC
+	// Report would not change, the host repeats held keys by itself
+	if (!updateKeyHeld(key, extended, release)) {
+		return;
+	}
+#endif
+
+	if (release) {
+		event |= BOARD_BREAK_CODE_EVT;
+	}
+
+	emitKey(event, HID_key);
+}
+
+/*********************************************************************
+ * @fn      decoderFeed
+ *
+ * @brief   advance the scan code set 2 decoder by one byte
+ *
+ * @param   key:	byte read from keyboard buffer
+ *
+ * @ret		true if the byte completed a sequence
+ */
+static bool decoderFeed(uint8_t key) {
+	static uint8_t state = DEC_IDLE;
+	uint8_t byteClass, entry;
+
+	if (key == EXT_CODE) {
+		byteClass = DEC_CLASS_E0;
+	} else if (key == BREAK_CODE) {
+		byteClass = DEC_CLASS_F0;
+	} else if (key == PAUSE_CODE) {
+		byteClass = DEC_CLASS_E1;
+	} else {
+		byteClass = DEC_CLASS_CODE;
+	}
+
+	entry = decoderTable[state][byteClass];
+	state = DEC_NEXT(entry);
+
+	switch (DEC_ACTION(entry)) {
+		case DEC_ACT_MAKE:
+			reportKey(key, 0, 0);
+			break;
+
+		case DEC_ACT_BREAK:
+			reportKey(key, 0, 1);
+			break;
+
+		case DEC_ACT_EXT_MAKE:
+			reportKey(key, 1, 0);
+			break;
+
+		case DEC_ACT_EXT_BREAK:
+			reportKey(key, 1, 1);
+			break;
+
+		case DEC_ACT_PAUSE:
+			// Pause has no break sequence, release it right away
+			emitKey(BOARD_KEY_CHANGE_EVT, PAUSE_HID);
+			emitKey(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, PAUSE_HID);
+			break;
+
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+#ifdef KB_PS2_MOUSE
+/*********************************************************************
+ * @fn      mouseFeed
+ *
+ * @brief   collect one byte of a mouse packet, hand the packet to the
+ * 			application once complete
+ *
+ * @param   key:	byte read from mouse buffer
+ */
+static void mouseFeed(uint8_t key) {
+	uint8_t length;
+	int16_t dx, dy;
+	int8_t wheel = 0;
+
+	// Bit 3 of the first byte is always set, skip bytes until one comes
+	if (mousePacketLength == 0 && (key & MOUSE_ALWAYS_1) == 0) {
+		return;
+	}
+	mousePacket[mousePacketLength++] = key;
+
+	length = (mousePort.id[0] == MOUSE_ID_WHEEL || mousePort.id[0] == MOUSE_ID_5_BUTTONS) ? 4 : 3;
+	if (mousePacketLength < length) {
+		return;
+	}
+	mousePacketLength = 0;
+
+	// 9 bit two's complement deltas, an overflowed axis is dropped
+	dx = (mousePacket[0] & MOUSE_X_OVERFLOW) ? 0 :
+		 (int16_t)mousePacket[1] - ((mousePacket[0] & MOUSE_X_SIGN) ? 256 : 0);
+	dy = (mousePacket[0] & MOUSE_Y_OVERFLOW) ? 0 :
+		 (int16_t)mousePacket[2] - ((mousePacket[0] & MOUSE_Y_SIGN) ? 256 : 0);
+	if (length == 4) {
+		// 4 bit signed wheel movement, the Explorer keeps buttons 4 and 5 above it
+		wheel = (int8_t)(mousePacket[3] << 4) >> 4;
+	}
+
+	// PS/2 Y and wheel count up and away from the user, HID the other way
+	if (appMouseHandler != NULL) {
+		(*appMouseHandler)(mousePacket[0] & MOUSE_BUTTONS_MASK, dx, -dy, -wheel);
+	}
+}
+#endif
+
+/*********************************************************************
+ * @fn      taskFxn
+ *
+ * @brief   main loop of program
+ * 			handling scan codes received from keyboard and sends it to HID handler
+ *
+ * @param   a0:		D/C
+ * 			a1:		D/C
+ */
+void taskFxn(UArg a0, UArg a1) {
+	uint8_t key;
+
+	// Application main loop.
+	for (;;) {
+		Semaphore_pend(boardSemaphoreHandle, BIOS_WAIT_FOREVER);
+
+		// Drain everything received so far. Decoder state is kept across
+		// wakeups, so a sequence cut short by a dropped byte never stalls
+		// the task.
+		while (bufferRead(&keyboardPort, &key)) {
+			decoderFeed(key);
+		}
+
+		if (appKeyBatchHandler != NULL) {
+			flushKeys();
+		}
+
+#ifdef KB_PS2_MOUSE
+		while (bufferRead(&mousePort, &key)) {
+			mouseFeed(key);
+		}
+#endif
+
+#if defined(KB_TIMING_STATS) && !defined(KB_TRACE)
+		if (statsQueryPending == 1) {
+			statsQueryPending = 0;
+			statsPrint();
+		}
+#endif
+	}
+}
+
+/*********************************************************************
+ * @fn      createTask
+ *
+ * @brief   create task for handling pressed keys
+ */
+void createTask(void) {
+	// Configure task
+	Task_Params_init(&keyboardTaskParams);
+	keyboardTaskParams.stack = keyboardTaskStack;
+	keyboardTaskParams.stackSize = BOARD_TASK_STACK_SIZE;
+	keyboardTaskParams.priority = BOARD_TASK_PRIORITY;
+
+	Task_construct(&keyboardTask, taskFxn, &keyboardTaskParams, NULL);
+}
+
+/*********************************************************************
+ * @fn      createSemaphore
+ *
+ * @brief   create semaphore for taskFxn
+ */
+void createSemaphore(void) {
+	Semaphore_Params semParams;
+
+	// Configure semaphore. Binary, since each wakeup drains the whole buffer
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	Semaphore_construct(&boardSemaphore, 0, &semParams);
+	boardSemaphoreHandle = Semaphore_handle(&boardSemaphore);
+}
+
+#ifdef KB_RX_GPTIMER
+/*********************************************************************
+ * @fn      createRxSampleTimer
+ *
+ * @brief   create one-shot timer used to sample the data line of a port
+ *
+ * @param   port:	PS/2 port
+ */
+void createRxSampleTimer(ps2Port_t *port) {
+	GPTimerCC26XX_Params timerParams;
+
+	// Configure timer
+	GPTimerCC26XX_Params_init(&timerParams);
+	timerParams.width = GPT_CONFIG_16BIT;
+	timerParams.mode = GPT_MODE_ONESHOT_UP;
+	timerParams.debugStallMode = GPTimerCC26XX_DEBUG_STALL_OFF;
+	port->rxSampleTimer = GPTimerCC26XX_open(port->rxTimerIndex, &timerParams);
+	if (port->rxSampleTimer == NULL) {
+		System_abort("Failed opening PS/2 sample timer\n");
+	}
+
+	GPTimerCC26XX_setLoadValue(port->rxSampleTimer, KB_RX_SAMPLE_TICKS);
+	GPTimerCC26XX_registerInterrupt(port->rxSampleTimer, rxSampleCallback, GPT_INT_TIMEOUT);
+}
+#endif
+
+/*********************************************************************
+ * @fn      createPort
+ *
+ * @brief   open the pins and construct the timers of a port
+ *
+ * @param   port:	PS/2 port
+ */
+void createPort(ps2Port_t *port) {
+	// Initialize pins. Enable int after callback registered
+	port->pinsHandle = PIN_open(&port->pins, port->pinsCfg);
+	if (port->pinsHandle == NULL) {
+		System_abort("Failed opening PS/2 pins\n");
+	}
+
+	// Create line timer, started by each timed phase
+	Util_constructClock(&port->lineClock, lineClockCallback, 0, 0, false, (UArg)port);
+
+	// Create command response timer
+	Util_constructClock(&port->cmdClock, cmdTimeoutCallback, 0, 0, false, (UArg)port);
+
+	// Create device reset retry timer
+	Util_constructClock(&port->reinitClock, reinitCallback, 0, 0, false, (UArg)port);
+
+#ifndef KB_RX_SSI
+	// Create frame watchdog
+	Util_constructClock(&port->rxFrameClock, rxFrameTimeoutCallback, 0, 0, false, (UArg)port);
+#endif
+
+#ifdef KB_RX_GPTIMER
+	// Create data line sample timer
+	createRxSampleTimer(port);
+#endif
+}
+
+/*********************************************************************
+ * @fn      resetPort
+ *
+ * @brief   send reset request to the device of a port
+ *
+ * @param   port:	PS/2 port
+ */
+void resetPort(ps2Port_t *port) {
+	cmdPush(port, portResetCommand(port), 1);
+
+	port->lineHeld = 1;
+	holdClock(port);
+	cmdService(port);
+}
+
+#ifndef KB_RX_SSI
 /*********************************************************************
  * @fn      rxCompleteCallback
  *
  * @brief   callback function for the last rise of clock line
  *
- * @param   hPin:		D/C
- * 			pinId:		D/C
+ * @param   hPin:		PIN handle of the port
+ * 			pinId:		D/C
+ */
+void rxCompleteCallback(PIN_Handle hPin, PIN_Id pinId) {
+	ps2Port_t *port = portFromPins(hPin);
+
+	holdClock(port);
+	PINCC26XX_clrPendInterrupt(port->clkPin);
+
+	if (!cmdService(port)) {
+		port->linePhase = KB_LINE_RX_HOLD;
+		Util_restartClockMicro(&port->lineClock, KB_RX_HOLD_US);
+	}
+}
+
+/*********************************************************************
+ * @fn      rxReleaseClock
+ *
+ * @brief   release clock line after the post frame hold, so the device
+ * 			can send the next frame
+ *
+ * @param   port:	PS/2 port
+ */
+static void rxReleaseClock(ps2Port_t *port) {
+	port->lineHeld = 0;
+	PIN_setConfig(port->pinsHandle, PIN_BM_IRQ				, port->clkPin	| PIN_IRQ_NEGEDGE);
+	PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->clkPin	| PIN_GPIO_OUTPUT_DIS);
+	PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->clkPin	| PIN_INPUT_EN);
+	PIN_registerIntCb(port->pinsHandle, &rxCallback);
+}
+
+/*********************************************************************
+ * @fn      rxCallback
+ *
+ * @brief   callback function for Device to Host transfer
+ *
+ * @param   hPin:		PIN handle of the port
+ * 			pinId:		D/C
+ */
+static void rxCallback(PIN_Handle hPin, PIN_Id pinId)
+{
+	ps2Port_t *port = portFromPins(hPin);
+
+#ifdef KB_TIMING_STATS
+	if (port->type == PS2_PORT_KEYBOARD) {
+		statsEdgeTime = statsCycles();
+	}
+#endif
+#ifdef KB_RX_GPTIMER
+	port->rxSamplePending = 1;
+	GPTimerCC26XX_start(port->rxSampleTimer);
+#else
+	delay_us(KB_RX_SAMPLE_DELAY_US);
+	rxProcessBit(port, PINCC26XX_getInputValue(port->dataPin));
+#endif
+}
+
+#ifdef KB_RX_GPTIMER
+/*********************************************************************
+ * @fn      rxSampleCallback
+ *
+ * @brief   callback function for data line sample timer
+ *
+ * @param   handle:			timer of the port
+ * 			interruptMask:	D/C
+ */
+static void rxSampleCallback(GPTimerCC26XX_Handle handle, GPTimerCC26XX_IntMask interruptMask)
+{
+	ps2Port_t *port = &keyboardPort;
+
+#ifdef KB_PS2_MOUSE
+	if (handle == mousePort.rxSampleTimer) {
+		port = &mousePort;
+	}
+#endif
+	port->rxSamplePending = 0;
+	rxProcessBit(port, PINCC26XX_getInputValue(port->dataPin));
+}
+#endif
+
+/*********************************************************************
+ * @fn      rxFrameTimeoutCallback
+ *
+ * @brief   frame watchdog expiry, a clock edge was lost. Drop the partial
+ * 			frame and ask for it again.
+ *
+ * @param   arg:	PS/2 port
  */
-void rxCompleteCallback(PIN_Handle hPin, PIN_Id pinId) {
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_DIS);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_CLK	| PIN_INPUT_DIS);
-	PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_CLK	| PIN_GPIO_OUTPUT_EN);
-	PINCC26XX_clrPendInterrupt(KB_CLK);
-	PINCC26XX_setOutputValue(KB_CLK, 0);
-
-	if (txRequestPending == 1) {
-		txRequestPending = 0;
-		keyboardTx(txRequestEvent, txRequestResponse);
-	} else if (pendingLedRequest == 1 && rxTxBusy == 0) {
-		pendingLedRequest = 0;
-		keyboardTx(BOARD_LED_CHANGE_SEND_EVT, latestLedState);
-	} else {
-		delay_us(105);
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ				, KB_CLK	| PIN_IRQ_NEGEDGE);
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_CLK	| PIN_GPIO_OUTPUT_DIS);
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_CLK	| PIN_INPUT_EN);
-		PIN_registerIntCb(keyboardPinsHandler, &rxCallback);
+static void rxFrameTimeoutCallback(UArg arg)
+{
+	ps2Port_t *port = (ps2Port_t *)arg;
+	uint_t bit;
+	UInt key;
+
+	key = Hwi_disable();
+	bit = port->rxBit;
+	port->rxBit = 0;
+	Hwi_restore(key);
+
+	if (bit == 0) {
+		return;
 	}
+
+	port->rxAbortedFrames++;
+	tracePortEvent(port, TRACE_RX_ABORT, bit, port->rxAbortedFrames);
+	rxError(port);
+	lineAcquire(port);
 }
 
 /*********************************************************************
- * @fn      rxCallback
+ * @fn      rxProcessBit
  *
- * @brief   callback function for Device to Host transfer
+ * @brief   Device to Host frame state machine, called once per clock cycle
  *
- * @param   hPin:		D/C
- * 			pinId:		D/C
+ * @param   port:		PS/2 port
+ * 			dataValue:	sampled data line
  */
-static void rxCallback(PIN_Handle hPin, PIN_Id pinId)
+static void rxProcessBit(ps2Port_t *port, uint_t dataValue)
 {
-	static uint_t dataValue,parity =1, bit = 0, resendRequest = 0;
-	static char key;
+	uint_t bit = port->rxBit;
 
-	delay_us(17);
-	dataValue=PINCC26XX_getInputValue(KB_DATA);
+#ifdef KB_TIMING_STATS
+	if (port->type == PS2_PORT_KEYBOARD) {
+		statsRxEdge(bit);
+	}
+#endif
 
 	if (bit == 0) {
-		key = 0;
-		parity = 1;
-		bit++;
+		Util_restartClockMicro(&port->rxFrameClock, KB_RX_FRAME_TIMEOUT_US);
+		port->rxKey = 0;
+		port->rxParity = 1;
+		port->rxResendRequest = 0;
+		port->rxBit = 1;
 		if (dataValue == 1) {
-			resendRequest = 1;
+			port->rxResendRequest = 1;
 		}
 	} else if (bit > 0 && bit < 9) {
-		key |= dataValue << (bit - 1);
-		parity ^= dataValue;
-		bit++;
+		port->rxKey |= dataValue << (bit - 1);
+		port->rxParity ^= dataValue;
+		port->rxBit = bit + 1;
 	} else if (bit == 9) {
-		if (parity != dataValue || (key > SCAN_CODE_SET_2_TO_HID_END && key != BOARD_TEST_PASSED && key != BOARD_ACK && key != BREAK_CODE && key != EXT_CODE)) {System_printf("P:%d\n",key);
-			resendRequest = 1;
+		if (port->rxParity != dataValue) {
+			port->rxResendRequest = 1;
 		}
-		bit++;
+		port->rxBit = bit + 1;
 	} else if (bit == 10) {
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_IRQ, KB_CLK	| PIN_IRQ_POSEDGE);
-		PIN_registerIntCb(keyboardPinsHandler,rxCompleteCallback);
-		rxTxBusy = 0;
-
-		if (resendRequest == 1){
-			resendRequest = 0;
-			txRequestPending = 1;
-			txRequestEvent = BOARD_RESEND_SEND_EVT;
-		} else if (key == BOARD_TEST_PASSED || key == BOARD_ACK) {
-			txRequestPending = 1;
-			txRequestEvent = BOARD_RESPONSE_SEND_EVT;
-			txRequestResponse = key;
-		} else {
-			bufferWrite(key);System_printf("%d\n",key);
-			if (key != BREAK_CODE && key != EXT_CODE) {
-				Semaphore_post(boardSemaphoreHandle);
-				rxTxBusy = 0;
+		Clock_stop(Clock_handle(&port->rxFrameClock));
+		port->lineHeld = 1;
+		PIN_setConfig(port->pinsHandle, PIN_BM_IRQ, port->clkPin	| PIN_IRQ_POSEDGE);
+		PIN_registerIntCb(port->pinsHandle,rxCompleteCallback);
+
+		rxFrameComplete(port, port->rxKey, port->rxResendRequest);
+		port->rxBit = 0;
+	}
+}
+#endif
+
+/*********************************************************************
+ * @fn      rxFrameComplete
+ *
+ * @brief   handle one received byte, common to all receive engines
+ *
+ * @param   port:	PS/2 port
+ * 			key:	received byte
+ * 			error:	frame had a bad start bit or parity
+ */
+static void rxFrameComplete(ps2Port_t *port, uint8_t key, uint_t error)
+{
+#ifdef KB_TIMING_STATS
+	if (port->type == PS2_PORT_KEYBOARD) {
+		keyboardStats.frames++;
+		if (error) {
+			keyboardStats.parityErrors++;
+		}
+	}
+#endif
+	if (error) {
+		tracePortEvent(port, TRACE_RX_ERROR, key, TRACE_RX_ERR_FRAME);
+		rxError(port);
+		return;
+	}
+
+	// Responses to commands
+	if (cmdResponse(port, key)) {
+		tracePortEvent(port, TRACE_RX_BYTE, key, 0);
+		port->rxErrorRun = 0;
+		return;
+	}
+
+#ifdef KB_PS2_MOUSE
+	// Mouse packets can hold any byte value, taskFxn sorts them out
+	if (port->type == PS2_PORT_MOUSE) {
+		tracePortEvent(port, TRACE_RX_BYTE, key, 0);
+		port->rxErrorRun = 0;
+		bufferWrite(port, key);
+		Semaphore_post(boardSemaphoreHandle);
+		return;
+	}
+#endif
+
+	// Unsolicited, the keyboard was plugged in again, or a stray ACK
+	if (key == BOARD_TEST_PASSED || key == BOARD_ACK) {
+		tracePortEvent(port, TRACE_RX_BYTE, key, 0);
+		port->rxErrorRun = 0;
+		if (key == BOARD_TEST_PASSED) {
+			portReady(port);
+		}
+		return;
+	}
+
+	if (key > SCAN_CODE_END && key != BREAK_CODE && key != EXT_CODE && key != PAUSE_CODE) {
+		tracePortEvent(port, TRACE_RX_ERROR, key, TRACE_RX_ERR_CODE);
+#ifdef KB_TIMING_STATS
+		keyboardStats.invalidCodes++;
+#endif
+		rxError(port);
+		return;
+	}
+
+	tracePortEvent(port, TRACE_RX_BYTE, key, 0);
+	port->rxErrorRun = 0;
+	bufferWrite(port, key);
+	if (key != BREAK_CODE && key != EXT_CODE) {
+		Semaphore_post(boardSemaphoreHandle);
+	}
+}
+
+#ifdef KB_RX_SSI
+/*********************************************************************
+ * @fn      rxSsiDecodeFrame
+ *
+ * @brief   verify and decode one 11 bit frame shifted in MSB first
+ *
+ * @param   frame:	raw frame [start,d0..d7,parity,stop]
+ * 			key:	decoded byte
+ *
+ * @ret		0 if frame is valid, 1 otherwise
+ */
+static uint_t rxSsiDecodeFrame(uint16_t frame, uint8_t *key)
+{
+	uint_t bit, parity = 1;
+	uint8_t value = 0;
+
+	// Data bits arrive LSB first, so d0 sits right below the start bit
+	for (bit = 0; bit < 8; bit++) {
+		if (frame & (1 << (9 - bit))) {
+			value |= 1 << bit;
+			parity ^= 1;
+		}
+	}
+	*key = value;
+
+	if ((frame & (1 << 10)) != 0 ||					// start bit must be 0
+		((frame >> 1) & 0x1) != parity ||			// odd parity
+		(frame & 0x1) != 1) {						// stop bit must be 1
+		rxSsiFrameErrors++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*********************************************************************
+ * @fn      rxSsiStart
+ *
+ * @brief   queue reception of the next frame
+ */
+static void rxSsiStart(void)
+{
+	rxSpiTransaction.count = 1;
+	rxSpiTransaction.txBuf = NULL;
+	rxSpiTransaction.rxBuf = &rxSpiFrame;
+	SPI_transfer(rxSpiHandle, &rxSpiTransaction);
+}
+
+/*********************************************************************
+ * @fn      rxSsiCallback
+ *
+ * @brief   SSI transfer complete callback, runs in Swi context
+ *
+ * @param   handle:			D/C
+ * 			transaction:	completed transaction
+ */
+static void rxSsiCallback(SPI_Handle handle, SPI_Transaction *transaction)
+{
+	uint8_t key;
+	uint_t error;
+
+	if (transaction->status != SPI_TRANSFER_COMPLETED) {
+		return;
+	}
+
+#ifdef KB_TIMING_STATS
+	// Only whole frames are seen here, the gap is measured end to end
+	statsEdgeTime = statsCycles();
+	if (statsFrameEndValid) {
+		statsHistAdd(keyboardStats.frameGapHist, statsLog2((statsEdgeTime - statsFrameEnd) / KB_STATS_CPU_MHZ));
+	}
+	statsFrameEnd = statsEdgeTime;
+	statsFrameEndValid = 1;
+#endif
+
+	error = rxSsiDecodeFrame(rxSpiFrame, &key);
+	rxFrameComplete(&keyboardPort, key, error);
+
+	// Host to Device transfers need the lines back as GPIOs
+	if (cmdReady(&keyboardPort)) {
+		keyboardPort.lineHeld = 1;
+		rxSsiOpenRequest = 0;
+		Swi_post(Swi_handle(&rxSsiSwi));
+	} else {
+		rxSsiStart();
+	}
+}
+
+/*********************************************************************
+ * @fn      rxSsiOpen
+ *
+ * @brief   hand the keyboard lines over to the SSI and start receiving
+ */
+static void rxSsiOpen(void)
+{
+	SPI_Params spiParams;
+	PIN_Id csnPin = KB_RX_SSI_CSN;
+
+	PIN_close(keyboardPort.pinsHandle);
+
+	SPI_Params_init(&spiParams);
+	spiParams.transferMode = SPI_MODE_CALLBACK;
+	spiParams.transferCallbackFxn = rxSsiCallback;
+	spiParams.mode = SPI_SLAVE;
+	spiParams.bitRate = KB_RX_SSI_BIT_RATE;
+	spiParams.dataSize = KB_RX_SSI_FRAME_BITS;
+	// Clock idles high, data is stable while clock is low
+	spiParams.frameFormat = SPI_POL1_PHA1;
+
+	rxSpiHandle = SPI_open(KB_RX_SPI, &spiParams);
+	if (rxSpiHandle == NULL) {
+		System_abort("Failed opening keyboard SSI\n");
+	}
+	SPI_control(rxSpiHandle, SPICC26XXDMA_CMD_SET_CSN_PIN, &csnPin);
+
+	rxSsiStart();
+}
+
+/*********************************************************************
+ * @fn      rxSsiClose
+ *
+ * @brief   take the keyboard lines back from the SSI as GPIOs
+ */
+static void rxSsiClose(void)
+{
+	SPI_transferCancel(rxSpiHandle);
+	SPI_close(rxSpiHandle);
+	rxSpiHandle = NULL;
+
+	keyboardPort.pinsHandle = PIN_open(&keyboardPort.pins, keyboardPort.pinsCfg);
+}
+
+/*********************************************************************
+ * @fn      rxSsiSwiFxn
+ *
+ * @brief   switch between SSI reception and GPIO Host to Device transfer
+ *
+ * @param   a0:		D/C
+ * 			a1:		D/C
+ */
+static void rxSsiSwiFxn(UArg a0, UArg a1)
+{
+	if (rxSsiOpenRequest == 1) {
+		keyboardPort.lineHeld = 0;
+		if (rxSpiHandle == NULL) {
+			rxSsiOpen();
+		}
+		return;
+	}
+
+	if (rxSpiHandle != NULL) {
+		rxSsiClose();
+	}
+
+	// Inhibit communication, as rxCompleteCallback does in GPIO mode
+	holdClock(&keyboardPort);
+
+	if (!cmdService(&keyboardPort)) {
+		keyboardPort.lineHeld = 0;
+		rxSsiOpen();
+	}
+}
+
+/*********************************************************************
+ * @fn      createSsiSwi
+ *
+ * @brief   create Swi switching the keyboard lines to and from the SSI
+ */
+void createSsiSwi(void) {
+	Swi_Params swiParams;
+
+	Swi_Params_init(&swiParams);
+	Swi_construct(&rxSsiSwi, rxSsiSwiFxn, &swiParams, NULL);
+}
+#endif
+
+#ifdef KB_TIMING_STATS
+/*********************************************************************
+ * @fn      statsHistAdd
+ *
+ * @brief   count one sample in a histogram, the last bucket collects
+ * 			everything above the range
+ *
+ * @param   hist:	histogram
+ * 			bucket:	sample bucket
+ */
+static void statsHistAdd(uint16_t *hist, uint32_t bucket) {
+	if (bucket >= KB_STATS_HIST_BUCKETS) {
+		bucket = KB_STATS_HIST_BUCKETS - 1;
+	}
+	if (hist[bucket] != 0xFFFF) {
+		hist[bucket]++;
+	}
+}
+
+/*********************************************************************
+ * @fn      statsLog2
+ *
+ * @brief   integer base 2 logarithm
+ *
+ * @param   value:	value, 0 is treated as 1
+ *
+ * @ret		floor(log2(value))
+ */
+static uint32_t statsLog2(uint32_t value) {
+	uint32_t log = 0;
+
+	while (value >>= 1) {
+		log++;
+	}
+	return log;
+}
+
+#ifndef KB_RX_SSI
+/*********************************************************************
+ * @fn      statsRxEdge
+ *
+ * @brief   account for one Device to Host clock edge, at statsEdgeTime
+ *
+ * @param   bit:	frame bit clocked by this edge
+ */
+static void statsRxEdge(uint_t bit) {
+	uint32_t now = statsEdgeTime;
+
+	// The data line is sampled after the clock edge, if the keyboard already
+	// released the clock the sample may belong to the next bit
+	if (PINCC26XX_getInputValue(KB_CLK) != 0) {
+		keyboardStats.lateEdges++;
+	}
+
+	if (bit == 0) {
+		if (statsFrameEndValid) {
+			statsHistAdd(keyboardStats.frameGapHist, statsLog2((now - statsFrameEnd) / KB_STATS_CPU_MHZ));
+		}
+		statsFrameStart = now;
+	} else {
+		statsHistAdd(keyboardStats.clockPeriodHist, (now - statsLastEdge) / (KB_STATS_CPU_MHZ * KB_STATS_PERIOD_BUCKET_US));
+	}
+
+	if (bit == 10) {
+		statsHistAdd(keyboardStats.frameTimeHist, (now - statsFrameStart) / (KB_STATS_CPU_MHZ * KB_STATS_FRAME_BUCKET_US));
+		statsFrameEnd = now;
+		statsFrameEndValid = 1;
+	}
+
+	statsLastEdge = now;
+}
+#endif
+
+/*********************************************************************
+ * @fn      statsPrintHist
+ *
+ * @brief   write one histogram to the statistics UART
+ *
+ * @param   name:	histogram name
+ * 			hist:	histogram
+ */
+static void statsPrintHist(const char *name, const uint16_t *hist) {
+	uint_t i, len;
+
+	// Leave room for the line end
+	len = System_snprintf(statsLine, sizeof(statsLine) - 2, "%s:", name);
+	for (i = 0; i < KB_STATS_HIST_BUCKETS && len < sizeof(statsLine) - 2; i++) {
+		len += System_snprintf(statsLine + len, sizeof(statsLine) - 2 - len, " %u", hist[i]);
+	}
+	if (len > sizeof(statsLine) - 3) {
+		len = sizeof(statsLine) - 3;
+	}
+	statsLine[len++] = '\r';
+	statsLine[len++] = '\n';
+
+	UART_write(diagUart, statsLine, len);
+}
+
+/*********************************************************************
+ * @fn      statsPrint
+ *
+ * @brief   write statistics to the statistics UART, task context only
+ */
+static void statsPrint(void) {
+	uint16_t len;
+	keyboardStats_t *stats = (keyboardStats_t *)Keyboard_getStats(&len);
+
+	len = System_snprintf(statsLine, sizeof(statsLine),
+			"frames %lu parity %u invalid %u resend %u noack %u late %u overflow %u abort %u reinit %u\r\n",
+			(unsigned long)stats->frames, stats->parityErrors, stats->invalidCodes,
+			stats->resendsSent, stats->txAckErrors, stats->lateEdges, stats->bufferOverflows,
+			stats->abortedFrames, stats->reinits);
+	UART_write(diagUart, statsLine, len < sizeof(statsLine) ? len : sizeof(statsLine) - 1);
+
+	statsPrintHist("period/8us", stats->clockPeriodHist);
+	statsPrintHist("frame/100us", stats->frameTimeHist);
+	statsPrintHist("gap/log2us", stats->frameGapHist);
+	statsPrintHist("led/500us", stats->ledLatencyHist);
+	statsPrintHist("key/log2(100us)", stats->keyLatencyHist);
+
+	len = System_snprintf(statsLine, sizeof(statsLine), "appdrop %u apppeak %u\r\n",
+			stats->appEventDrops, stats->appEventPeak);
+	UART_write(diagUart, statsLine, len < sizeof(statsLine) ? len : sizeof(statsLine) - 1);
+
+	len = System_snprintf(statsLine, sizeof(statsLine),
+			"rptq overflow %u merged %u collapsed %u dropped %u\r\n",
+			stats->reportQOverflows, stats->reportQMerged, stats->reportQCollapsed,
+			stats->reportQDropped);
+	UART_write(diagUart, statsLine, len < sizeof(statsLine) ? len : sizeof(statsLine) - 1);
+}
+
+/*********************************************************************
+ * @fn      statsUartReadCallback
+ *
+ * @brief   statistics UART receive callback, a query character has the
+ * 			keyboard task dump the statistics
+ *
+ * @param   handle:	D/C
+ * 			buf:	D/C
+ * 			count:	number of bytes received
+ */
+static void statsUartReadCallback(UART_Handle handle, void *buf, size_t count) {
+	if (count == 1 && statsUartRx == KB_STATS_QUERY_CHAR) {
+		statsQueryPending = 1;
+#ifndef KB_TRACE
+		Semaphore_post(boardSemaphoreHandle);
+#endif
+	}
+	UART_read(diagUart, &statsUartRx, 1);
+}
+
+/*********************************************************************
+ * @fn      createStats
+ *
+ * @brief   start the cycle counter
+ */
+void createStats(void) {
+	HWREG(CPU_SCS_BASE + CPU_SCS_O_DEMCR) |= CPU_SCS_DEMCR_TRCENA;
+	HWREG(CPU_DWT_BASE + CPU_DWT_O_CTRL) |= CPU_DWT_CTRL_CYCCNTENA;
+}
+#endif
+
+#ifdef KB_TRACE
+/*********************************************************************
+ * @fn      traceDrain
+ *
+ * @brief   write the committed trace records to the diagnostics UART
+ */
+static void traceDrain(void) {
+	traceRecord_t *record;
+	uint8_t *frame;
+	uint16_t lost;
+	uint_t count;
+	UInt key;
+
+	do {
+		// Account for dropped records once the ring has room for it, or
+		// the count would be lost along with the record
+		key = Hwi_disable();
+		if (traceLostCount != 0 &&
+				(uint8_t)(traceWritePos - traceReadPos) < KB_TRACE_SIZE) {
+			lost = traceLostCount;
+			traceLostCount = 0;
+			traceEvent(TRACE_LOST, 0, lost);
+		}
+		Hwi_restore(key);
+
+		count = 0;
+		frame = traceFrames;
+		while (count < KB_TRACE_BATCH && traceReadPos != traceWritePos) {
+			record = &traceRing[traceReadPos & KB_TRACE_MASK];
+			if (*(volatile uint8_t *)&record->id == 0) {
+				// Reserved, but the producer has not finished yet
+				break;
 			}
+
+			frame[0] = KB_TRACE_SYNC;
+			frame[1] = record->id;
+			frame[2] = record->arg8;
+			frame[3] = record->arg16 & 0xFF;
+			frame[4] = record->arg16 >> 8;
+			frame[5] = record->time & 0xFF;
+			frame[6] = (record->time >> 8) & 0xFF;
+			frame[7] = (record->time >> 16) & 0xFF;
+			frame[8] = record->time >> 24;
+			frame += KB_TRACE_FRAME_LEN;
+			count++;
+
+			record->id = 0;
+			traceReadPos++;
+		}
+
+		if (count != 0) {
+			UART_write(diagUart, traceFrames, count * KB_TRACE_FRAME_LEN);
+		}
+	} while (count == KB_TRACE_BATCH);
+}
+
+/*********************************************************************
+ * @fn      traceTaskFxn
+ *
+ * @brief   trace drain loop, runs below the keyboard and application tasks
+ * 			so UART output never delays key handling
+ *
+ * @param   a0:		D/C
+ * 			a1:		D/C
+ */
+static void traceTaskFxn(UArg a0, UArg a1) {
+#ifdef KB_TIMING_STATS
+	traceEvent(TRACE_START, TRACE_TIME_CYCLES, KB_STATS_CPU_MHZ);
+#else
+	traceEvent(TRACE_START, TRACE_TIME_CLOCK, Clock_tickPeriod);
+#endif
+
+	for (;;) {
+		traceDrain();
+
+#ifdef KB_TIMING_STATS
+		if (statsQueryPending == 1) {
+			statsQueryPending = 0;
+			statsPrint();
 		}
-		bit = 0;
+#endif
+
+		Task_sleep(KB_TRACE_DRAIN_MS * (1000 / Clock_tickPeriod));
+	}
+}
+
+/*********************************************************************
+ * @fn      createTrace
+ *
+ * @brief   create task draining the trace ring
+ */
+void createTrace(void) {
+	Task_Params_init(&traceTaskParams);
+	traceTaskParams.stack = traceTaskStack;
+	traceTaskParams.stackSize = KB_TRACE_TASK_STACK_SIZE;
+	traceTaskParams.priority = KB_TRACE_TASK_PRIORITY;
+
+	Task_construct(&traceTask, traceTaskFxn, &traceTaskParams, NULL);
+}
+#endif
+
+#if defined(KB_TIMING_STATS) || defined(KB_TRACE)
+/*********************************************************************
+ * @fn      createDiagUart
+ *
+ * @brief   open the diagnostics UART, written from task context only
+ */
+void createDiagUart(void) {
+	UART_Params uartParams;
+
+	UART_Params_init(&uartParams);
+	uartParams.baudRate = KB_DIAG_UART_BAUD;
+	uartParams.writeDataMode = UART_DATA_BINARY;
+#ifdef KB_TIMING_STATS
+	uartParams.readMode = UART_MODE_CALLBACK;
+	uartParams.readCallback = statsUartReadCallback;
+	uartParams.readDataMode = UART_DATA_BINARY;
+	uartParams.readEcho = UART_ECHO_OFF;
+#endif
+
+	diagUart = UART_open(KB_DIAG_UART, &uartParams);
+	if (diagUart == NULL) {
+		System_abort("Failed opening diagnostics UART\n");
 	}
+#ifdef KB_TIMING_STATS
+	UART_read(diagUart, &statsUartRx, 1);
+#endif
 }
+#endif
 
 /*********************************************************************
  * @fn      txCallback
  *
  * @brief   callback function for Host to Device transfer
  *
- * @param   hPin:		D/C
+ * @param   hPin:		PIN handle of the port
  * 			pinId:		D/C
  */
 static void txCallback(PIN_Handle hPin, PIN_Id pinId) {
-	static uint_t data_value, parity = 1, bit = 0;
+	ps2Port_t *port = portFromPins(hPin);
+	uint_t data_value, bit = port->txBit;
 
 	if (bit < 8) {
-		data_value = (tx_byte >> bit) & 0x1;
-		PINCC26XX_setOutputValue(KB_DATA, data_value);
-		parity ^= data_value;
-		bit++;
+		data_value = (port->txByte >> bit) & 0x1;
+		PINCC26XX_setOutputValue(port->dataPin, data_value);
+		port->txParity ^= data_value;
+		port->txBit = bit + 1;
 	} else if (bit == 8) {
-		PINCC26XX_setOutputValue(KB_DATA, parity);
-		bit++;
+		PINCC26XX_setOutputValue(port->dataPin, port->txParity);
+		port->txBit = bit + 1;
 	} else if (bit == 9) {
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_GPIO_OUTPUT_EN	, KB_DATA | PIN_GPIO_OUTPUT_DIS);
-		PIN_setConfig(keyboardPinsHandler, PIN_BM_INPUT_EN			, KB_DATA | PIN_INPUT_EN);
-		bit++;
+		PIN_setConfig(port->pinsHandle, PIN_BM_GPIO_OUTPUT_EN	, port->dataPin | PIN_GPIO_OUTPUT_DIS);
+		PIN_setConfig(port->pinsHandle, PIN_BM_INPUT_EN			, port->dataPin | PIN_INPUT_EN);
+		port->txBit = bit + 1;
 	} else if (bit == 10) {
-		bit = 0;
-		parity = 1;
-		stopTx();
+		port->txBit = 0;
+		port->txParity = 1;
+
+		// Device pulls data line low to ACK the frame
+		if (PINCC26XX_getInputValue(port->dataPin) != 0) {
+			port->txAckErrors++;
+			tracePortEvent(port, TRACE_TX_NOACK, port->txByte, port->txRetries);
+			if (port->txRetries < KB_TX_RETRIES) {
+				port->txRetries++;
+				holdClock(port);
+				startTx(port);
+				return;
+			}
+		}
+		port->txRetries = 0;
+		stopTx(port);
+	}
+}
+
+/*********************************************************************
+ * @fn      lineClockCallback
+ *
+ * @brief   line timer expiry, ends the current timed phase
+ *
+ * @param   arg:	PS/2 port
+ */
+static void lineClockCallback(UArg arg) {
+	ps2Port_t *port = (ps2Port_t *)arg;
+
+	if (port->linePhase == KB_LINE_TX_INHIBIT) {
+		requestToSend(port);
+	}
+#ifndef KB_RX_SSI
+	else if (!cmdService(port)) {
+		// Nothing to send while the clock line is still inhibited
+		rxReleaseClock(port);
 	}
+#endif
 }
 
 /*********************************************************************
@@ -598,9 +2791,6 @@ void Keyboard_init(keysPressedCB_t appKeyCB){
 
   LED_changeState(Board_LED0, 1);
 
-  // Initialize KEY pins. Enable int after callback registered
-  keyboardPinsHandler = PIN_open(&keyboardPins, keyboardPinsCfg);
-
   // Set the application callback
   appKeyChangeHandler = appKeyCB;
 
@@ -610,11 +2800,72 @@ void Keyboard_init(keysPressedCB_t appKeyCB){
   // Create task
   createTask();
 
-  // Reset keyboard
-  resetKeyboard();
+  // Open the ports
+  createPort(&keyboardPort);
+#ifdef KB_PS2_MOUSE
+  createPort(&mousePort);
+#endif
+
+#ifdef KB_TIMING_STATS
+  // Start statistics collection
+  createStats();
+#endif
+
+#if defined(KB_TIMING_STATS) || defined(KB_TRACE)
+  // Open diagnostics UART
+  createDiagUart();
+#endif
+
+#ifdef KB_TRACE
+  // Create trace drain task
+  createTrace();
+#endif
+
+#ifdef KB_RX_SSI
+  // Create SSI switch Swi
+  createSsiSwi();
+#endif
+
+  // Reset the devices
+  resetPort(&keyboardPort);
+#ifdef KB_PS2_MOUSE
+  resetPort(&mousePort);
+#endif
+}
+
+void Keyboard_registerBatchCB(keysBatchCB_t appBatchCB){
+	appKeyBatchHandler = appBatchCB;
 }
 
 void Keyboard_changeLedState(uint8_t state){
 	latestLedState = state;
-	pendingLedRequest = 1;
+	cmdPushLed();
+
+	// Don't wait for the keyboard to send something, take the bus now
+	lineAcquire(&keyboardPort);
+}
+
+#ifdef KB_PS2_MOUSE
+void Keyboard_registerMouseCB(mouseMovedCB_t appMouseCB){
+	appMouseHandler = appMouseCB;
 }
+#endif
+
+#ifdef KB_TIMING_STATS
+uint8_t *Keyboard_getStats(uint16_t *pLen){
+	keyboardStats.txAckErrors = keyboardPort.txAckErrors;
+	keyboardStats.bufferOverflows = keyboardPort.bufferOverflows;
+	keyboardStats.abortedFrames = keyboardPort.rxAbortedFrames;
+	keyboardStats.reinits = keyboardPort.reinits;
+
+	*pLen = sizeof(keyboardStats);
+	return (uint8_t *)&keyboardStats;
+}
+
+void Keyboard_keyReported(uint32_t time){
+	if (time != 0) {
+		statsHistAdd(keyboardStats.keyLatencyHist,
+				statsLog2((statsCycles() - time) / (KB_STATS_CPU_MHZ * KB_STATS_KEY_BUCKET_US)));
+	}
+}
+#endif
@@ -62,270 +62,330 @@ extern "C" {
 #define BOARD_KEY_CHANGE_EVT			0x01
 #define BOARD_MOD_CHANGE_EVT			0x02
 #define BOARD_BREAK_CODE_EVT			0x04
+#define BOARD_CONSUMER_CHANGE_EVT		0x08
 
-#define SCAN_CODE_SET_2_TO_HID		{						\
-										{ 0x0	,	0x0	 },	\
-										{ 0x42	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x3E	,	0x0	 },	\
-										{ 0x3C	,	0x0	 },	\
-										{ 0x3A	,	0x0	 },	\
-										{ 0x3B	,	0x0	 },	\
-										{ 0x45	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x43	,	0x0	 },	\
-										{ 0x41	,	0x0	 },	\
-										{ 0x3F	,	0x0	 },	\
-										{ 0x3D	,	0x0	 },	\
-										{ 0x2B	,	0x0	 },	\
-										{ 0x35	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x04	,	0x40 },	\
-										{ 0x02	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x01	,	0x10 },	\
-										{ 0x14	,	0x0	 },	\
-										{ 0x1E	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x1D	,	0x0	 },	\
-										{ 0x16	,	0x0	 },	\
-										{ 0x04	,	0x0	 },	\
-										{ 0x1A	,	0x0	 },	\
-										{ 0x1F	,	0x0	 },	\
-										{ 0x0	,	0x8  },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x06	,	0x81 },	\
-										{ 0x1B	,	0x0	 },	\
-										{ 0x07	,	0x7F },	\
-										{ 0x08	,	0x0	 },	\
-										{ 0x21	,	0x0	 },	\
-										{ 0x20	,	0x0	 },	\
-										{ 0x0	,	0x80 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x2C	,	0x0	 },	\
-										{ 0x19	,	0x0	 },	\
-										{ 0x09	,	0x0	 },	\
-										{ 0x17	,	0x0	 },	\
-										{ 0x15	,	0x0	 },	\
-										{ 0x22	,	0x0	 },	\
-										{ 0x0	,	0x65 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x11	,	0x0	 },	\
-										{ 0x05	,	0x80 },	\
-										{ 0x0B	,	0x0	 },	\
-										{ 0x0A	,	0x74 },	\
-										{ 0x1C	,	0x0	 },	\
-										{ 0x23	,	0x0	 },	\
-										{ 0x0	,	0x66 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x10	,	0x0	 },	\
-										{ 0x0D	,	0x78 },	\
-										{ 0x18	,	0x0	 },	\
-										{ 0x24	,	0x0	 },	\
-										{ 0x25	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x36	,	0x0	 },	\
-										{ 0x0E	,	0x0	 },	\
-										{ 0x0C	,	0x0	 },	\
-										{ 0x12	,	0x0	 },	\
-										{ 0x27	,	0x0	 },	\
-										{ 0x26	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x37	,	0x0	 },	\
-										{ 0x38	,	0x54 },	\
-										{ 0xF	,	0x0	 },	\
-										{ 0x33	,	0x0	 },	\
-										{ 0x13	,	0x0	 },	\
-										{ 0x2D	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x34	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x2F	,	0x0	 },	\
-										{ 0x2E	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x39	,	0x0	 },	\
-										{ 0x20	,	0x0	 },	\
-										{ 0x28	,	0x58 },	\
-										{ 0x30	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x31	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x2A	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x59	,	0x4D },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x5C	,	0x50 },	\
-										{ 0x5F	,	0x4A },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x62	,	0x49 },	\
-										{ 0x63	,	0x4C },	\
-										{ 0x5A	,	0x51 },	\
-										{ 0x5D	,	0x0	 },	\
-										{ 0x5E	,	0x4F },	\
-										{ 0x60	,	0x52 },	\
-										{ 0x29	,	0x0	 },	\
-										{ 0x53	,	0x0	 },	\
-										{ 0x44	,	0x0	 },	\
-										{ 0x57	,	0x0	 },	\
-										{ 0x5B	,	0x4E },	\
-										{ 0x56	,	0x0	 },	\
-										{ 0x55	,	0x0	 },	\
-										{ 0x61	,	0x4B },	\
-										{ 0x47	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x40	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 },	\
-										{ 0x0	,	0x0	 }	\
-									 };
+// Largest number of key events handed over in one batch
+#define KB_BATCH_MAX_EVENTS				8
+
+// Scan code set 2 to USB HID keymap. Single source for the lookup tables in
+// Keyboard.c, expanded with X(scan code, HID usage). Modifier keys map to
+// their bit in the HID modifier byte.
+#define SCAN_CODE_SET_2_KEYMAP(X)					\
+		X(0x01,	0x42)	/* F9 */	\
+		X(0x03,	0x3E)	/* F5 */	\
+		X(0x04,	0x3C)	/* F3 */	\
+		X(0x05,	0x3A)	/* F1 */	\
+		X(0x06,	0x3B)	/* F2 */	\
+		X(0x07,	0x45)	/* F12 */	\
+		X(0x09,	0x43)	/* F10 */	\
+		X(0x0A,	0x41)	/* F8 */	\
+		X(0x0B,	0x3F)	/* F6 */	\
+		X(0x0C,	0x3D)	/* F4 */	\
+		X(0x0D,	0x2B)	/* Tab */	\
+		X(0x0E,	0x35)	/* ` */	\
+		X(0x11,	0x04)	/* L Alt */	\
+		X(0x12,	0x02)	/* L Shift */	\
+		X(0x14,	0x01)	/* L Ctrl */	\
+		X(0x15,	0x14)	/* Q */	\
+		X(0x16,	0x1E)	/* 1 */	\
+		X(0x1A,	0x1D)	/* Z */	\
+		X(0x1B,	0x16)	/* S */	\
+		X(0x1C,	0x04)	/* A */	\
+		X(0x1D,	0x1A)	/* W */	\
+		X(0x1E,	0x1F)	/* 2 */	\
+		X(0x21,	0x06)	/* C */	\
+		X(0x22,	0x1B)	/* X */	\
+		X(0x23,	0x07)	/* D */	\
+		X(0x24,	0x08)	/* E */	\
+		X(0x25,	0x21)	/* 4 */	\
+		X(0x26,	0x20)	/* 3 */	\
+		X(0x29,	0x2C)	/* Space */	\
+		X(0x2A,	0x19)	/* V */	\
+		X(0x2B,	0x09)	/* F */	\
+		X(0x2C,	0x17)	/* T */	\
+		X(0x2D,	0x15)	/* R */	\
+		X(0x2E,	0x22)	/* 5 */	\
+		X(0x31,	0x11)	/* N */	\
+		X(0x32,	0x05)	/* B */	\
+		X(0x33,	0x0B)	/* H */	\
+		X(0x34,	0x0A)	/* G */	\
+		X(0x35,	0x1C)	/* Y */	\
+		X(0x36,	0x23)	/* 6 */	\
+		X(0x3A,	0x10)	/* M */	\
+		X(0x3B,	0x0D)	/* J */	\
+		X(0x3C,	0x18)	/* U */	\
+		X(0x3D,	0x24)	/* 7 */	\
+		X(0x3E,	0x25)	/* 8 */	\
+		X(0x41,	0x36)	/* , */	\
+		X(0x42,	0x0E)	/* K */	\
+		X(0x43,	0x0C)	/* I */	\
+		X(0x44,	0x12)	/* O */	\
+		X(0x45,	0x27)	/* 0 */	\
+		X(0x46,	0x26)	/* 9 */	\
+		X(0x49,	0x37)	/* . */	\
+		X(0x4A,	0x38)	/* / */	\
+		X(0x4B,	0x0F)	/* L */	\
+		X(0x4C,	0x33)	/* ; */	\
+		X(0x4D,	0x13)	/* P */	\
+		X(0x4E,	0x2D)	/* - */	\
+		X(0x52,	0x34)	/* ' */	\
+		X(0x54,	0x2F)	/* [ */	\
+		X(0x55,	0x2E)	/* = */	\
+		X(0x58,	0x39)	/* Caps Lock */	\
+		X(0x59,	0x20)	/* R Shift */	\
+		X(0x5A,	0x28)	/* Enter */	\
+		X(0x5B,	0x30)	/* ] */	\
+		X(0x5D,	0x31)	/* Backslash */	\
+		X(0x66,	0x2A)	/* Backspace */	\
+		X(0x69,	0x59)	/* KP 1 */	\
+		X(0x6B,	0x5C)	/* KP 4 */	\
+		X(0x6C,	0x5F)	/* KP 7 */	\
+		X(0x70,	0x62)	/* KP 0 */	\
+		X(0x71,	0x63)	/* KP . */	\
+		X(0x72,	0x5A)	/* KP 2 */	\
+		X(0x73,	0x5D)	/* KP 5 */	\
+		X(0x74,	0x5E)	/* KP 6 */	\
+		X(0x75,	0x60)	/* KP 8 */	\
+		X(0x76,	0x29)	/* Esc */	\
+		X(0x77,	0x53)	/* Num Lock */	\
+		X(0x78,	0x44)	/* F11 */	\
+		X(0x79,	0x57)	/* KP + */	\
+		X(0x7A,	0x5B)	/* KP 3 */	\
+		X(0x7B,	0x56)	/* KP - */	\
+		X(0x7C,	0x55)	/* KP * */	\
+		X(0x7D,	0x61)	/* KP 9 */	\
+		X(0x7E,	0x47)	/* Scroll Lock */	\
+		X(0x83,	0x40)	/* F7 */	\
+		X(0x84,	0x46)	/* Alt+SysRq */
+
+// Extended (E0 prefixed) scan codes
+#define SCAN_CODE_SET_2_EXT_KEYMAP(X)				\
+		X(0x11,	0x40)	/* R Alt */	\
+		X(0x14,	0x10)	/* R Ctrl */	\
+		X(0x1F,	0x08)	/* L GUI */	\
+		X(0x27,	0x80)	/* R GUI */	\
+		X(0x2F,	0x65)	/* Apps */	\
+		X(0x4A,	0x54)	/* KP / */	\
+		X(0x5A,	0x58)	/* KP Enter */	\
+		X(0x69,	0x4D)	/* End */	\
+		X(0x6B,	0x50)	/* Left */	\
+		X(0x6C,	0x4A)	/* Home */	\
+		X(0x70,	0x49)	/* Insert */	\
+		X(0x71,	0x4C)	/* Delete */	\
+		X(0x72,	0x51)	/* Down */	\
+		X(0x74,	0x4F)	/* Right */	\
+		X(0x75,	0x52)	/* Up */	\
+		X(0x7A,	0x4E)	/* Page Down */	\
+		X(0x7C,	0x46)	/* PrintScreen */	\
+		X(0x7D,	0x4B)	/* Page Up */	\
+		X(0x7E,	0x48)	/* Ctrl+Break */
+
+// Extended scan codes of multimedia keyboards to HID consumer page usages,
+// expanded with X(scan code, consumer usage). Usages do not fit the key
+// field of an event, so BOARD_CONSUMER_CHANGE_EVT carries the 1 based
+// position in this list instead.
+#define SCAN_CODE_SET_2_CONSUMER_KEYMAP(X)			\
+		X(0x10,	0x0221)	/* WWW Search */	\
+		X(0x15,	0x00B6)	/* Previous Track */	\
+		X(0x18,	0x022A)	/* WWW Favorites */	\
+		X(0x20,	0x0227)	/* WWW Refresh */	\
+		X(0x21,	0x00EA)	/* Volume Down */	\
+		X(0x23,	0x00E2)	/* Mute */	\
+		X(0x28,	0x0226)	/* WWW Stop */	\
+		X(0x2B,	0x0192)	/* Calculator */	\
+		X(0x30,	0x0225)	/* WWW Forward */	\
+		X(0x32,	0x00E9)	/* Volume Up */	\
+		X(0x34,	0x00CD)	/* Play/Pause */	\
+		X(0x37,	0x0030)	/* Power */	\
+		X(0x38,	0x0224)	/* WWW Back */	\
+		X(0x3A,	0x0223)	/* WWW Home */	\
+		X(0x3B,	0x00B7)	/* Stop */	\
+		X(0x3F,	0x0032)	/* Sleep */	\
+		X(0x40,	0x0194)	/* My Computer */	\
+		X(0x48,	0x018A)	/* E-Mail */	\
+		X(0x4D,	0x00B5)	/* Next Track */	\
+		X(0x50,	0x0183)	/* Media Select */
+
+// Largest scan code in the consumer keymap
+#define SCAN_CODE_SET_2_CONSUMER_LAST	0x50
+
+// Scan code set 3 to USB HID keymap, used when built with KB_SCAN_CODE_SET_3.
+// Set 3 has no E0 prefixed codes.
+#define SCAN_CODE_SET_3_KEYMAP(X)					\
+		X(0x07,	0x3A)	/* F1 */	\
+		X(0x08,	0x29)	/* Esc */	\
+		X(0x0D,	0x2B)	/* Tab */	\
+		X(0x0E,	0x35)	/* ` */	\
+		X(0x0F,	0x3B)	/* F2 */	\
+		X(0x11,	0x01)	/* L Ctrl */	\
+		X(0x12,	0x02)	/* L Shift */	\
+		X(0x14,	0x39)	/* Caps Lock */	\
+		X(0x15,	0x14)	/* Q */	\
+		X(0x16,	0x1E)	/* 1 */	\
+		X(0x17,	0x3C)	/* F3 */	\
+		X(0x19,	0x04)	/* L Alt */	\
+		X(0x1A,	0x1D)	/* Z */	\
+		X(0x1B,	0x16)	/* S */	\
+		X(0x1C,	0x04)	/* A */	\
+		X(0x1D,	0x1A)	/* W */	\
+		X(0x1E,	0x1F)	/* 2 */	\
+		X(0x1F,	0x3D)	/* F4 */	\
+		X(0x21,	0x06)	/* C */	\
+		X(0x22,	0x1B)	/* X */	\
+		X(0x23,	0x07)	/* D */	\
+		X(0x24,	0x08)	/* E */	\
+		X(0x25,	0x21)	/* 4 */	\
+		X(0x26,	0x20)	/* 3 */	\
+		X(0x27,	0x3E)	/* F5 */	\
+		X(0x29,	0x2C)	/* Space */	\
+		X(0x2A,	0x19)	/* V */	\
+		X(0x2B,	0x09)	/* F */	\
+		X(0x2C,	0x17)	/* T */	\
+		X(0x2D,	0x15)	/* R */	\
+		X(0x2E,	0x22)	/* 5 */	\
+		X(0x2F,	0x3F)	/* F6 */	\
+		X(0x31,	0x11)	/* N */	\
+		X(0x32,	0x05)	/* B */	\
+		X(0x33,	0x0B)	/* H */	\
+		X(0x34,	0x0A)	/* G */	\
+		X(0x35,	0x1C)	/* Y */	\
+		X(0x36,	0x23)	/* 6 */	\
+		X(0x37,	0x40)	/* F7 */	\
+		X(0x39,	0x40)	/* R Alt */	\
+		X(0x3A,	0x10)	/* M */	\
+		X(0x3B,	0x0D)	/* J */	\
+		X(0x3C,	0x18)	/* U */	\
+		X(0x3D,	0x24)	/* 7 */	\
+		X(0x3E,	0x25)	/* 8 */	\
+		X(0x3F,	0x41)	/* F8 */	\
+		X(0x41,	0x36)	/* , */	\
+		X(0x42,	0x0E)	/* K */	\
+		X(0x43,	0x0C)	/* I */	\
+		X(0x44,	0x12)	/* O */	\
+		X(0x45,	0x27)	/* 0 */	\
+		X(0x46,	0x26)	/* 9 */	\
+		X(0x47,	0x42)	/* F9 */	\
+		X(0x49,	0x37)	/* . */	\
+		X(0x4A,	0x38)	/* / */	\
+		X(0x4B,	0x0F)	/* L */	\
+		X(0x4C,	0x33)	/* ; */	\
+		X(0x4D,	0x13)	/* P */	\
+		X(0x4E,	0x2D)	/* - */	\
+		X(0x4F,	0x43)	/* F10 */	\
+		X(0x52,	0x34)	/* ' */	\
+		X(0x54,	0x2F)	/* [ */	\
+		X(0x55,	0x2E)	/* = */	\
+		X(0x56,	0x44)	/* F11 */	\
+		X(0x57,	0x46)	/* PrintScreen */	\
+		X(0x58,	0x10)	/* R Ctrl */	\
+		X(0x59,	0x20)	/* R Shift */	\
+		X(0x5A,	0x28)	/* Enter */	\
+		X(0x5B,	0x30)	/* ] */	\
+		X(0x5C,	0x31)	/* Backslash */	\
+		X(0x5E,	0x45)	/* F12 */	\
+		X(0x5F,	0x47)	/* Scroll Lock */	\
+		X(0x60,	0x51)	/* Down */	\
+		X(0x61,	0x50)	/* Left */	\
+		X(0x62,	0x48)	/* Pause */	\
+		X(0x63,	0x52)	/* Up */	\
+		X(0x64,	0x4C)	/* Delete */	\
+		X(0x65,	0x4D)	/* End */	\
+		X(0x66,	0x2A)	/* Backspace */	\
+		X(0x67,	0x49)	/* Insert */	\
+		X(0x69,	0x59)	/* KP 1 */	\
+		X(0x6A,	0x4F)	/* Right */	\
+		X(0x6B,	0x5C)	/* KP 4 */	\
+		X(0x6C,	0x5F)	/* KP 7 */	\
+		X(0x6D,	0x4E)	/* Page Down */	\
+		X(0x6E,	0x4A)	/* Home */	\
+		X(0x6F,	0x4B)	/* Page Up */	\
+		X(0x70,	0x62)	/* KP 0 */	\
+		X(0x71,	0x63)	/* KP . */	\
+		X(0x72,	0x5A)	/* KP 2 */	\
+		X(0x73,	0x5D)	/* KP 5 */	\
+		X(0x74,	0x5E)	/* KP 6 */	\
+		X(0x75,	0x60)	/* KP 8 */	\
+		X(0x76,	0x53)	/* Num Lock */	\
+		X(0x77,	0x54)	/* KP / */	\
+		X(0x79,	0x58)	/* KP Enter */	\
+		X(0x7A,	0x5B)	/* KP 3 */	\
+		X(0x7C,	0x57)	/* KP + */	\
+		X(0x7D,	0x61)	/* KP 9 */	\
+		X(0x7E,	0x55)	/* KP * */	\
+		X(0x84,	0x56)	/* KP - */	\
+		X(0x8B,	0x08)	/* L GUI */	\
+		X(0x8C,	0x80)	/* R GUI */	\
+		X(0x8D,	0x65)	/* Apps */
+
+#ifdef KB_TIMING_STATS
+// Number of buckets in each PS/2 timing histogram
+#define KB_STATS_HIST_BUCKETS			16
+#define KB_STATS_PERIOD_BUCKET_US		8		// clock period histogram bucket width
+#define KB_STATS_FRAME_BUCKET_US		100		// frame duration histogram bucket width
+#define KB_STATS_LED_BUCKET_US			500		// LED update latency histogram bucket width
+#define KB_STATS_KEY_BUCKET_US			100		// key latency histogram base, buckets double from here
+#endif
 
 /*********************************************************************
  * TYPEDEFS
  */
-typedef void (*keysPressedCB_t)(uint8_t event, uint8_t keysPressed);
+// Consumer keys, numbered from 1 in keymap order
+#define CONSUMER_KEY_ENUM(code, usage)	CONSUMER_KEY_##code,
+enum
+{
+	CONSUMER_KEY_NONE = 0,
+	SCAN_CODE_SET_2_CONSUMER_KEYMAP(CONSUMER_KEY_ENUM)
+	CONSUMER_KEY_COUNT
+};
+
+// Key event callback, time is the cycle counter when the last byte of the
+// key's scan code was received, 0 if not measured
+typedef void (*keysPressedCB_t)(uint8_t event, uint8_t keysPressed, uint32_t time);
+
+// Decoded key event
+typedef struct
+{
+	uint8_t		event;		// BOARD_*_EVT bitmask
+	uint8_t		key;		// HID usage, modifier bit for BOARD_MOD_CHANGE_EVT,
+							// consumer key for BOARD_CONSUMER_CHANGE_EVT
+	uint32_t	time;		// capture time, as passed to keysPressedCB_t
+} keyEvent_t;
+
+// Key events decoded in one keyboard task wakeup, in arrival order
+typedef void (*keysBatchCB_t)(uint8_t numEvents, const keyEvent_t *events);
+
+#ifdef KB_PS2_MOUSE
+// One mouse packet: button state [0,0,0,0,0,MIDDLE,RIGHT,LEFT] and the
+// movement since the previous packet, in HID directions
+typedef void (*mouseMovedCB_t)(uint8_t buttons, int16_t dx, int16_t dy, int8_t wheel);
+#endif
+
+#ifdef KB_TIMING_STATS
+// PS/2 link statistics. Histogram counters saturate instead of wrapping.
+typedef struct
+{
+	uint32_t	frames;					// frames received
+	uint16_t	parityErrors;			// frames with bad start, parity or stop bit
+	uint16_t	invalidCodes;			// bytes outside the active scan code set
+	uint16_t	resendsSent;			// resend requests sent to the keyboard
+	uint16_t	txAckErrors;			// host to device frames not ACKed
+	uint16_t	lateEdges;				// clock already high when the edge was serviced
+	uint16_t	bufferOverflows;		// scan codes dropped on a full buffer
+	uint16_t	abortedFrames;			// frames cut short by the frame watchdog
+	uint16_t	reinits;				// keyboard resets after repeated errors
+	uint16_t	clockPeriodHist[KB_STATS_HIST_BUCKETS];	// falling edge to falling edge
+	uint16_t	frameTimeHist[KB_STATS_HIST_BUCKETS];	// start bit to stop bit
+	uint16_t	frameGapHist[KB_STATS_HIST_BUCKETS];	// log2(us) from stop bit to next start bit
+	uint16_t	ledLatencyHist[KB_STATS_HIST_BUCKETS];	// Keyboard_changeLedState to LED state ACK
+	uint16_t	keyLatencyHist[KB_STATS_HIST_BUCKETS];	// log2 of 100 us units from scan code to notification sent
+	uint16_t	appEventDrops;			// events dropped on a full application event ring
+	uint16_t	appEventPeak;			// deepest the application event ring has been
+	uint16_t	reportQOverflows;		// HidDev report queue counters, hidDevReportQStats_t,
+	uint16_t	reportQMerged;			// as of the last connection change or statistics read
+	uint16_t	reportQCollapsed;
+	uint16_t	reportQDropped;
+} keyboardStats_t;
+#endif
 
 
 /*********************************************************************
@@ -341,14 +401,60 @@ typedef void (*keysPressedCB_t)(uint8_t event, uint8_t keysPressed);
  */
 void Keyboard_init(keysPressedCB_t appKeyCB);
 
+/*********************************************************************
+ * @fn      Keyboard_registerBatchCB
+ *
+ * @brief   hand key events over in batches instead of one by one
+ *
+ * @param   appBatchCB:	HID key batch callback function, replaces the
+ * 						callback given to Keyboard_init
+ */
+void Keyboard_registerBatchCB(keysBatchCB_t appBatchCB);
+
 /*********************************************************************
  * @fn      Keyboard_changeLedState
  *
- * @brief   Change LED state
+ * @brief   Change LED state, the LED command is sent right away unless a
+ * 			frame is on the way
  *
  * @param   state:	LED new state in USB HID format: [0,0,0,0,0,SCROLL,CAPS,NUM]
  */
 void Keyboard_changeLedState(uint8_t state);
+
+#ifdef KB_PS2_MOUSE
+/*********************************************************************
+ * @fn      Keyboard_registerMouseCB
+ *
+ * @brief   hand mouse packets over to the application, called from the
+ * 			keyboard task
+ *
+ * @param   appMouseCB:	mouse packet callback function
+ */
+void Keyboard_registerMouseCB(mouseMovedCB_t appMouseCB);
+#endif
+
+#ifdef KB_TIMING_STATS
+/*********************************************************************
+ * @fn      Keyboard_getStats
+ *
+ * @brief   Get PS/2 link statistics
+ *
+ * @param   pLen:	set to the statistics length
+ *
+ * @ret		statistics, laid out as keyboardStats_t
+ */
+uint8_t *Keyboard_getStats(uint16_t *pLen);
+
+/*********************************************************************
+ * @fn      Keyboard_keyReported
+ *
+ * @brief   account for a key event whose report was accepted by the
+ * 			BLE stack
+ *
+ * @param   time:	capture time passed with the key event, ignored if 0
+ */
+void Keyboard_keyReported(uint32_t time);
+#endif
 /*********************************************************************
 *********************************************************************/
 
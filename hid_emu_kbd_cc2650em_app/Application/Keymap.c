@@ -0,0 +1,549 @@
+/******************************************************************************
+
+ @file  Keymap.c
+
+ @brief Key remapping engine: layers, layer keys and tap-hold keys,
+        configured at run time and stored in SNV.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stddef.h>
+#include <string.h>
+#include <ti/sysbios/knl/Clock.h>
+
+#include "bcomdef.h"
+#include "osal_snv.h"
+
+#include "Keyboard.h"
+#include "Keymap.h"
+
+/*********************************************************************
+ * MACROS
+ */
+
+// SNV item holding the configuration
+#define KEYMAP_NVID						BLE_NVID_CUST_START
+
+// Stored configuration layout, older layouts are ignored
+#define KEYMAP_CONFIG_VERSION			1
+
+// Layer of a key that is not held
+#define KEYMAP_NOT_HELD					0xFF
+
+// Order of the entries, by usage then layer
+#define KEYMAP_ENTRY_ORDER(entry)		(((entry)->usage << 8) | (entry)->layer)
+
+// Tapping term in Clock ticks
+#define KEYMAP_TAPPING_TERM_TICKS		(KB_KEYMAP_TAPPING_TERM_MS * 1000 / Clock_tickPeriod)
+
+#if KB_KEYMAP_LAYERS < 1 || KB_KEYMAP_LAYERS > 16
+#error "KB_KEYMAP_LAYERS must be 1 to 16"
+#endif
+
+#if 2 + 4 * KB_KEYMAP_MAX_ENTRIES > 255
+#error "KB_KEYMAP_MAX_ENTRIES does not fit one SNV item"
+#endif
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+// Configuration, as stored, after the result of the last change
+static keymapState_t keymapState;
+
+// Keys with an entry on any layer, one bit per usage. The entries are
+// kept sorted by usage, then layer, and only searched for these keys.
+static uint8_t keymapConfigured[(KEYMAP_USAGE_COUNT + 7) / 8];
+
+// Layer each held key was pressed on, it is released on the same layer
+static uint8_t keymapHeld[KEYMAP_USAGE_COUNT];
+
+// Layers switched on by toggle keys and held by momentary keys, one bit
+// each, and the highest of them, which is the one keys are looked up on
+static uint16_t layersToggled = 0;
+static uint16_t layersHeld = 0;
+static uint8_t activeLayer = 0;
+
+// Tap-hold key not yet known to be tapped or held, 0 if none, and the
+// Clock ticks at its press
+static uint8_t tapHoldUsage = 0;
+static uint32_t tapHoldTicks;
+
+// Remapped key events go here
+static keymapKeyCB_t keymapKeyCB = NULL;
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static void keymapIndex(void);
+static uint16_t keymapLookup(uint8_t layer, uint8_t usage);
+static uint8_t keymapStore(void);
+static void keymapReleaseAll(void);
+static void keymapUpdateLayer(void);
+static void keymapApply(uint8_t usage, uint8_t release, uint8_t repeat, uint32_t time);
+static void keymapResolveHold(uint32_t time);
+static void keymapSend(uint8_t usage, uint8_t release, uint32_t time);
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Keymap_init
+ *
+ * @brief   Load the configuration from SNV and sort its entries.
+ * 			Call from a task registered with ICall.
+ *
+ * @param   keyCB:	receives the remapped key events
+ */
+void Keymap_init(keymapKeyCB_t keyCB) {
+	uint8_t i, n = 0;
+
+	keymapKeyCB = keyCB;
+	memset(keymapHeld, KEYMAP_NOT_HELD, sizeof(keymapHeld));
+
+	if (osal_snv_read(KEYMAP_NVID, sizeof(keymapState.config), &keymapState.config) != SUCCESS ||
+			keymapState.config.version != KEYMAP_CONFIG_VERSION ||
+			keymapState.config.numEntries > KB_KEYMAP_MAX_ENTRIES) {
+		memset(&keymapState.config, 0, sizeof(keymapState.config));
+		keymapState.config.version = KEYMAP_CONFIG_VERSION;
+	}
+
+	// Entries stored by a build with more layers are dropped
+	for (i = 0; i < keymapState.config.numEntries; i++) {
+		if (Keymap_validEntry(&keymapState.config.entries[i])) {
+			keymapState.config.entries[n++] = keymapState.config.entries[i];
+		}
+	}
+	keymapState.config.numEntries = n;
+
+	keymapIndex();
+}
+
+/*********************************************************************
+ * @fn      Keymap_keyEvent
+ *
+ * @brief   Remap a key event, zero or more events are passed on to the
+ * 			callback given to Keymap_init
+ *
+ * @param   event:	BOARD_KEY_CHANGE_EVT or BOARD_MOD_CHANGE_EVT, with
+ * 					BOARD_BREAK_CODE_EVT for a release
+ * 			key:	HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
+ * 			time:	capture time, passed on
+ */
+void Keymap_keyEvent(uint8_t event, uint8_t key, uint32_t time) {
+	uint8_t release = (event & BOARD_BREAK_CODE_EVT) != 0;
+	uint8_t usage = key;
+	uint8_t repeat = false;
+	uint8_t bit;
+
+	if (event & BOARD_MOD_CHANGE_EVT) {
+		for (usage = KEYMAP_USAGE_MODIFIER, bit = key; bit > 1; bit >>= 1) {
+			usage++;
+		}
+	}
+
+	if (usage >= KEYMAP_USAGE_COUNT) {
+		(*keymapKeyCB)(event, key, time);
+		return;
+	}
+
+	if (release) {
+		// Pressed before the configuration changed, already released
+		if (keymapHeld[usage] == KEYMAP_NOT_HELD) {
+			return;
+		}
+	} else if (keymapHeld[usage] == KEYMAP_NOT_HELD) {
+		keymapHeld[usage] = activeLayer;
+	} else {
+		// Typematic repeat, stays on the layer it was pressed on
+		repeat = true;
+	}
+
+	keymapApply(usage, release, repeat, time);
+}
+
+/*********************************************************************
+ * @fn      Keymap_validEntry
+ *
+ * @brief   check an entry before it is configured, may be called from
+ * 			any task
+ *
+ * @param   entry:	layer, usage and action
+ *
+ * @ret		true if the entry can be configured
+ */
+bool Keymap_validEntry(const keymapEntry_t *entry) {
+	uint8_t arg = KEYMAP_ACTION_ARG(entry->action);
+
+	if (entry->layer >= KB_KEYMAP_LAYERS || entry->usage >= KEYMAP_USAGE_COUNT) {
+		return false;
+	}
+
+	switch (KEYMAP_ACTION_TYPE(entry->action)) {
+	case KEYMAP_KEY:
+		return arg < KEYMAP_USAGE_COUNT;
+	case KEYMAP_TRANSPARENT:
+		return true;
+	case KEYMAP_LAYER_MOMENTARY:
+	case KEYMAP_LAYER_TOGGLE:
+		return arg < KB_KEYMAP_LAYERS;
+	case KEYMAP_TAP_HOLD:
+		return arg != 0 && arg < KEYMAP_USAGE_MODIFIER && KEYMAP_ACTION_ARG2(entry->action) < 8;
+	default:
+		return false;
+	}
+}
+
+/*********************************************************************
+ * @fn      Keymap_setEntry
+ *
+ * @brief   Configure one key and store the configuration.
+ * 			KEYMAP_TRANSPARENT_ACTION removes the entry. Keys held are
+ * 			released first.
+ *
+ * @param   entry:	layer, usage and action
+ *
+ * @ret		SUCCESS, INVALIDPARAMETER, bleNoResources when full, or
+ * 			the SNV write error
+ */
+uint8_t Keymap_setEntry(const keymapEntry_t *entry) {
+	keymapEntry_t *entries = keymapState.config.entries;
+	uint8_t i;
+
+	if (!Keymap_validEntry(entry)) {
+		return keymapState.status = INVALIDPARAMETER;
+	}
+
+	for (i = 0; i < keymapState.config.numEntries; i++) {
+		if (entries[i].layer == entry->layer && entries[i].usage == entry->usage) {
+			break;
+		}
+	}
+
+	if (i == keymapState.config.numEntries) {
+		if (KEYMAP_ACTION_TYPE(entry->action) == KEYMAP_TRANSPARENT) {
+			return keymapState.status = SUCCESS;
+		}
+		if (i == KB_KEYMAP_MAX_ENTRIES) {
+			return keymapState.status = bleNoResources;
+		}
+	}
+
+	// Keys held are released with the actions they were pressed with
+	keymapReleaseAll();
+
+	if (KEYMAP_ACTION_TYPE(entry->action) == KEYMAP_TRANSPARENT) {
+		entries[i] = entries[--keymapState.config.numEntries];
+	} else if (i < keymapState.config.numEntries) {
+		entries[i].action = entry->action;
+	} else {
+		entries[keymapState.config.numEntries++] = *entry;
+	}
+
+	return keymapStore();
+}
+
+/*********************************************************************
+ * @fn      Keymap_clear
+ *
+ * @brief   Remove all entries and store the configuration
+ *
+ * @ret		SUCCESS or the SNV write error
+ */
+uint8_t Keymap_clear(void) {
+	keymapReleaseAll();
+	keymapState.config.numEntries = 0;
+	return keymapStore();
+}
+
+/*********************************************************************
+ * @fn      Keymap_getConfig
+ *
+ * @brief   Get the configuration and the result of the last change
+ *
+ * @param   pLen:	set to the length in use
+ *
+ * @ret		configuration, laid out as keymapState_t
+ */
+uint8_t *Keymap_getConfig(uint16_t *pLen) {
+	*pLen = offsetof(keymapState_t, config.entries) +
+			keymapState.config.numEntries * sizeof(keymapEntry_t);
+	return (uint8_t *)&keymapState;
+}
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      keymapIndex
+ *
+ * @brief   sort the entries by usage, then layer, and mark the keys
+ * 			that have any
+ */
+static void keymapIndex(void) {
+	keymapEntry_t *entries = keymapState.config.entries;
+	keymapEntry_t entry;
+	uint8_t i, j;
+
+	// Insertion sort, the entries are few and mostly in order already
+	for (i = 1; i < keymapState.config.numEntries; i++) {
+		entry = entries[i];
+		for (j = i; j > 0 && KEYMAP_ENTRY_ORDER(&entries[j - 1]) > KEYMAP_ENTRY_ORDER(&entry); j--) {
+			entries[j] = entries[j - 1];
+		}
+		entries[j] = entry;
+	}
+
+	memset(keymapConfigured, 0, sizeof(keymapConfigured));
+	for (i = 0; i < keymapState.config.numEntries; i++) {
+		keymapConfigured[entries[i].usage >> 3] |= 1 << (entries[i].usage & 0x7);
+	}
+}
+
+/*********************************************************************
+ * @fn      keymapLookup
+ *
+ * @brief   action of a key: the entry of the key on the layer, or on the
+ * 			nearest layer below it that is not transparent. A key with
+ * 			no entry sends its own usage.
+ *
+ * @param   layer:	layer the key is on
+ * 			usage:	key, HID usage
+ *
+ * @ret		KEYMAP_ACTION()
+ */
+static uint16_t keymapLookup(uint8_t layer, uint8_t usage) {
+	keymapEntry_t *entries = keymapState.config.entries;
+	uint16_t order = (usage << 8) | layer;
+	uint8_t lo = 0, hi = keymapState.config.numEntries, mid;
+
+	if (!(keymapConfigured[usage >> 3] & (1 << (usage & 0x7)))) {
+		return KEYMAP_KEY_ACTION(usage);
+	}
+
+	// First entry after the key on the layer
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (KEYMAP_ENTRY_ORDER(&entries[mid]) <= order) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	// The entries of the key on this layer and below it, highest first
+	while (lo > 0 && entries[lo - 1].usage == usage) {
+		lo--;
+		if (KEYMAP_ACTION_TYPE(entries[lo].action) != KEYMAP_TRANSPARENT) {
+			return entries[lo].action;
+		}
+	}
+
+	return KEYMAP_KEY_ACTION(usage);
+}
+
+/*********************************************************************
+ * @fn      keymapStore
+ *
+ * @brief   write the configuration to SNV and make it the active one
+ *
+ * @ret		SNV write status
+ */
+static uint8_t keymapStore(void) {
+	keymapIndex();
+
+	keymapState.status = osal_snv_write(KEYMAP_NVID, sizeof(keymapState.config), &keymapState.config);
+	return keymapState.status;
+}
+
+/*********************************************************************
+ * @fn      keymapReleaseAll
+ *
+ * @brief   release every key held and return to layer 0, before the
+ * 			entries change under them
+ */
+static void keymapReleaseAll(void) {
+	uint16_t usage;
+
+	// A tap-hold key not decided yet has sent nothing
+	tapHoldUsage = 0;
+
+	for (usage = 0; usage < KEYMAP_USAGE_COUNT; usage++) {
+		if (keymapHeld[usage] != KEYMAP_NOT_HELD) {
+			keymapApply(usage, true, false, 0);
+		}
+	}
+
+	layersToggled = 0;
+	layersHeld = 0;
+	keymapUpdateLayer();
+}
+
+/*********************************************************************
+ * @fn      keymapUpdateLayer
+ *
+ * @brief   look keys up on the highest layer switched on
+ */
+static void keymapUpdateLayer(void) {
+	uint16_t layers = layersToggled | layersHeld;
+
+	activeLayer = 0;
+	while (layers >>= 1) {
+		activeLayer++;
+	}
+}
+
+/*********************************************************************
+ * @fn      keymapApply
+ *
+ * @brief   carry out the action of a key
+ *
+ * @param   usage:		key, held
+ * 			release:	is it a release, the key is no longer held after
+ * 			repeat:		is it a typematic repeat
+ * 			time:		capture time
+ */
+static void keymapApply(uint8_t usage, uint8_t release, uint8_t repeat, uint32_t time) {
+	uint16_t action = keymapLookup(keymapHeld[usage], usage);
+	uint8_t arg = KEYMAP_ACTION_ARG(action);
+
+	if (release) {
+		keymapHeld[usage] = KEYMAP_NOT_HELD;
+	} else if (usage != tapHoldUsage) {
+		// Any other key pressed while a tap-hold key is down makes it hold
+		keymapResolveHold(time);
+	}
+
+	switch (KEYMAP_ACTION_TYPE(action)) {
+	case KEYMAP_KEY:
+		keymapSend(arg, release, time);
+		break;
+
+	case KEYMAP_LAYER_MOMENTARY:
+		if (release) {
+			layersHeld &= ~(1 << arg);
+		} else {
+			layersHeld |= 1 << arg;
+		}
+		keymapUpdateLayer();
+		break;
+
+	case KEYMAP_LAYER_TOGGLE:
+		if (!release && !repeat) {
+			layersToggled ^= 1 << arg;
+			keymapUpdateLayer();
+		}
+		break;
+
+	case KEYMAP_TAP_HOLD:
+		if (!release) {
+			// A repeat means it was held long enough to repeat
+			keymapResolveHold(time);
+			if (!repeat) {
+				tapHoldUsage = usage;
+				tapHoldTicks = Clock_getTicks();
+			}
+		} else if (usage == tapHoldUsage) {
+			tapHoldUsage = 0;
+			if (Clock_getTicks() - tapHoldTicks <= KEYMAP_TAPPING_TERM_TICKS) {
+				keymapSend(arg, false, time);
+				keymapSend(arg, true, time);
+			}
+		} else {
+			keymapSend(KEYMAP_USAGE_MODIFIER + KEYMAP_ACTION_ARG2(action), true, time);
+		}
+		break;
+	}
+}
+
+/*********************************************************************
+ * @fn      keymapResolveHold
+ *
+ * @brief   the tap-hold key waiting, if any, is held: press its modifier
+ *
+ * @param   time:	capture time
+ */
+static void keymapResolveHold(uint32_t time) {
+	uint16_t action;
+
+	if (tapHoldUsage == 0) {
+		return;
+	}
+
+	action = keymapLookup(keymapHeld[tapHoldUsage], tapHoldUsage);
+	tapHoldUsage = 0;
+	keymapSend(KEYMAP_USAGE_MODIFIER + KEYMAP_ACTION_ARG2(action), false, time);
+}
+
+/*********************************************************************
+ * @fn      keymapSend
+ *
+ * @brief   pass a key event on, as a modifier event for usages 0xE0 to
+ * 			0xE7
+ *
+ * @param   usage:		HID usage, nothing is sent for 0
+ * 			release:	is it a release
+ * 			time:		capture time
+ */
+static void keymapSend(uint8_t usage, uint8_t release, uint32_t time) {
+	uint8_t event = BOARD_KEY_CHANGE_EVT;
+	uint8_t key = usage;
+
+	if (usage == 0) {
+		return;
+	}
+
+	if (usage >= KEYMAP_USAGE_MODIFIER) {
+		event = BOARD_MOD_CHANGE_EVT;
+		key = 1 << (usage - KEYMAP_USAGE_MODIFIER);
+	}
+	if (release) {
+		event |= BOARD_BREAK_CODE_EVT;
+	}
+
+	(*keymapKeyCB)(event, key, time);
+}
+
+/*********************************************************************
+*********************************************************************/
@@ -0,0 +1,216 @@
+/******************************************************************************
+
+ @file  Keymap.h
+
+ @brief This file contains the interface to the key remapping engine.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************************************************************
+ * MACROS
+ */
+
+// Number of layers, layer 0 is the base layer
+#ifndef KB_KEYMAP_LAYERS
+#define KB_KEYMAP_LAYERS				4
+#endif
+
+// Largest number of configured entries, all layers together. The stored
+// configuration must fit one SNV item.
+#ifndef KB_KEYMAP_MAX_ENTRIES
+#define KB_KEYMAP_MAX_ENTRIES			48
+#endif
+
+// Keys are HID keyboard page usages, modifiers are usages 0xE0 to 0xE7
+#define KEYMAP_USAGE_COUNT				0xE8
+#define KEYMAP_USAGE_MODIFIER			0xE0
+
+// Actions are 16 bits: [type:4][arg2:4][arg:8]
+#define KEYMAP_ACTION(type, arg2, arg)	((uint16_t)(((type) << 12) | ((arg2) << 8) | (arg)))
+#define KEYMAP_ACTION_TYPE(action)		((action) >> 12)
+#define KEYMAP_ACTION_ARG2(action)		(((action) >> 8) & 0x0F)
+#define KEYMAP_ACTION_ARG(action)		((action) & 0xFF)
+
+// Action types
+#define KEYMAP_KEY						0x0		// arg: usage sent, 0 disables the key
+#define KEYMAP_TRANSPARENT				0x1		// use the layer below
+#define KEYMAP_LAYER_MOMENTARY			0x2		// arg: layer active while held
+#define KEYMAP_LAYER_TOGGLE				0x3		// arg: layer switched on and off by presses
+#define KEYMAP_TAP_HOLD					0x4		// arg: usage when tapped, arg2: modifier bit number when held
+
+// Action shorthands
+#define KEYMAP_KEY_ACTION(usage)		KEYMAP_ACTION(KEYMAP_KEY, 0, usage)
+#define KEYMAP_TRANSPARENT_ACTION		KEYMAP_ACTION(KEYMAP_TRANSPARENT, 0, 0)
+#define KEYMAP_MO(layer)				KEYMAP_ACTION(KEYMAP_LAYER_MOMENTARY, 0, layer)
+#define KEYMAP_TG(layer)				KEYMAP_ACTION(KEYMAP_LAYER_TOGGLE, 0, layer)
+#define KEYMAP_TAP_HOLD_ACTION(usage, mod)	KEYMAP_ACTION(KEYMAP_TAP_HOLD, mod, usage)
+
+// A tap-hold key released within this time after its press is a tap
+#ifndef KB_KEYMAP_TAPPING_TERM_MS
+#define KB_KEYMAP_TAPPING_TERM_MS		200
+#endif
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+// One configured key, action is sent LSB first
+typedef struct
+{
+	uint8_t		layer;
+	uint8_t		usage;		// key remapped, HID usage
+	uint16_t	action;		// KEYMAP_ACTION()
+} keymapEntry_t;
+
+// Configuration as stored in SNV and read over GATT, entries sorted by
+// usage then layer. Keys not listed keep their usage on layer 0 and are
+// transparent on the other layers.
+typedef struct
+{
+	uint8_t			version;
+	uint8_t			numEntries;
+	keymapEntry_t	entries[KB_KEYMAP_MAX_ENTRIES];
+} keymapConfig_t;
+
+// Configuration as read over GATT, after the result of the last change:
+// SUCCESS, bleNoResources, or the SNV write error
+typedef struct
+{
+	uint8_t			status;
+	uint8_t			reserved;
+	keymapConfig_t	config;
+} keymapState_t;
+
+// Key event output, same event and key format as keysPressedCB_t
+typedef void (*keymapKeyCB_t)(uint8_t event, uint8_t key, uint32_t time);
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      Keymap_init
+ *
+ * @brief   Load the configuration from SNV and sort its entries.
+ * 			Call from a task registered with ICall.
+ *
+ * @param   keyCB:	receives the remapped key events
+ */
+void Keymap_init(keymapKeyCB_t keyCB);
+
+/*********************************************************************
+ * @fn      Keymap_keyEvent
+ *
+ * @brief   Remap a key event, zero or more events are passed on to the
+ * 			callback given to Keymap_init
+ *
+ * @param   event:	BOARD_KEY_CHANGE_EVT or BOARD_MOD_CHANGE_EVT, with
+ * 					BOARD_BREAK_CODE_EVT for a release
+ * 			key:	HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
+ * 			time:	capture time, passed on
+ */
+void Keymap_keyEvent(uint8_t event, uint8_t key, uint32_t time);
+
+/*********************************************************************
+ * @fn      Keymap_validEntry
+ *
+ * @brief   check an entry before it is configured, may be called from
+ * 			any task
+ *
+ * @param   entry:	layer, usage and action
+ *
+ * @ret		true if the entry can be configured
+ */
+bool Keymap_validEntry(const keymapEntry_t *entry);
+
+/*********************************************************************
+ * @fn      Keymap_setEntry
+ *
+ * @brief   Configure one key and store the configuration.
+ * 			KEYMAP_TRANSPARENT_ACTION removes the entry. Keys held are
+ * 			released first.
+ *
+ * @param   entry:	layer, usage and action
+ *
+ * @ret		SUCCESS, INVALIDPARAMETER, bleNoResources when full, or
+ * 			the SNV write error
+ */
+uint8_t Keymap_setEntry(const keymapEntry_t *entry);
+
+/*********************************************************************
+ * @fn      Keymap_clear
+ *
+ * @brief   Remove all entries and store the configuration
+ *
+ * @ret		SUCCESS or the SNV write error
+ */
+uint8_t Keymap_clear(void);
+
+/*********************************************************************
+ * @fn      Keymap_getConfig
+ *
+ * @brief   Get the configuration and the result of the last change
+ *
+ * @param   pLen:	set to the length in use
+ *
+ * @ret		configuration, laid out as keymapState_t
+ */
+uint8_t *Keymap_getConfig(uint16_t *pLen);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KEYMAP_H */
@@ -51,6 +51,7 @@
  * INCLUDES
  */
 
+#include <string.h>
 #include <xdc/runtime/System.h>
 #include <ti/sysbios/knl/Task.h>
 #include <ti/sysbios/knl/Clock.h>
@@ -65,16 +66,26 @@
 #include "battservice.h"
 #include "hidkbdservice.h"
 #include "hiddev.h"
+#ifdef KB_TIMING_STATS
+#include "kbddiagservice.h"
+#endif
+#ifdef KB_KEYMAP
+#include "kbdkeymapservice.h"
+#endif
 
 #include "peripheral.h"
 #include "gapbondmgr.h"
 
 #include "osal_snv.h"
 #include "icall_apimsg.h"
+#include "hci.h"
 
 #include "util.h"
 #include <ti/mw/display/Display.h>
 #include "Keyboard.h"
+#ifdef KB_KEYMAP
+#include "Keymap.h"
+#endif
 #include "LED.h"
 #include "board.h"
 
@@ -86,11 +97,32 @@
  */
 
 // HID keyboard input report length
+#ifdef KB_NKRO
+#define HID_KEYBOARD_IN_RPT_LEN     (1 + HID_NKRO_KEY_BYTES)
+#else
 #define HID_KEYBOARD_IN_RPT_LEN     8
+#endif
+
+// HID boot keyboard input report length, and the key array entry reporting
+// more keys than it holds
+#define HID_BOOT_KEYBOARD_IN_RPT_LEN  8
+#define HID_KEY_ERROR_ROLLOVER      0x01
 
 // HID LED output report length
 #define HID_LED_OUT_RPT_LEN         1
 
+// HID consumer control input report length, one 16 bit usage
+#define HID_CC_IN_RPT_LEN           2
+
+// Consumer keymap expansion into the usage table
+#define CONSUMER_USAGE_ENTRY(code, usage)  (usage),
+
+#ifdef KB_PS2_MOUSE
+// HID mouse input report length, the boot report has no wheel
+#define HID_MOUSE_IN_RPT_LEN        4
+#define HID_BOOT_MOUSE_IN_RPT_LEN   3
+#endif
+
 /*********************************************************************
  * CONSTANTS
  */
@@ -98,6 +130,55 @@
 // HID idle timeout in msec; set to zero to disable timeout
 #define DEFAULT_HID_IDLE_TIMEOUT              0
 
+#ifdef KB_CONN_PARAM_ADAPT
+// Connection parameters (intervals in units of 1.25ms) requested while
+// reports are being sent
+#ifndef HIDEMUKBD_FAST_MIN_CONN_INTERVAL
+#define HIDEMUKBD_FAST_MIN_CONN_INTERVAL      6
+#endif
+#ifndef HIDEMUKBD_FAST_MAX_CONN_INTERVAL
+#define HIDEMUKBD_FAST_MAX_CONN_INTERVAL      6
+#endif
+#ifndef HIDEMUKBD_FAST_SLAVE_LATENCY
+#define HIDEMUKBD_FAST_SLAVE_LATENCY          0
+#endif
+
+// Connection parameters requested once idle, and when a connection is formed
+#ifndef HIDEMUKBD_IDLE_MIN_CONN_INTERVAL
+#define HIDEMUKBD_IDLE_MIN_CONN_INTERVAL      24
+#endif
+#ifndef HIDEMUKBD_IDLE_MAX_CONN_INTERVAL
+#define HIDEMUKBD_IDLE_MAX_CONN_INTERVAL      40
+#endif
+#ifndef HIDEMUKBD_IDLE_SLAVE_LATENCY
+#define HIDEMUKBD_IDLE_SLAVE_LATENCY          20
+#endif
+
+// Time in ms without reports before the idle set is requested
+#ifndef HIDEMUKBD_CONN_IDLE_TIMEOUT
+#define HIDEMUKBD_CONN_IDLE_TIMEOUT           5000
+#endif
+
+// Reports, each less than the idle timeout after the last, before the fast
+// set is requested. A lone key press keeps the idle set.
+#ifndef HIDEMUKBD_CONN_FAST_REPORTS
+#define HIDEMUKBD_CONN_FAST_REPORTS           4
+#endif
+
+// Time in ms from one update request to the next, and the requests made for
+// one set before giving up on a host that keeps other parameters
+#ifndef HIDEMUKBD_CONN_UPDATE_HOLD
+#define HIDEMUKBD_CONN_UPDATE_HOLD            2000
+#endif
+#ifndef HIDEMUKBD_CONN_UPDATE_TRIES
+#define HIDEMUKBD_CONN_UPDATE_TRIES           3
+#endif
+
+// Automatic parameter update requests ask for the idle set
+#define DEFAULT_DESIRED_MIN_CONN_INTERVAL     HIDEMUKBD_IDLE_MIN_CONN_INTERVAL
+#define DEFAULT_DESIRED_MAX_CONN_INTERVAL     HIDEMUKBD_IDLE_MAX_CONN_INTERVAL
+#define DEFAULT_DESIRED_SLAVE_LATENCY         HIDEMUKBD_IDLE_SLAVE_LATENCY
+#else
 // Minimum connection interval (units of 1.25ms) if automatic parameter update
 // request is enabled.
 #define DEFAULT_DESIRED_MIN_CONN_INTERVAL     8
@@ -108,6 +189,7 @@
 
 // Slave latency to use if automatic parameter update request is enabled
 #define DEFAULT_DESIRED_SLAVE_LATENCY         50
+#endif
 
 // Supervision timeout value (units of 10ms) if automatic parameter update
 // request is enabled.
@@ -138,6 +220,48 @@
 // Battery level is critical when it is less than this %
 #define DEFAULT_BATT_CRITICAL_LEVEL           6
 
+#ifdef KB_PS2_MOUSE
+// App events from the mouse, outside the BOARD_*_EVT bits
+#define HIDEMUKBD_MOUSE_BUTTON_EVT            0x40
+#define HIDEMUKBD_MOUSE_MOVE_EVT              0x20
+#endif
+
+// App event from HidDev, outside the BOARD_*_EVT bits
+#define HIDEMUKBD_GAPROLE_STATE_EVT           0x10
+
+#ifdef KB_KEYMAP
+// App event from the keymap service, state is KBD_KEYMAP_CMD_CLEAR or
+// HIDEMUKBD_KEYMAP_SET
+#define HIDEMUKBD_KEYMAP_EVT                  0x80
+#define HIDEMUKBD_KEYMAP_SET                  0x01
+#endif
+
+// Stack event at the end of each connection event. Key changes and mouse
+// movement are gathered in between and reported once per connection event.
+#define HIDEMUKBD_CONN_EVT_END_EVT            0x0001
+
+// Connection events without reports before the notice is turned off
+#define HIDEMUKBD_CONN_EVT_IDLE_LIMIT         8
+
+#ifdef KB_CONN_PARAM_ADAPT
+// Clock events
+#define HIDEMUKBD_CONN_IDLE_EVT               0x0001
+#define HIDEMUKBD_CONN_HOLD_EVT               0x0002
+#endif
+
+// App event ring, power of two not larger than 128
+#ifndef HIDEMUKBD_EVT_RING_SIZE
+#define HIDEMUKBD_EVT_RING_SIZE               32
+#endif
+#define HIDEMUKBD_EVT_RING_MASK               (HIDEMUKBD_EVT_RING_SIZE - 1)
+
+// Index of a key among the key changes kept off a full ring: HID usage,
+// then modifier bits, then consumer keys
+#define HIDEMUKBD_KEY_IDX_MOD                 256
+#define HIDEMUKBD_KEY_IDX_CONSUMER            (HIDEMUKBD_KEY_IDX_MOD + 8)
+#define HIDEMUKBD_KEY_IDX_COUNT               (HIDEMUKBD_KEY_IDX_CONSUMER + CONSUMER_KEY_COUNT)
+#define HIDEMUKBD_KEY_IDX_BYTES               ((HIDEMUKBD_KEY_IDX_COUNT + 7) / 8)
+
 // Task configuration
 #define HIDEMUKBD_TASK_PRIORITY               1
 
@@ -149,10 +273,19 @@
  * TYPEDEFS
  */
 
-// App event passed from profiles.
+// App event passed from the keyboard task and from profiles.
 typedef struct
 {
-  appEvtHdr_t hdr; // Event header
+  appEvtHdr_t hdr; // Event header, state holds the key or button state
+  uint32_t time;   // Key capture time, 0 if not measured
+#ifdef KB_PS2_MOUSE
+  int16_t dx;      // Mouse movement up to and including a button change
+  int16_t dy;
+  int16_t wheel;
+#endif
+#ifdef KB_KEYMAP
+  keymapEntry_t entry; // Key configured by HIDEMUKBD_KEYMAP_SET
+#endif
 } hidEmuKbdEvt_t;
 
 /*********************************************************************
@@ -180,9 +313,87 @@ static ICall_EntityID selfEntity;
 // Semaphore globally used to post events to the application thread
 static ICall_Semaphore sem;
 
-// Queue object used for app messages
-static Queue_Struct appMsg;
-static Queue_Handle appMsgQueue;
+// App event ring
+// Producers (keyboard task, HidDev task) add whole events with the
+// scheduler locked. The consumer is the application task, which runs at a
+// lower priority and only moves the read position. No heap is used on the
+// way, so key events never wait on the ICall heap shared with the stack.
+static hidEmuKbdEvt_t evtRing[HIDEMUKBD_EVT_RING_SIZE];
+static volatile uint8_t evtWritePos = 0;
+static volatile uint8_t evtReadPos = 0;
+
+// Events refused by a full ring, and the deepest the ring has been
+static uint16_t evtRingDrops = 0;
+static uint8_t evtRingPeak = 0;
+
+// Key changes refused by a full ring, kept as the keys changed and the
+// state each was left in. Once one is kept the changes after it are kept
+// too, so none overtakes it. Written by the keyboard task, taken by the
+// application task with the scheduler locked once it has drained the ring.
+static uint8_t keysUnsent[HIDEMUKBD_KEY_IDX_BYTES];
+static uint8_t keysUnsentDown[HIDEMUKBD_KEY_IDX_BYTES];
+static volatile uint8_t keyChangesUnsent = FALSE;
+
+#ifdef KB_TIMING_STATS
+// Keyboard statistics, the ring counters are kept in them as well
+static keyboardStats_t *pKbdStats;
+#endif
+
+// Keyboard input report being built, and the last one sent
+static uint8_t keyReport[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
+static uint8_t keyReportSent[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
+
+// Capture time of the oldest change not sent yet, 0 if none or not measured
+static uint32_t keyReportTime = 0;
+
+// Consumer page usage of each consumer key
+static const uint16_t consumerUsage[CONSUMER_KEY_COUNT] =
+{
+	0,
+	SCAN_CODE_SET_2_CONSUMER_KEYMAP(CONSUMER_USAGE_ENTRY)
+};
+
+// Consumer usage last reported, 0 if none is down
+static uint16_t consumerReportSent = 0;
+
+// A key report waits for the next connection event, later changes are
+// merged into one report sent when that event ends
+static uint8_t keyReportInFlight = FALSE;
+
+#ifdef KB_PS2_MOUSE
+// Mouse movement not reported yet. Added to by the keyboard task, taken by
+// the application task with the scheduler locked.
+static int16_t mouseDx = 0;
+static int16_t mouseDy = 0;
+static int16_t mouseWheel = 0;
+static uint8_t mouseButtons = 0;
+
+// A button change could not be queued, the next report carries it
+static uint8_t mouseButtonsUnsent = FALSE;
+
+// A HIDEMUKBD_MOUSE_MOVE_EVT is queued
+static volatile uint8_t mouseMoveQueued = FALSE;
+#endif
+
+// Connection event notice is on, and connection events since the last
+// report
+static volatile uint8_t connEvtNoticeOn = FALSE;
+static uint8_t connEvtIdle = 0;
+
+#ifdef KB_CONN_PARAM_ADAPT
+// Clock events to process
+static uint16_t events = 0;
+
+// Whether the fast parameter set is wanted, reports counted towards it,
+// and update requests made for the wanted set
+static uint8_t connParamFast = FALSE;
+static uint8_t connParamReports = 0;
+static uint8_t connParamTries = 0;
+
+// Idle timeout, and the hold between two update requests
+static Clock_Struct connIdleClock;
+static Clock_Struct connHoldClock;
+#endif
 
 // Task configuration
 Task_Struct hidEmuKbdTask;
@@ -250,16 +461,61 @@ static void HidEmuKbd_taskFxn(UArg a0, UArg a1);
 static void HidEmuKbd_processAppMsg(hidEmuKbdEvt_t *pMsg);
 static void HidEmuKbd_processStackMsg(ICall_Hdr *pMsg);
 static void HidEmuKbd_processGattMsg(gattMsgEvent_t *pMsg);
-static uint8_t HidEmuKbd_enqueueMsg(uint16_t event, uint8_t state);
+static uint8_t HidEmuKbd_enqueueMsg(uint16_t event, uint8_t state,
+                                    uint32_t time);
+static uint8_t HidEmuKbd_enqueueEvt(const hidEmuKbdEvt_t *pEvt);
 
 // Key press.
-static void HidEmuKbd_keyPressHandler(uint8_t event, uint8_t keys);
+static void HidEmuKbd_keyPressHandler(uint8_t event, uint8_t keys, uint32_t time);
+static void HidEmuKbd_keyBatchHandler(uint8_t numEvents, const keyEvent_t *events);
+static void HidEmuKbd_queueKeyEvent(uint8_t event, uint8_t key, uint32_t time);
+static void HidEmuKbd_applyUnsentKeys(void);
+static void HidEmuKbd_keyEvent(uint8_t event, uint8_t key, uint32_t time);
+static void HidEmuKbd_applyKeyEvent(uint8_t event, uint8_t key);
+static uint8_t HidEmuKbd_keyInReport(const uint8_t *report, uint8_t event, uint8_t key);
+static uint8_t HidEmuKbd_sendKeyReport(void);
+static void HidEmuKbd_consumerEvent(uint8_t event, uint8_t key, uint32_t time);
+#ifdef KB_NKRO
+static void HidEmuKbd_buildBootKeyReport(uint8_t *boot);
+#endif
+
+#ifdef KB_PS2_MOUSE
+// Mouse.
+static void HidEmuKbd_mouseHandler(uint8_t buttons, int16_t dx, int16_t dy, int8_t wheel);
+static void HidEmuKbd_sendMouseReport(uint8_t buttons, int16_t dx, int16_t dy, int16_t wheel);
+#endif
+
+// Connection events.
+static void HidEmuKbd_armConnEventNotice(void);
+static void HidEmuKbd_connEventEnd(void);
+static void HidEmuKbd_gapRoleStateChange(void);
+#ifdef KB_CONN_PARAM_ADAPT
+static void HidEmuKbd_connActivity(void);
+static void HidEmuKbd_connIdle(void);
+static void HidEmuKbd_connParamUpdate(void);
+static void HidEmuKbd_clockHandler(UArg arg);
+#endif
 
 // HID reports.
 static uint8_t HidEmuKbd_receiveReport(uint8_t len, uint8_t *pData);
 static uint8_t HidEmuKbd_reportCB(uint8_t id, uint8_t type, uint16_t uuid,
                                   uint8_t oper, uint16_t *pLen, uint8_t *pData);
 static void HidEmuKbd_hidEventCB(uint8_t evt);
+static uint8_t HidEmuKbd_reportMergeCB(uint8_t id, uint8_t type, uint8_t len,
+                                       const uint8_t *pPrev,
+                                       const uint8_t *pFirst,
+                                       uint8_t *pSecond);
+static uint8_t HidEmuKbd_keyInArray(const uint8_t *report, uint8_t key);
+#ifdef KB_TIMING_STATS
+static uint8_t *HidEmuKbd_getStats(uint16_t *pLen);
+static void HidEmuKbd_updateReportQStats(void);
+#endif
+
+#ifdef KB_KEYMAP
+// Keymap.
+static bStatus_t HidEmuKbd_keymapWriteCB(uint8_t *pValue, uint16_t len);
+static void HidEmuKbd_keymapChange(hidEmuKbdEvt_t *pMsg);
+#endif
 
 /*********************************************************************
  * PROFILE CALLBACKS
@@ -269,8 +525,22 @@ static hidDevCB_t hidEmuKbdHidCBs =
 {
   HidEmuKbd_reportCB,
   HidEmuKbd_hidEventCB,
-  NULL
+  NULL,
+#ifdef KB_TIMING_STATS
+  Keyboard_keyReported,
+#else
+  NULL,
+#endif
+  HidEmuKbd_reportMergeCB
+};
+
+#ifdef KB_KEYMAP
+static kbdKeymapCBs_t hidEmuKbdKeymapCBs =
+{
+  Keymap_getConfig,
+  HidEmuKbd_keymapWriteCB
 };
+#endif
 
 /*********************************************************************
  * PUBLIC FUNCTIONS
@@ -328,7 +598,6 @@ void HidEmuKbd_init(void)
   //HCI_EXT_SetSCACmd(40);
 
   // Create an RTOS queue for message from profile to be sent to app.
-  appMsgQueue = Util_constructQueue(&appMsg);
 
   // Setup the GAP
   VOID GAP_SetParamValue(TGAP_CONN_PAUSE_PERIPHERAL,
@@ -400,6 +669,36 @@ void HidEmuKbd_init(void)
   // Set up HID keyboard service
   HidKbd_AddService();
 
+#ifdef KB_TIMING_STATS
+  // Set up keyboard diagnostics service
+  KbdDiag_AddService();
+  KbdDiag_Register(HidEmuKbd_getStats);
+
+  // Keep the app event ring counters with the keyboard statistics
+  {
+    uint16_t statsLen;
+
+    pKbdStats = (keyboardStats_t *)Keyboard_getStats(&statsLen);
+  }
+#endif
+
+#ifdef KB_KEYMAP
+  // Set up the key remapping engine and its service
+  Keymap_init(HidEmuKbd_keyEvent);
+  KbdKeymap_AddService();
+  KbdKeymap_Register(&hidEmuKbdKeymapCBs);
+#endif
+
+#ifdef KB_CONN_PARAM_ADAPT
+  // Connection parameter clocks, not started until reports are sent
+  Util_constructClock(&connIdleClock, HidEmuKbd_clockHandler,
+                      HIDEMUKBD_CONN_IDLE_TIMEOUT, 0, false,
+                      HIDEMUKBD_CONN_IDLE_EVT);
+  Util_constructClock(&connHoldClock, HidEmuKbd_clockHandler,
+                      HIDEMUKBD_CONN_UPDATE_HOLD, 0, false,
+                      HIDEMUKBD_CONN_HOLD_EVT);
+#endif
+
   // Register for HID Dev callback
   HidDev_Register(&hidEmuKbdCfg, &hidEmuKbdHidCBs);
 
@@ -411,6 +710,10 @@ void HidEmuKbd_init(void)
 
   // Initialize keys on SmartRF06EB.
   Keyboard_init(HidEmuKbd_keyPressHandler);
+  Keyboard_registerBatchCB(HidEmuKbd_keyBatchHandler);
+#ifdef KB_PS2_MOUSE
+  Keyboard_registerMouseCB(HidEmuKbd_mouseHandler);
+#endif
 }
 
 /*********************************************************************
@@ -449,8 +752,21 @@ void HidEmuKbd_taskFxn(UArg a0, UArg a1)
       {
         if ((src == ICALL_SERVICE_CLASS_BLE) && (dest == selfEntity))
         {
-          // Process inter-task message
-          HidEmuKbd_processStackMsg((ICall_Hdr *)pMsg);
+          ICall_Stack_Event *pEvt = (ICall_Stack_Event *)pMsg;
+
+          // Check for BLE stack events first
+          if (pEvt->signature == 0xffff)
+          {
+            if (pEvt->event_flag & HIDEMUKBD_CONN_EVT_END_EVT)
+            {
+              HidEmuKbd_connEventEnd();
+            }
+          }
+          else
+          {
+            // Process inter-task message
+            HidEmuKbd_processStackMsg((ICall_Hdr *)pMsg);
+          }
         }
 
         if (pMsg)
@@ -459,19 +775,43 @@ void HidEmuKbd_taskFxn(UArg a0, UArg a1)
         }
       }
 
-      // If RTOS queue is not empty, process app message.
-      while (!Queue_empty(appMsgQueue))
+      // Process the app events, the slot is freed once processed.
+      while (evtReadPos != evtWritePos)
       {
-        hidEmuKbdEvt_t *pMsg = (hidEmuKbdEvt_t *)Util_dequeueMsg(appMsgQueue);
-        if (pMsg)
-        {
-          // Process message.
-          HidEmuKbd_processAppMsg(pMsg);
+        HidEmuKbd_processAppMsg(&evtRing[evtReadPos & HIDEMUKBD_EVT_RING_MASK]);
+        evtReadPos++;
+      }
 
-          // Free the space from the message.
-          ICall_free(pMsg);
-        }
+      // Then the key changes that found the ring full
+      if (keyChangesUnsent)
+      {
+        HidEmuKbd_applyUnsentKeys();
+      }
+
+      // The key events taken in one go make one report. While a report
+      // waits for its connection event the changes gather and go out
+      // together when it ends.
+      if (!keyReportInFlight)
+      {
+        HidEmuKbd_sendKeyReport();
+      }
+
+#ifdef KB_CONN_PARAM_ADAPT
+      if (events & HIDEMUKBD_CONN_IDLE_EVT)
+      {
+        events &= ~HIDEMUKBD_CONN_IDLE_EVT;
+
+        HidEmuKbd_connIdle();
+      }
+
+      if (events & HIDEMUKBD_CONN_HOLD_EVT)
+      {
+        events &= ~HIDEMUKBD_CONN_HOLD_EVT;
+
+        // Requests held back, or a host that has not switched yet
+        HidEmuKbd_connParamUpdate();
       }
+#endif
     }
   }
 }
@@ -522,14 +862,152 @@ static void HidEmuKbd_processGattMsg(gattMsgEvent_t *pMsg)
  */
 static void HidEmuKbd_processAppMsg(hidEmuKbdEvt_t *pMsg)
 {
-	static uint8_t buf[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
-	uint8_t key = pMsg->hdr.state;
-	uint8_t event = pMsg->hdr.event;
+#ifdef KB_PS2_MOUSE
+	if (pMsg->hdr.event == HIDEMUKBD_MOUSE_BUTTON_EVT)
+	{
+		HidEmuKbd_sendMouseReport(pMsg->hdr.state, pMsg->dx, pMsg->dy, pMsg->wheel);
+		return;
+	}
+	else if (pMsg->hdr.event == HIDEMUKBD_MOUSE_MOVE_EVT)
+	{
+		mouseMoveQueued = FALSE;
+		HidEmuKbd_connEventEnd();
+		return;
+	}
+#endif
+	if (pMsg->hdr.event == HIDEMUKBD_GAPROLE_STATE_EVT)
+	{
+		HidEmuKbd_gapRoleStateChange();
+		return;
+	}
+#ifdef KB_KEYMAP
+	if (pMsg->hdr.event == HIDEMUKBD_KEYMAP_EVT)
+	{
+		HidEmuKbd_keymapChange(pMsg);
+		return;
+	}
+#endif
+	if (pMsg->hdr.event & BOARD_CONSUMER_CHANGE_EVT)
+	{
+		HidEmuKbd_consumerEvent(pMsg->hdr.event, pMsg->hdr.state, pMsg->time);
+		return;
+	}
+
+#ifdef KB_KEYMAP
+	Keymap_keyEvent(pMsg->hdr.event, pMsg->hdr.state, pMsg->time);
+#else
+	HidEmuKbd_keyEvent(pMsg->hdr.event, pMsg->hdr.state, pMsg->time);
+#endif
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_keyEvent
+ *
+ * @brief   Apply a key event to the keyboard input report. A change that
+ *          undoes one not sent yet (press and release before the next
+ *          report) must not be lost, so the state in between is reported
+ *          first.
+ *
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   key - HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
+ * @param   time - capture time, 0 if not measured
+ *
+ * @return  none
+ */
+static void HidEmuKbd_keyEvent(uint8_t event, uint8_t key, uint32_t time)
+{
+	uint8_t pressed = (event & BOARD_BREAK_CODE_EVT) == 0;
+
+	// Nothing changes, e.g. a typematic repeat
+	if (HidEmuKbd_keyInReport(keyReport, event, key) == pressed) {
+		return;
+	}
+
+	if (HidEmuKbd_keyInReport(keyReportSent, event, key) == pressed) {
+		HidEmuKbd_sendKeyReport();
+	}
+
+	HidEmuKbd_applyKeyEvent(event, key);
+
+	// A report is as late as the oldest change it carries
+	if (keyReportTime == 0) {
+		keyReportTime = time;
+	}
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_consumerEvent
+ *
+ * @brief   Report a consumer key. The report holds one usage, so a press
+ *          replaces the one reported and only the release of that key
+ *          clears it. A report is sent only when the usage changes.
+ *
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   key - consumer key, CONSUMER_KEY_*
+ * @param   time - capture time, 0 if not measured
+ *
+ * @return  none
+ */
+static void HidEmuKbd_consumerEvent(uint8_t event, uint8_t key, uint32_t time)
+{
+	uint8_t report[HID_CC_IN_RPT_LEN];
+	uint16_t usage;
+
+	if (key >= CONSUMER_KEY_COUNT) {
+		return;
+	}
+
+	usage = consumerUsage[key];
+	if (event & BOARD_BREAK_CODE_EVT) {
+		if (usage != consumerReportSent) {
+			return;
+		}
+		usage = 0;
+	}
+
+	if (usage == consumerReportSent) {
+		return;
+	}
+	consumerReportSent = usage;
+
+	report[0] = LO_UINT16(usage);
+	report[1] = HI_UINT16(usage);
+	HidDev_ReportStamped(HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT, HID_CC_IN_RPT_LEN, report, time);
+
+	HidEmuKbd_armConnEventNotice();
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_applyKeyEvent
+ *
+ * @brief   Apply a key event to the keyboard input report.
+ *
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   key - HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
+ *
+ * @return  none
+ */
+static void HidEmuKbd_applyKeyEvent(uint8_t event, uint8_t key)
+{
+	uint8_t *buf = keyReport;
+#ifndef KB_NKRO
 	uint8_t already_in;
+#endif
 
 	if (event & BOARD_KEY_CHANGE_EVT)
 	// Regular key
 	{
+#ifdef KB_NKRO
+		// One bit per usage, usages beyond the bitmap are not reported
+		if (key > HID_NKRO_USAGE_MAX) {
+			return;
+		}
+		if (event & BOARD_BREAK_CODE_EVT) {
+			buf[1 + (key >> 3)] &= ~(1 << (key & 0x7));
+		} else {
+			buf[1 + (key >> 3)] |= 1 << (key & 0x7);
+		}
+#else
 		if (event & BOARD_BREAK_CODE_EVT)
 		// Release event
 		{
@@ -558,6 +1036,7 @@ static void HidEmuKbd_processAppMsg(hidEmuKbdEvt_t *pMsg)
 				}
 			}
 		}
+#endif
 	} else if (event & BOARD_MOD_CHANGE_EVT)
 	// Modifier key
 	{
@@ -571,143 +1050,1014 @@ static void HidEmuKbd_processAppMsg(hidEmuKbdEvt_t *pMsg)
 			buf[0] |= key;
 		}
 	}
-
-	HidDev_Report(HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_KEYBOARD_IN_RPT_LEN, buf);
 }
 
 /*********************************************************************
- * @fn      HidKEmukbd_keyPressHandler
+ * @fn      HidEmuKbd_keyInReport
  *
- * @brief   Key event handler function.
+ * @brief   Check whether a key is pressed in a keyboard input report.
  *
- * @param   a0 - ignored
+ * @param   report - keyboard input report
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   key - HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
  *
- * @return  none
+ * @return  TRUE if pressed, FALSE otherwise
  */
-static void HidEmuKbd_keyPressHandler(uint8_t event, uint8_t keys)
+static uint8_t HidEmuKbd_keyInReport(const uint8_t *report, uint8_t event, uint8_t key)
 {
-  // Enqueue the event.
-  HidEmuKbd_enqueueMsg(event, keys);
-}
+	if (event & BOARD_MOD_CHANGE_EVT) {
+		return (report[0] & key) != 0;
+	}
 
-/*********************************************************************
- * @fn      HidEmuKbd_receiveReport
- *
- * @brief   Process an incoming HID keyboard report.
- *
- * @param   len - Length of report.
- * @param   pData - Report data.
- *
- * @return  status
- */
-static uint8_t HidEmuKbd_receiveReport(uint8_t len, uint8_t *pData)
-{
-  // Verify data length
-  if (len == HID_LED_OUT_RPT_LEN)
-  {
-    // Set keyfob LEDs
-	Keyboard_changeLedState(*pData);
-    return SUCCESS;
-  }
-  else
-  {
-    return ATT_ERR_INVALID_VALUE_SIZE;
-  }
+#ifdef KB_NKRO
+	return key <= HID_NKRO_USAGE_MAX && (report[1 + (key >> 3)] & (1 << (key & 0x7))) != 0;
+#else
+	for (int i = 2; i < HID_KEYBOARD_IN_RPT_LEN; i++) {
+		if (report[i] == key) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+#endif
 }
 
 /*********************************************************************
- * @fn      HidEmuKbd_reportCB
- *
- * @brief   HID Dev report callback.
+ * @fn      HidEmuKbd_sendKeyReport
  *
- * @param   id - HID report ID.
- * @param   type - HID report type.
- * @param   uuid - attribute uuid.
- * @param   oper - operation:  read, write, etc.
- * @param   len - Length of report.
- * @param   pData - Report data.
+ * @brief   Send the keyboard input report if it changed since the last
+ *          one, and hold later changes until the next connection event
+ *          ends. With KB_NKRO a host in boot protocol mode gets the 6 key
+ *          boot report instead.
  *
- * @return  GATT status code.
+ * @return  TRUE if a report was sent
  */
-static uint8_t HidEmuKbd_reportCB(uint8_t id, uint8_t type, uint16_t uuid,
-                                  uint8_t oper, uint16_t *pLen, uint8_t *pData)
+static uint8_t HidEmuKbd_sendKeyReport(void)
 {
-  uint8_t status = SUCCESS;
+	uint32_t time = keyReportTime;
 
-  // Write
-  if (oper == HID_DEV_OPER_WRITE)
-  {
-    if (uuid == REPORT_UUID)
-    {
-      // Process write to LED output report; ignore others
-      if (type == HID_REPORT_TYPE_OUTPUT)
-      {
-        status = HidEmuKbd_receiveReport(*pLen, pData);
-      }
-    }
+	keyReportTime = 0;
+	if (memcmp(keyReport, keyReportSent, HID_KEYBOARD_IN_RPT_LEN) == 0) {
+		return FALSE;
+	}
+	memcpy(keyReportSent, keyReport, HID_KEYBOARD_IN_RPT_LEN);
 
-    if (status == SUCCESS)
-    {
-      status = HidKbd_SetParameter(id, type, uuid, *pLen, pData);
-    }
-  }
-  // Read
-  else if (oper == HID_DEV_OPER_READ)
-  {
-    uint8_t len;
+#ifdef KB_NKRO
+	if (hidProtocolMode == HID_PROTOCOL_MODE_BOOT) {
+		uint8_t boot[HID_BOOT_KEYBOARD_IN_RPT_LEN];
 
-    status = HidKbd_GetParameter(id, type, uuid, &len, pData);
-    if (status == SUCCESS)
-    {
-      *pLen = len;
-    }
-  }
+		HidEmuKbd_buildBootKeyReport(boot);
+		HidDev_ReportStamped(HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_BOOT_KEYBOARD_IN_RPT_LEN, boot, time);
+	} else
+#endif
+	{
+		HidDev_ReportStamped(HID_RPT_ID_KEY_IN, HID_REPORT_TYPE_INPUT, HID_KEYBOARD_IN_RPT_LEN, keyReport, time);
+	}
 
-  return status;
+	// Not connected, HidDev queues the report until the link is back
+	HidEmuKbd_armConnEventNotice();
+	keyReportInFlight = connEvtNoticeOn;
+	return TRUE;
 }
 
+#ifdef KB_NKRO
 /*********************************************************************
- * @fn      HidEmuKbd_hidEventCB
+ * @fn      HidEmuKbd_buildBootKeyReport
  *
- * @brief   HID Dev event callback.
+ * @brief   Convert the key bitmap to a boot keyboard input report. With
+ *          more than 6 keys down every array entry reports rollover.
  *
- * @param   evt - event ID.
+ * @param   boot - boot report to fill, HID_BOOT_KEYBOARD_IN_RPT_LEN bytes
  *
- * @return  HID response code.
+ * @return  none
  */
-static void HidEmuKbd_hidEventCB(uint8_t evt)
+static void HidEmuKbd_buildBootKeyReport(uint8_t *boot)
 {
-  // Process enter/exit suspend or enter/exit boot mode
-  return;
+	uint8_t n = 2;
+
+	memset(boot, 0, HID_BOOT_KEYBOARD_IN_RPT_LEN);
+	boot[0] = keyReport[0];
+
+	for (int i = 0; i < HID_NKRO_KEY_BYTES; i++) {
+		uint8_t bits = keyReport[1 + i];
+
+		for (int bit = 0; bits != 0; bit++, bits >>= 1) {
+			if ((bits & 0x1) == 0) {
+				continue;
+			}
+			if (n == HID_BOOT_KEYBOARD_IN_RPT_LEN) {
+				memset(&boot[2], HID_KEY_ERROR_ROLLOVER, HID_BOOT_KEYBOARD_IN_RPT_LEN - 2);
+				return;
+			}
+			boot[n++] = (i << 3) + bit;
+		}
+	}
 }
+#endif
 
+#ifdef KB_PS2_MOUSE
 /*********************************************************************
- * @fn      HidEmuKbd_enqueueMsg
+ * @fn      HidEmuKbd_mouseHandler
  *
- * @brief   Creates a message and puts the message in RTOS queue.
+ * @brief   Mouse packet handler function, runs in the keyboard task.
+ *          Movement is added up until the next connection event, each
+ *          button change is queued with the movement that led up to it.
  *
- * @param   event  - message event.
- * @param   state  - message state.
+ * @param   buttons - button state
+ * @param   dx, dy, wheel - movement in HID directions
  *
- * @return  TRUE or FALSE
+ * @return  none
  */
-static uint8_t HidEmuKbd_enqueueMsg(uint16_t event, uint8_t state)
+static void HidEmuKbd_mouseHandler(uint8_t buttons, int16_t dx, int16_t dy, int8_t wheel)
 {
-  hidEmuKbdEvt_t *pMsg;
+  hidEmuKbdEvt_t evt;
 
-  // Create dynamic pointer to message.
-  if (pMsg = ICall_malloc(sizeof(hidEmuKbdEvt_t)))
+  // The application task runs at a lower priority and takes the sums with
+  // the scheduler locked, so it never sees them half updated
+  if (buttons != mouseButtons)
   {
-    pMsg->hdr.event = event;
-    pMsg->hdr.state = state;
+    mouseButtons = buttons;
 
-    // Enqueue the message.
-    return Util_enqueueMsg(appMsgQueue, sem, (uint8_t *)pMsg);
-  }
+    evt.hdr.event = HIDEMUKBD_MOUSE_BUTTON_EVT;
+    evt.hdr.state = buttons;
+    evt.time = 0;
+    evt.dx = mouseDx + dx;
+    evt.dy = mouseDy + dy;
+    evt.wheel = mouseWheel + wheel;
+
+    if (HidEmuKbd_enqueueEvt(&evt))
+    {
+      mouseDx = mouseDy = mouseWheel = 0;
+      mouseButtonsUnsent = FALSE;
+      Semaphore_post(sem);
+      return;
+    }
+
+    // Keep the movement, the button state goes with the next report
+    mouseButtonsUnsent = TRUE;
+  }
+
+  mouseDx += dx;
+  mouseDy += dy;
+  mouseWheel += wheel;
+
+  // Between connection events the movement waits for the next one
+  if (!connEvtNoticeOn && !mouseMoveQueued)
+  {
+    mouseMoveQueued = HidEmuKbd_enqueueMsg(HIDEMUKBD_MOUSE_MOVE_EVT, 0, 0);
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_sendMouseReport
+ *
+ * @brief   Send a mouse input report, and have the connection event
+ *          notice collect the movement that follows. Movement beyond the
+ *          report range is left for the next report.
+ *
+ * @param   buttons - button state
+ * @param   dx, dy, wheel - movement in HID directions
+ *
+ * @return  none
+ */
+static void HidEmuKbd_sendMouseReport(uint8_t buttons, int16_t dx, int16_t dy, int16_t wheel)
+{
+  uint8_t report[HID_MOUSE_IN_RPT_LEN];
+  int8_t x, y, z;
+  uint8_t len;
+  UInt key;
+
+  x = (dx > 127) ? 127 : (dx < -127) ? -127 : dx;
+  y = (dy > 127) ? 127 : (dy < -127) ? -127 : dy;
+  z = (wheel > 127) ? 127 : (wheel < -127) ? -127 : wheel;
+
+  if (x != dx || y != dy || z != wheel)
+  {
+    key = Task_disable();
+    mouseDx += dx - x;
+    mouseDy += dy - y;
+    mouseWheel += wheel - z;
+    Task_restore(key);
+  }
+
+  report[0] = buttons;
+  report[1] = (uint8_t)x;
+  report[2] = (uint8_t)y;
+  report[3] = (uint8_t)z;
+  len = (hidProtocolMode == HID_PROTOCOL_MODE_BOOT) ? HID_BOOT_MOUSE_IN_RPT_LEN :
+                                                      HID_MOUSE_IN_RPT_LEN;
+  HidDev_Report(HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT, len, report);
+
+  HidEmuKbd_armConnEventNotice();
+}
+#endif
+
+/*********************************************************************
+ * @fn      HidEmuKbd_armConnEventNotice
+ *
+ * @brief   A report was sent, have the connection event notice collect
+ *          what follows.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_armConnEventNotice(void)
+{
+#ifdef KB_CONN_PARAM_ADAPT
+  HidEmuKbd_connActivity();
+#endif
+
+  connEvtIdle = 0;
+  if (!connEvtNoticeOn)
+  {
+    uint16_t connHandle;
+    uint8_t state;
+
+    GAPRole_GetParameter(GAPROLE_STATE, &state);
+    if (state == GAPROLE_CONNECTED || state == GAPROLE_CONNECTED_ADV)
+    {
+      GAPRole_GetParameter(GAPROLE_CONNHANDLE, &connHandle);
+      if (HCI_EXT_ConnEventNoticeCmd(connHandle, selfEntity,
+                                     HIDEMUKBD_CONN_EVT_END_EVT) == SUCCESS)
+      {
+        connEvtNoticeOn = TRUE;
+      }
+    }
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_connEventEnd
+ *
+ * @brief   Report the key changes, mouse movement and unqueued button
+ *          changes gathered since the last report, or turn the
+ *          connection event notice off once there is nothing to report.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_connEventEnd(void)
+{
+  uint8_t sent;
+#ifdef KB_PS2_MOUSE
+  int16_t dx, dy, wheel;
+  uint8_t buttons, buttonsUnsent;
+  UInt key;
+#endif
+
+  keyReportInFlight = FALSE;
+  sent = HidEmuKbd_sendKeyReport();
+
+#ifdef KB_PS2_MOUSE
+  key = Task_disable();
+  dx = mouseDx;
+  dy = mouseDy;
+  wheel = mouseWheel;
+  buttons = mouseButtons;
+  buttonsUnsent = mouseButtonsUnsent;
+  mouseDx = mouseDy = mouseWheel = 0;
+  mouseButtonsUnsent = FALSE;
+  Task_restore(key);
+
+  if (dx != 0 || dy != 0 || wheel != 0 || buttonsUnsent)
+  {
+    HidEmuKbd_sendMouseReport(buttons, dx, dy, wheel);
+    sent = TRUE;
+  }
+#endif
+
+  if (!sent && connEvtNoticeOn && ++connEvtIdle >= HIDEMUKBD_CONN_EVT_IDLE_LIMIT)
+  {
+    uint16_t connHandle;
+
+    GAPRole_GetParameter(GAPROLE_CONNHANDLE, &connHandle);
+    HCI_EXT_ConnEventNoticeCmd(connHandle, selfEntity, 0);
+    connEvtNoticeOn = FALSE;
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_gapRoleStateChange
+ *
+ * @brief   The connection event notice ends with the connection. Key
+ *          changes still held are handed to HidDev, which keeps them
+ *          for the next connection.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_gapRoleStateChange(void)
+{
+  uint8_t state;
+
+  GAPRole_GetParameter(GAPROLE_STATE, &state);
+  if (state != GAPROLE_CONNECTED && state != GAPROLE_CONNECTED_ADV)
+  {
+    connEvtNoticeOn = FALSE;
+    keyReportInFlight = FALSE;
+    HidEmuKbd_sendKeyReport();
+
+#ifdef KB_CONN_PARAM_ADAPT
+    // A new connection starts on the idle set
+    Util_stopClock(&connIdleClock);
+    Util_stopClock(&connHoldClock);
+    events = 0;
+    connParamFast = FALSE;
+    connParamReports = 0;
+    connParamTries = 0;
+#endif
+  }
+
+#ifdef KB_TIMING_STATS
+  HidEmuKbd_updateReportQStats();
+#endif
+}
+
+#ifdef KB_CONN_PARAM_ADAPT
+/*********************************************************************
+ * @fn      HidEmuKbd_connActivity
+ *
+ * @brief   A report was sent. Restart the idle timeout, and ask for the
+ *          fast parameter set once enough reports follow each other.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_connActivity(void)
+{
+  Util_restartClock(&connIdleClock, HIDEMUKBD_CONN_IDLE_TIMEOUT);
+
+  if (!connParamFast && ++connParamReports >= HIDEMUKBD_CONN_FAST_REPORTS)
+  {
+    connParamFast = TRUE;
+    connParamTries = 0;
+    HidEmuKbd_connParamUpdate();
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_connIdle
+ *
+ * @brief   No report for the idle timeout, go back to the idle set.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_connIdle(void)
+{
+  connParamReports = 0;
+
+  if (connParamFast)
+  {
+    connParamFast = FALSE;
+    connParamTries = 0;
+    HidEmuKbd_connParamUpdate();
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_connParamUpdate
+ *
+ * @brief   Request the wanted parameter set if the link does not use it.
+ *          Requests are at least HIDEMUKBD_CONN_UPDATE_HOLD apart, one
+ *          held back is made when the hold ends, and each set is asked
+ *          for at most HIDEMUKBD_CONN_UPDATE_TRIES times.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_connParamUpdate(void)
+{
+  uint16_t interval, latency;
+  uint16_t minInterval, maxInterval, slaveLatency;
+  uint8_t state;
+
+  if (Util_isActive(&connHoldClock))
+  {
+    return;
+  }
+
+  GAPRole_GetParameter(GAPROLE_STATE, &state);
+  if (state != GAPROLE_CONNECTED && state != GAPROLE_CONNECTED_ADV)
+  {
+    return;
+  }
+
+  if (connParamFast)
+  {
+    minInterval = HIDEMUKBD_FAST_MIN_CONN_INTERVAL;
+    maxInterval = HIDEMUKBD_FAST_MAX_CONN_INTERVAL;
+    slaveLatency = HIDEMUKBD_FAST_SLAVE_LATENCY;
+  }
+  else
+  {
+    minInterval = HIDEMUKBD_IDLE_MIN_CONN_INTERVAL;
+    maxInterval = HIDEMUKBD_IDLE_MAX_CONN_INTERVAL;
+    slaveLatency = HIDEMUKBD_IDLE_SLAVE_LATENCY;
+  }
+
+  GAPRole_GetParameter(GAPROLE_CONN_INTERVAL, &interval);
+  GAPRole_GetParameter(GAPROLE_CONN_LATENCY, &latency);
+  if (interval >= minInterval && interval <= maxInterval &&
+      latency == slaveLatency)
+  {
+    return;
+  }
+
+  if (connParamTries >= HIDEMUKBD_CONN_UPDATE_TRIES)
+  {
+    return;
+  }
+  connParamTries++;
+
+  GAPRole_SendUpdateParam(minInterval, maxInterval, slaveLatency,
+                          DEFAULT_DESIRED_CONN_TIMEOUT, GAPROLE_NO_ACTION);
+
+  // Check the outcome when the hold ends
+  Util_startClock(&connHoldClock);
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_clockHandler
+ *
+ * @brief   Clock handler, stores the event and wakes up the application.
+ *
+ * @param   arg - event flag.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_clockHandler(UArg arg)
+{
+  events |= arg;
+
+  Semaphore_post(sem);
+}
+#endif
+
+/*********************************************************************
+ * @fn      HidKEmukbd_keyPressHandler
+ *
+ * @brief   Key event handler function.
+ *
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   keys - HID usage, or modifier bit for BOARD_MOD_CHANGE_EVT
+ * @param   time - capture time, 0 if not measured
+ *
+ * @return  none
+ */
+static void HidEmuKbd_keyPressHandler(uint8_t event, uint8_t keys, uint32_t time)
+{
+  HidEmuKbd_queueKeyEvent(event, keys, time);
+  Semaphore_post(sem);
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_keyBatchHandler
+ *
+ * @brief   Key batch handler function, queues all events in one message.
+ *
+ * @param   numEvents - number of key events
+ * @param   events - key events
+ *
+ * @return  none
+ */
+static void HidEmuKbd_keyBatchHandler(uint8_t numEvents, const keyEvent_t *events)
+{
+  for (uint8_t n = 0; n < numEvents; n++)
+  {
+    HidEmuKbd_queueKeyEvent(events[n].event, events[n].key, events[n].time);
+  }
+
+  // One wakeup for the whole batch
+  Semaphore_post(sem);
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_queueKeyEvent
+ *
+ * @brief   Queue a key event, keyboard task only. A change the ring has
+ *          no room for is kept in keysUnsent rather than dropped, so a
+ *          released key is never left down on the host. The caller wakes
+ *          up the application task.
+ *
+ * @param   event - BOARD_*_EVT bitmask
+ * @param   key - HID usage, modifier bit or consumer key
+ * @param   time - capture time, 0 if not measured
+ *
+ * @return  none
+ */
+static void HidEmuKbd_queueKeyEvent(uint8_t event, uint8_t key, uint32_t time)
+{
+  hidEmuKbdEvt_t evt;
+  uint16_t idx;
+  uint8_t bit = 0;
+
+  evt.hdr.event = event;
+  evt.hdr.state = key;
+  evt.time = time;
+
+  if (!keyChangesUnsent && HidEmuKbd_enqueueEvt(&evt))
+  {
+    return;
+  }
+
+  if (event & BOARD_CONSUMER_CHANGE_EVT)
+  {
+    idx = HIDEMUKBD_KEY_IDX_CONSUMER + key;
+  }
+  else if (event & BOARD_MOD_CHANGE_EVT)
+  {
+    while (bit < 7 && !(key & (1 << bit)))
+    {
+      bit++;
+    }
+    idx = HIDEMUKBD_KEY_IDX_MOD + bit;
+  }
+  else
+  {
+    idx = key;
+  }
+
+  if (idx >= HIDEMUKBD_KEY_IDX_COUNT)
+  {
+    return;
+  }
+
+  // The application task runs at a lower priority and takes these with
+  // the scheduler locked, so it never sees them half updated
+  keysUnsent[idx / 8] |= 1 << (idx % 8);
+  if (event & BOARD_BREAK_CODE_EVT)
+  {
+    keysUnsentDown[idx / 8] &= ~(1 << (idx % 8));
+  }
+  else
+  {
+    keysUnsentDown[idx / 8] |= 1 << (idx % 8);
+  }
+  keyChangesUnsent = TRUE;
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_applyUnsentKeys
+ *
+ * @brief   Apply the key changes kept off a full ring, once the events
+ *          queued before them are processed. Each key goes to the state
+ *          it was left in; presses and releases in between are lost.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_applyUnsentKeys(void)
+{
+  uint8_t unsent[HIDEMUKBD_KEY_IDX_BYTES];
+  uint8_t down[HIDEMUKBD_KEY_IDX_BYTES];
+  hidEmuKbdEvt_t evt;
+  uint16_t idx;
+  UInt key;
+
+  key = Task_disable();
+  memcpy(unsent, keysUnsent, sizeof(unsent));
+  memcpy(down, keysUnsentDown, sizeof(down));
+  memset(keysUnsent, 0, sizeof(keysUnsent));
+  keyChangesUnsent = FALSE;
+  Task_restore(key);
+
+  evt.time = 0;
+  for (idx = 0; idx < HIDEMUKBD_KEY_IDX_COUNT; idx++)
+  {
+    if (!(unsent[idx / 8] & (1 << (idx % 8))))
+    {
+      continue;
+    }
+
+    if (idx >= HIDEMUKBD_KEY_IDX_CONSUMER)
+    {
+      evt.hdr.event = BOARD_CONSUMER_CHANGE_EVT;
+      evt.hdr.state = idx - HIDEMUKBD_KEY_IDX_CONSUMER;
+    }
+    else if (idx >= HIDEMUKBD_KEY_IDX_MOD)
+    {
+      evt.hdr.event = BOARD_MOD_CHANGE_EVT;
+      evt.hdr.state = 1 << (idx - HIDEMUKBD_KEY_IDX_MOD);
+    }
+    else
+    {
+      evt.hdr.event = BOARD_KEY_CHANGE_EVT;
+      evt.hdr.state = idx;
+    }
+
+    if (!(down[idx / 8] & (1 << (idx % 8))))
+    {
+      evt.hdr.event |= BOARD_BREAK_CODE_EVT;
+    }
+
+    HidEmuKbd_processAppMsg(&evt);
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_receiveReport
+ *
+ * @brief   Process an incoming HID keyboard report.
+ *
+ * @param   len - Length of report.
+ * @param   pData - Report data.
+ *
+ * @return  status
+ */
+static uint8_t HidEmuKbd_receiveReport(uint8_t len, uint8_t *pData)
+{
+  // Verify data length
+  if (len == HID_LED_OUT_RPT_LEN)
+  {
+    // Set keyfob LEDs
+	Keyboard_changeLedState(*pData);
+    return SUCCESS;
+  }
+  else
+  {
+    return ATT_ERR_INVALID_VALUE_SIZE;
+  }
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_reportCB
+ *
+ * @brief   HID Dev report callback.
+ *
+ * @param   id - HID report ID.
+ * @param   type - HID report type.
+ * @param   uuid - attribute uuid.
+ * @param   oper - operation:  read, write, etc.
+ * @param   len - Length of report.
+ * @param   pData - Report data.
+ *
+ * @return  GATT status code.
+ */
+static uint8_t HidEmuKbd_reportCB(uint8_t id, uint8_t type, uint16_t uuid,
+                                  uint8_t oper, uint16_t *pLen, uint8_t *pData)
+{
+  uint8_t status = SUCCESS;
+
+  // Write
+  if (oper == HID_DEV_OPER_WRITE)
+  {
+    if (uuid == REPORT_UUID)
+    {
+      // Process write to LED output report; ignore others
+      if (type == HID_REPORT_TYPE_OUTPUT)
+      {
+        status = HidEmuKbd_receiveReport(*pLen, pData);
+      }
+    }
+
+    if (status == SUCCESS)
+    {
+      status = HidKbd_SetParameter(id, type, uuid, *pLen, pData);
+    }
+  }
+  // Read
+  else if (oper == HID_DEV_OPER_READ)
+  {
+    uint8_t len;
+
+    status = HidKbd_GetParameter(id, type, uuid, &len, pData);
+    if (status == SUCCESS)
+    {
+      *pLen = len;
+    }
+  }
+
+  return status;
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_hidEventCB
+ *
+ * @brief   HID Dev event callback.
+ *
+ * @param   evt - event ID.
+ *
+ * @return  HID response code.
+ */
+static void HidEmuKbd_hidEventCB(uint8_t evt)
+{
+  // Runs in the HidDev task, the connection event notice belongs to the
+  // application task
+  if (evt == HID_DEV_GAPROLE_STATE_CHANGE_EVT)
+  {
+    HidEmuKbd_enqueueMsg(HIDEMUKBD_GAPROLE_STATE_EVT, 0, 0);
+  }
+
+  // Process enter/exit suspend or enter/exit boot mode
+  return;
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_reportMergeCB
+ *
+ * @brief   HID Dev report merge callback, runs with the scheduler locked
+ *          when the report queue is full. The first report can go if no
+ *          key changes both from pPrev to pFirst and from pFirst to
+ *          pSecond. Mouse movement is added up while the buttons stay.
+ *
+ * @param   id - report ID.
+ * @param   type - report type.
+ * @param   len - report length.
+ * @param   pPrev - report the host has before pFirst.
+ * @param   pFirst - report to fold into pSecond.
+ * @param   pSecond - report after pFirst.
+ *
+ * @return  TRUE if pFirst can be dropped.
+ */
+static uint8_t HidEmuKbd_reportMergeCB(uint8_t id, uint8_t type, uint8_t len,
+                                       const uint8_t *pPrev,
+                                       const uint8_t *pFirst,
+                                       uint8_t *pSecond)
+{
+  const uint8_t *reports[3] = { pPrev, pFirst, pSecond };
+  uint8_t i, j, key;
+
+  if (type != HID_REPORT_TYPE_INPUT)
+  {
+    return FALSE;
+  }
+
+  if (id == HID_RPT_ID_KEY_IN)
+  {
+    // Modifier byte, and the key bitmap of the N-key rollover report
+    for (i = 0; i < ((len == HID_BOOT_KEYBOARD_IN_RPT_LEN) ? 1 : len); i++)
+    {
+      if ((pPrev[i] ^ pFirst[i]) & (pFirst[i] ^ pSecond[i]))
+      {
+        return FALSE;
+      }
+    }
+
+    // Key arrays, every key in any of the three reports
+    if (len == HID_BOOT_KEYBOARD_IN_RPT_LEN)
+    {
+      for (j = 0; j < 3; j++)
+      {
+        for (i = 2; i < len; i++)
+        {
+          key = reports[j][i];
+          if (key != 0 &&
+              HidEmuKbd_keyInArray(pPrev, key) != HidEmuKbd_keyInArray(pFirst, key) &&
+              HidEmuKbd_keyInArray(pFirst, key) != HidEmuKbd_keyInArray(pSecond, key))
+          {
+            return FALSE;
+          }
+        }
+      }
+    }
+
+    return TRUE;
+  }
+  else if (id == HID_RPT_ID_CC_IN)
+  {
+    uint16_t prev = BUILD_UINT16(pPrev[0], pPrev[1]);
+    uint16_t first = BUILD_UINT16(pFirst[0], pFirst[1]);
+    uint16_t second = BUILD_UINT16(pSecond[0], pSecond[1]);
+
+    // One usage at a time: a release followed by another press merges
+    return (first == prev || first == second || (first == 0 && prev != second));
+  }
+#ifdef KB_PS2_MOUSE
+  else if (id == HID_RPT_ID_MOUSE_IN)
+  {
+    int16_t sum[HID_MOUSE_IN_RPT_LEN];
+
+    if (pFirst[0] != pSecond[0])
+    {
+      return FALSE;
+    }
+
+    for (i = 1; i < len; i++)
+    {
+      sum[i] = (int8_t)pFirst[i] + (int8_t)pSecond[i];
+      if (sum[i] > 127 || sum[i] < -127)
+      {
+        return FALSE;
+      }
+    }
+
+    for (i = 1; i < len; i++)
+    {
+      pSecond[i] = (uint8_t)sum[i];
+    }
+
+    return TRUE;
+  }
+#endif
 
   return FALSE;
 }
 
+/*********************************************************************
+ * @fn      HidEmuKbd_keyInArray
+ *
+ * @brief   Look a key up in a boot format keyboard report.
+ *
+ * @param   report - boot keyboard input report.
+ * @param   key - HID usage.
+ *
+ * @return  TRUE if the key is in the report.
+ */
+static uint8_t HidEmuKbd_keyInArray(const uint8_t *report, uint8_t key)
+{
+  uint8_t i;
+
+  for (i = 2; i < HID_BOOT_KEYBOARD_IN_RPT_LEN; i++)
+  {
+    if (report[i] == key)
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+#ifdef KB_TIMING_STATS
+/*********************************************************************
+ * @fn      HidEmuKbd_getStats
+ *
+ * @brief   Keyboard diagnostics read callback, the statistics with the
+ *          HID Dev report queue counters brought up to date.
+ *
+ * @param   pLen - set to the statistics length.
+ *
+ * @return  statistics, laid out as keyboardStats_t
+ */
+static uint8_t *HidEmuKbd_getStats(uint16_t *pLen)
+{
+  HidEmuKbd_updateReportQStats();
+
+  return Keyboard_getStats(pLen);
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_updateReportQStats
+ *
+ * @brief   Copy the HID Dev report queue counters into the statistics.
+ *
+ * @return  none
+ */
+static void HidEmuKbd_updateReportQStats(void)
+{
+  hidDevReportQStats_t qStats;
+
+  HidDev_GetParameter(HIDDEV_REPORT_Q_STATS, &qStats);
+
+  pKbdStats->reportQOverflows = qStats.overflows;
+  pKbdStats->reportQMerged = qStats.merged;
+  pKbdStats->reportQCollapsed = qStats.collapsed;
+  pKbdStats->reportQDropped = qStats.dropped;
+}
+#endif
+
+#ifdef KB_KEYMAP
+/*********************************************************************
+ * @fn      HidEmuKbd_keymapWriteCB
+ *
+ * @brief   Keymap characteristic write callback. Runs in the stack task,
+ *          and SNV is only reached through ICall from the application
+ *          task, so the change is passed on in the app event ring. The
+ *          keymap belongs to the application task, which finds out whether
+ *          an entry fits when it applies it.
+ *
+ * @param   pValue - written value
+ * @param   len - value length
+ *
+ * @return  SUCCESS or ATT error code
+ */
+static bStatus_t HidEmuKbd_keymapWriteCB(uint8_t *pValue, uint16_t len)
+{
+  hidEmuKbdEvt_t evt;
+
+  evt.hdr.event = HIDEMUKBD_KEYMAP_EVT;
+  evt.time = 0;
+
+  if (len == 1 && pValue[0] == KBD_KEYMAP_CMD_CLEAR)
+  {
+    evt.hdr.state = KBD_KEYMAP_CMD_CLEAR;
+  }
+  else if (len == KBD_KEYMAP_ENTRY_LEN)
+  {
+    evt.hdr.state = HIDEMUKBD_KEYMAP_SET;
+    evt.entry.layer = pValue[0];
+    evt.entry.usage = pValue[1];
+    evt.entry.action = BUILD_UINT16(pValue[2], pValue[3]);
+
+    if (!Keymap_validEntry(&evt.entry))
+    {
+      return ATT_ERR_INVALID_VALUE;
+    }
+  }
+  else
+  {
+    return ATT_ERR_INVALID_VALUE_SIZE;
+  }
+
+  if (!HidEmuKbd_enqueueEvt(&evt))
+  {
+    return ATT_ERR_INSUFFICIENT_RESOURCES;
+  }
+  Semaphore_post(sem);
+
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_keymapChange
+ *
+ * @brief   Apply a keymap change written over GATT. The write was
+ *          acknowledged already, its result, bleNoResources for an entry
+ *          that does not fit, is read back with the keymap.
+ *
+ * @param   pMsg - HIDEMUKBD_KEYMAP_EVT event
+ *
+ * @return  none
+ */
+static void HidEmuKbd_keymapChange(hidEmuKbdEvt_t *pMsg)
+{
+  if (pMsg->hdr.state == HIDEMUKBD_KEYMAP_SET)
+  {
+    Keymap_setEntry(&pMsg->entry);
+  }
+  else
+  {
+    Keymap_clear();
+  }
+}
+#endif
+
+/*********************************************************************
+ * @fn      HidEmuKbd_enqueueMsg
+ *
+ * @brief   Creates an event and puts it in the app event ring.
+ *
+ * @param   event  - message event.
+ * @param   state  - message state.
+ * @param   time   - key capture time, 0 if not measured.
+ *
+ * @return  TRUE or FALSE
+ */
+static uint8_t HidEmuKbd_enqueueMsg(uint16_t event, uint8_t state,
+                                    uint32_t time)
+{
+  hidEmuKbdEvt_t evt;
+
+  evt.hdr.event = event;
+  evt.hdr.state = state;
+  evt.time = time;
+
+  if (HidEmuKbd_enqueueEvt(&evt))
+  {
+    // Wake up the application task.
+    Semaphore_post(sem);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*********************************************************************
+ * @fn      HidEmuKbd_enqueueEvt
+ *
+ * @brief   Copy an event into the app event ring, task context only.
+ *          The caller wakes up the application task.
+ *
+ * @param   pEvt - event to add.
+ *
+ * @return  TRUE, or FALSE if the ring is full and the event was dropped
+ */
+static uint8_t HidEmuKbd_enqueueEvt(const hidEmuKbdEvt_t *pEvt)
+{
+  uint8_t depth;
+  UInt key;
+
+  key = Task_disable();
+
+  depth = (uint8_t)(evtWritePos - evtReadPos);
+  if (depth >= HIDEMUKBD_EVT_RING_SIZE)
+  {
+    evtRingDrops++;
+#ifdef KB_TIMING_STATS
+    pKbdStats->appEventDrops = evtRingDrops;
+#endif
+    Task_restore(key);
+    return FALSE;
+  }
+
+  evtRing[evtWritePos & HIDEMUKBD_EVT_RING_MASK] = *pEvt;
+  evtWritePos++;
+
+  if (++depth > evtRingPeak)
+  {
+    evtRingPeak = depth;
+#ifdef KB_TIMING_STATS
+    pKbdStats->appEventPeak = evtRingPeak;
+#endif
+  }
+
+  Task_restore(key);
+  return TRUE;
+}
+
 
 /*********************************************************************
 *********************************************************************/
@@ -197,6 +197,17 @@ void Util_restartClock(Clock_Struct *pClock, uint32_t clockTimeout)
   Clock_start(handle);
 }
 
+/*********************************************************************
+ * @fn      Util_restartClockMicro
+ *
+ * @brief   Restart a clock by changing the timeout, in microseconds.
+ *
+ * @param   pClock - pointer to clock struct
+ * @param   clockTimeout - longevity of clock timer in microseconds, rounded
+ *                         up so the clock never expires early
+ *
+ * @return  none
+ */
 void Util_restartClockMicro(Clock_Struct *pClock, uint32_t clockTimeout)
 {
   uint32_t clockTicks;
@@ -210,8 +221,9 @@ void Util_restartClockMicro(Clock_Struct *pClock, uint32_t clockTimeout)
     Clock_stop(handle);
   }
 
-  // Convert timeout in milliseconds to ticks.
-  clockTicks = clockTimeout * (1 / Clock_tickPeriod);
+  // Convert timeout in microseconds to ticks. One extra tick covers the
+  // partially elapsed current tick.
+  clockTicks = (clockTimeout + Clock_tickPeriod - 1) / Clock_tickPeriod + 1;
 
   // Set the initial timeout
   Clock_setTimeout(handle, clockTicks);
@@ -141,7 +141,19 @@ extern void Util_startClock(Clock_Struct *pClock);
  * @return  none
  */
 extern void Util_restartClock(Clock_Struct *pClock, uint32_t clockTimeout);
-void Util_restartClockMicro(Clock_Struct *pClock, uint32_t clockTimeout);
+
+/*********************************************************************
+ * @fn      Util_restartClockMicro
+ *
+ * @brief   Restart a clock by changing the timeout, in microseconds.
+ *
+ * @param   pClock - pointer to clock struct
+ * @param   clockTimeout - longevity of clock timer in microseconds
+ *
+ * @return  none
+ */
+extern void Util_restartClockMicro(Clock_Struct *pClock, uint32_t clockTimeout);
+
 /*********************************************************************
  * @fn      Util_isActive
  *
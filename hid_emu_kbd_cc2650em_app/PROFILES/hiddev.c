@@ -122,8 +122,20 @@
 #define HID_BATT_SERVICE_EVT                  0x0010
 #define HID_PASSCODE_EVT                      0x0020
 #define HID_PAIR_STATE_EVT                    0x0040
+#define HID_RESUME_REPORT_EVT                 0x0080
+#define HID_PARAM_UPDATE_EVT                  0x0100
 
 #define reportQEmpty()                        (firstQIdx == lastQIdx)
+#define reportQNext(idx)                      (((idx) + 1) % HID_DEV_REPORT_Q_SIZE)
+#define reportQPrev(idx)                      (((idx) + HID_DEV_REPORT_Q_SIZE - 1) % \
+                                               HID_DEV_REPORT_Q_SIZE)
+#define reportQFull()                         (reportQNext(lastQIdx) == firstQIdx)
+
+// Notification refused for lack of stack or controller buffers, the report
+// can be sent again once buffers are freed
+#define reportFlowControlled(status)          ((status) == blePending || \
+                                               (status) == bleMemAllocError || \
+                                               (status) == bleNoResources)
 
 #define HIDDEVICE_TASK_PRIORITY               2
 
@@ -135,7 +147,13 @@
  * CONSTANTS
  */
 
-#define HID_DEV_DATA_LEN                      9
+#ifdef KB_NKRO
+  // N-key rollover keyboard report, modifier byte and the 18 byte key
+  // bitmap of hidkbdservice
+  #define HID_DEV_DATA_LEN                    19
+#else
+  #define HID_DEV_DATA_LEN                    9
+#endif
 
 #ifdef HID_DEV_RPT_QUEUE_LEN
   #define HID_DEV_REPORT_Q_SIZE               (HID_DEV_RPT_QUEUE_LEN+1)
@@ -143,6 +161,20 @@
   #define HID_DEV_REPORT_Q_SIZE               (10+1)
 #endif
 
+// Highest report ID and widest span of report and CCC handles indexed by
+// HidDev_RegisterReports. Lookups outside these fall back to a table scan.
+#ifndef HID_DEV_RPT_ID_MAX
+  #define HID_DEV_RPT_ID_MAX                  7
+#endif
+
+#ifndef HID_DEV_RPT_HANDLE_SPAN
+  #define HID_DEV_RPT_HANDLE_SPAN             64
+#endif
+
+// Report index table entries hold the report table index plus one, with this
+// flag set in the handle index for CCC handles.
+#define HID_DEV_RPT_IDX_CCCD                  0x80
+
 // HID Auto Sync White List configuration parameter. This parameter should be
 // set to FALSE if the HID Host (i.e., the Master device) uses a Resolvable
 // Private Address (RPA). It should be set to TRUE, otherwise.
@@ -175,6 +207,7 @@ typedef struct
  uint8_t type;
  uint8_t len;
  uint8_t data[HID_DEV_DATA_LEN];
+ uint32_t time;
 } hidDevReport_t;
 
 /*********************************************************************
@@ -236,6 +269,14 @@ static hidRptMap_t *pHidDevRptTbl;
 
 static uint8_t hidDevRptTblLen;
 
+// Report table indexes by [mode][type-1][id] and by handle offset
+static uint8_t hidDevRptIdIdx[HID_PROTOCOL_MODE_REPORT+1][HID_REPORT_TYPE_FEATURE]
+                             [HID_DEV_RPT_ID_MAX+1];
+static uint8_t hidDevRptHandleIdx[HID_DEV_RPT_HANDLE_SPAN];
+static uint16_t hidDevRptHandleBase;
+static uint8_t hidDevRptIdIdxValid = FALSE;
+static uint8_t hidDevRptHandleIdxValid = FALSE;
+
 static hidDevCB_t *pHidDevCB;
 
 static hidDevCfg_t *pHidDevCfg;
@@ -251,12 +292,24 @@ static hidDevReport_t hidDevReportQ[HID_DEV_REPORT_Q_SIZE];
 // Last report sent out
 static hidDevReport_t lastReport = { 0 };
 
+// Report taken off the queue and being sent. Until sent it is the state
+// the host gets before the queued reports, lastReport is not.
+static hidDevReport_t reportInFlight;
+static volatile uint8_t reportInFlightValid = FALSE;
+
+// Report queue counters
+static hidDevReportQStats_t hidDevReportQStats = { 0 };
+
 // State when HID reports are ready to be sent out
 static volatile uint8_t hidDevReportReadyState = TRUE;
 
 // Report ready delay clock
 static Clock_Struct reportReadyClock;
 
+// Sending stopped until buffers are freed, and the clock resuming it
+static uint8_t hidDevReportQPaused = FALSE;
+static Clock_Struct reportResumeClock;
+
 /*********************************************************************
  * LOCAL FUNCTIONS
  */
@@ -281,15 +334,25 @@ static hidRptMap_t *HidDev_reportByHandle(uint16_t handle);
 static hidRptMap_t *HidDev_reportById(uint8_t id, uint8_t type);
 static hidRptMap_t *HidDev_reportByCccdHandle(uint16_t handle);
 static void HidDev_enqueueReport(uint8_t id, uint8_t type, uint8_t len,
-                                 uint8_t *pData);
-static hidDevReport_t *HidDev_dequeueReport(void);
-static void HidDev_sendReport(uint8_t id, uint8_t type, uint8_t len,
-                              uint8_t *pData);
+                                 uint8_t *pData, uint32_t time);
+static uint8_t HidDev_dequeueReport(hidDevReport_t *pReport);
+static void HidDev_sendQueuedReports(void);
+static void HidDev_compactReportQ(void);
+static uint8_t HidDev_mergeQueuedReport(void);
+static uint8_t HidDev_collapseQueuedReports(void);
+static void HidDev_removeQueuedReport(uint8_t idx);
+static void HidDev_requeueReport(hidDevReport_t *pReport);
+static void HidDev_pauseReports(void);
+static uint8_t HidDev_sendReport(uint8_t id, uint8_t type, uint8_t len,
+                                 uint8_t *pData, uint32_t time);
 static uint8_t HidDev_sendNoti(uint16_t handle, uint8_t len, uint8_t *pData);
 static uint8_t HidDev_isbufset(uint8_t *buf, uint8_t val, uint8_t len);
 
 // Peripheral GAP role.
 static void HidDev_stateChangeCB(gaprole_States_t newState);
+static void HidDev_paramUpdateCB(uint16_t connInterval,
+                                 uint16_t connSlaveLatency,
+                                 uint16_t connTimeout);
 static void HidDev_processStateChangeEvt(gaprole_States_t newState);
 
 // Pair state.
@@ -325,6 +388,9 @@ static gapRolesCBs_t hidDev_PeripheralCBs =
   HidDev_stateChangeCB   // Profile State Change Callbacks
 };
 
+// GAP Role Connection Parameter Update Callback
+static gapRolesParamUpdateCB_t hidDevParamUpdateCB = HidDev_paramUpdateCB;
+
 // Bond Manager Callbacks
 static const gapBondCBs_t hidDevBondCB =
 {
@@ -412,7 +478,11 @@ static void HidDev_init(void)
 
   // Initialize report ready clock timer
   Util_constructClock(&reportReadyClock, HidDev_reportReadyClockCB,
-                      HID_REPORT_READY_TIME, 0, false, NULL);
+                      HID_REPORT_READY_TIME, 0, false, 0);
+
+  // Initialize report resume clock, the timeout is set when started
+  Util_constructClock(&reportResumeClock, HidDev_clockHandler,
+                      1, 0, false, HID_RESUME_REPORT_EVT);
 }
 
 /*********************************************************************
@@ -505,32 +575,24 @@ static void HidDev_taskFxn(UArg a0, UArg a1)
       HidDev_battPeriodicTask();
     }
 
+    // Resume sending reports event.
+    if (events & HID_RESUME_REPORT_EVT)
+    {
+      events &= ~HID_RESUME_REPORT_EVT;
+
+      hidDevReportQPaused = FALSE;
+      events |= HID_SEND_REPORT_EVT;
+    }
+
     // Send HID report event.
     if (events & HID_SEND_REPORT_EVT)
     {
       events &= ~HID_SEND_REPORT_EVT;
 
       // If connection is secure
-      if (hidDevConnSecure && hidDevReportReadyState)
+      if (hidDevConnSecure && hidDevReportReadyState && !hidDevReportQPaused)
       {
-        hidDevReport_t *pReport = HidDev_dequeueReport();
-
-        if (pReport != NULL)
-        {
-          // Send report.
-          HidDev_sendReport(pReport->id, pReport->type, pReport->len,
-                            pReport->data);
-        }
-
-        // If there is another report in the queue
-        if (!reportQEmpty())
-        {
-          // Set another event.
-          events |= HID_SEND_REPORT_EVT;
-
-          // Post the profile's semaphore.
-          Semaphore_post(sem);
-        }
+        HidDev_sendQueuedReports();
       }
     }
   }
@@ -552,6 +614,9 @@ void HidDev_StartDevice(void)
   // Start the Device.
   VOID GAPRole_StartDevice(&hidDev_PeripheralCBs);
 
+  // The report resume clock follows the connection interval.
+  GAPRole_RegisterAppCBs(&hidDevParamUpdateCB);
+
   // Register with bond manager after starting device.
   GAPBondMgr_Register((gapBondCBs_t *)&hidDevBondCB);
 }
@@ -591,8 +656,93 @@ void HidDev_Register(hidDevCfg_t *pCfg, hidDevCB_t *pCBs)
  */
 void HidDev_RegisterReports(uint8_t numReports, hidRptMap_t *pRpt)
 {
+  uint8_t i;
+  uint16_t maxHandle = 0;
+  hidRptMap_t *p;
+
   pHidDevRptTbl = pRpt;
   hidDevRptTblLen = numReports;
+
+  memset(hidDevRptIdIdx, 0, sizeof(hidDevRptIdIdx));
+  memset(hidDevRptHandleIdx, 0, sizeof(hidDevRptHandleIdx));
+  hidDevRptHandleBase = 0xFFFF;
+  hidDevRptIdIdxValid = FALSE;
+  hidDevRptHandleIdxValid = FALSE;
+
+  if (numReports >= HID_DEV_RPT_IDX_CCCD)
+  {
+    // Too many reports to index, lookups scan the table.
+    return;
+  }
+
+  // Index by ID, keeping the first match as the table scan does.
+  for (i = 0, p = pRpt; i < numReports; i++, p++)
+  {
+    if (p->id <= HID_DEV_RPT_ID_MAX &&
+        p->mode <= HID_PROTOCOL_MODE_REPORT &&
+        p->type >= HID_REPORT_TYPE_INPUT &&
+        p->type <= HID_REPORT_TYPE_FEATURE &&
+        hidDevRptIdIdx[p->mode][p->type - 1][p->id] == 0)
+    {
+      hidDevRptIdIdx[p->mode][p->type - 1][p->id] = i + 1;
+    }
+
+    if (p->handle < hidDevRptHandleBase)
+    {
+      hidDevRptHandleBase = p->handle;
+    }
+
+    if (p->handle > maxHandle)
+    {
+      maxHandle = p->handle;
+    }
+
+    if (p->pCccdAttr != NULL)
+    {
+      if (p->pCccdAttr->handle < hidDevRptHandleBase)
+      {
+        hidDevRptHandleBase = p->pCccdAttr->handle;
+      }
+
+      if (p->pCccdAttr->handle > maxHandle)
+      {
+        maxHandle = p->pCccdAttr->handle;
+      }
+    }
+  }
+
+  hidDevRptIdIdxValid = TRUE;
+
+  if (numReports == 0 ||
+      maxHandle - hidDevRptHandleBase >= HID_DEV_RPT_HANDLE_SPAN)
+  {
+    return;
+  }
+
+  // Index by handle offset. A handle shared by several reports (e.g. by
+  // protocol mode) leaves the index off so the mode check still scans.
+  for (i = 0, p = pRpt; i < numReports; i++, p++)
+  {
+    if (hidDevRptHandleIdx[p->handle - hidDevRptHandleBase] != 0)
+    {
+      return;
+    }
+
+    hidDevRptHandleIdx[p->handle - hidDevRptHandleBase] = i + 1;
+
+    if (p->pCccdAttr != NULL)
+    {
+      if (hidDevRptHandleIdx[p->pCccdAttr->handle - hidDevRptHandleBase] != 0)
+      {
+        return;
+      }
+
+      hidDevRptHandleIdx[p->pCccdAttr->handle - hidDevRptHandleBase] =
+        (i + 1) | HID_DEV_RPT_IDX_CCCD;
+    }
+  }
+
+  hidDevRptHandleIdxValid = TRUE;
 }
 
 /*********************************************************************
@@ -608,6 +758,25 @@ void HidDev_RegisterReports(uint8_t numReports, hidRptMap_t *pRpt)
  * @return  None.
  */
 void HidDev_Report(uint8_t id, uint8_t type, uint8_t len, uint8_t *pData)
+{
+  HidDev_ReportStamped(id, type, len, pData, 0);
+}
+
+/*********************************************************************
+ * @fn      HidDev_ReportStamped
+ *
+ * @brief   Send a HID report carrying the time its input was captured.
+ *
+ * @param   id    - HID report ID.
+ * @param   type  - HID report type.
+ * @param   len   - Length of report.
+ * @param   pData - Report data.
+ * @param   time  - Capture time, 0 if not measured.
+ *
+ * @return  None.
+ */
+void HidDev_ReportStamped(uint8_t id, uint8_t type, uint8_t len,
+                          uint8_t *pData, uint32_t time)
 {
   // Validate length of report
   if ( len > HID_DEV_DATA_LEN )
@@ -622,10 +791,18 @@ void HidDev_Report(uint8_t id, uint8_t type, uint8_t len, uint8_t *pData)
     if (hidDevConnSecure)
     {
       // Make sure there're no pending reports.
-      if (reportQEmpty())
+      if (reportQEmpty() && !reportInFlightValid && !hidDevReportQPaused)
       {
         // Send report.
-        HidDev_sendReport(id, type, len, pData);
+        if (!reportFlowControlled(HidDev_sendReport(id, type, len, pData,
+                                                    time)))
+        {
+          return;
+        }
+
+        // Out of buffers; queue the report and try again later
+        HidDev_enqueueReport(id, type, len, pData, time);
+        HidDev_pauseReports();
 
         return;
       }
@@ -638,7 +815,7 @@ void HidDev_Report(uint8_t id, uint8_t type, uint8_t len, uint8_t *pData)
   }
 
   // HidDev task will send report when secure connection is established.
-  HidDev_enqueueReport(id, type, len, pData);
+  HidDev_enqueueReport(id, type, len, pData, time);
 }
 
 /*********************************************************************
@@ -763,6 +940,10 @@ bStatus_t HidDev_GetParameter(uint8_t param, void *pValue)
       *((uint8_t*)pValue) = hidDevGapBondPairingState;
       break;
 
+    case HIDDEV_REPORT_Q_STATS:
+      memcpy(pValue, &hidDevReportQStats, sizeof(hidDevReportQStats_t));
+      break;
+
     default:
       ret = INVALIDPARAMETER;
       break;
@@ -1090,6 +1271,14 @@ static void HidDev_processAppMsg(hidDevEvt_t *pMsg)
       }
       break;
 
+    case HID_PARAM_UPDATE_EVT:
+      // A pause timed for the old interval ends one new interval from now
+      if (hidDevReportQPaused)
+      {
+        HidDev_pauseReports();
+      }
+      break;
+
     default:
       // Do nothing.
       break;
@@ -1146,6 +1335,25 @@ static void HidDev_stateChangeCB(gaprole_States_t newState)
   HidDev_enqueueMsg(HID_STATE_CHANGE_EVT, newState, NULL);
 }
 
+/*********************************************************************
+ * @fn      HidDev_paramUpdateCB
+ *
+ * @brief   Notification from the profile of new connection parameters.
+ *
+ * @param   connInterval - new connection interval
+ * @param   connSlaveLatency - new slave latency
+ * @param   connTimeout - new supervision timeout
+ *
+ * @return  none
+ */
+static void HidDev_paramUpdateCB(uint16_t connInterval,
+                                 uint16_t connSlaveLatency,
+                                 uint16_t connTimeout)
+{
+  // Enqueue the message, GAPROLE_CONN_INTERVAL has the new interval.
+  HidDev_enqueueMsg(HID_PARAM_UPDATE_EVT, 0, NULL);
+}
+
 /*********************************************************************
  * @fn      HidDev_processStateChangeEvt
  *
@@ -1231,6 +1439,8 @@ static void HidDev_disconnected(void)
 
   // Reset state variables.
   hidDevConnSecure = FALSE;
+  hidDevReportQPaused = FALSE;
+  Util_stopClock(&reportResumeClock);
   hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
   hidDevPairingStarted = FALSE;
   hidDevGapBondPairingState = HID_GAPBOND_PAIRING_STATE_NONE;
@@ -1486,6 +1696,27 @@ static hidRptMap_t *HidDev_reportByHandle(uint16_t handle)
   uint8_t i;
   hidRptMap_t *p = pHidDevRptTbl;
 
+  if (hidDevRptHandleIdxValid)
+  {
+    // Handles below the base wrap to a large offset.
+    uint16_t offset = handle - hidDevRptHandleBase;
+
+    if (offset >= HID_DEV_RPT_HANDLE_SPAN)
+    {
+      return NULL;
+    }
+
+    i = hidDevRptHandleIdx[offset];
+    if (i == 0 || (i & HID_DEV_RPT_IDX_CCCD))
+    {
+      return NULL;
+    }
+
+    p = &pHidDevRptTbl[i - 1];
+
+    return (p->mode == hidProtocolMode) ? p : NULL;
+  }
+
   for (i = hidDevRptTblLen; i > 0; i--, p++)
   {
     if (p->handle == handle && p->mode == hidProtocolMode)
@@ -1511,6 +1742,24 @@ static hidRptMap_t *HidDev_reportByCccdHandle(uint16_t handle)
   uint8_t i;
   hidRptMap_t *p = pHidDevRptTbl;
 
+  if (hidDevRptHandleIdxValid)
+  {
+    uint16_t offset = handle - hidDevRptHandleBase;
+
+    if (offset >= HID_DEV_RPT_HANDLE_SPAN)
+    {
+      return NULL;
+    }
+
+    i = hidDevRptHandleIdx[offset];
+    if (!(i & HID_DEV_RPT_IDX_CCCD))
+    {
+      return NULL;
+    }
+
+    return &pHidDevRptTbl[(i & ~HID_DEV_RPT_IDX_CCCD) - 1];
+  }
+
   for (i = hidDevRptTblLen; i > 0; i--, p++)
   {
     if ((p->pCccdAttr != NULL) && (p->pCccdAttr->handle == handle))
@@ -1537,6 +1786,15 @@ static hidRptMap_t *HidDev_reportById(uint8_t id, uint8_t type)
   uint8_t i;
   hidRptMap_t *p = pHidDevRptTbl;
 
+  if (hidDevRptIdIdxValid && id <= HID_DEV_RPT_ID_MAX &&
+      hidProtocolMode <= HID_PROTOCOL_MODE_REPORT &&
+      type >= HID_REPORT_TYPE_INPUT && type <= HID_REPORT_TYPE_FEATURE)
+  {
+    i = hidDevRptIdIdx[hidProtocolMode][type - 1][id];
+
+    return (i != 0) ? &pHidDevRptTbl[i - 1] : NULL;
+  }
+
   for (i = hidDevRptTblLen; i > 0; i--, p++)
   {
     if (p->id == id && p->type == type && p->mode == hidProtocolMode)
@@ -1557,11 +1815,15 @@ static hidRptMap_t *HidDev_reportById(uint8_t id, uint8_t type)
  * @param   type  - HID report type.
  * @param   len   - Length of report.
  * @param   pData - Report data.
+ * @param   time  - Capture time, 0 if not measured.
  *
- * @return  None.
+ * @return  Notification status, SUCCESS if the report is not sent
+ *          because the host has not enabled it.
  */
-static void HidDev_sendReport(uint8_t id, uint8_t type, uint8_t len, uint8_t *pData)
+static uint8_t HidDev_sendReport(uint8_t id, uint8_t type, uint8_t len,
+                                 uint8_t *pData, uint32_t time)
 {
+  uint8_t status = SUCCESS;
   hidRptMap_t *pRpt;
 
   // Get ATT handle for report.
@@ -1585,19 +1847,27 @@ static void HidDev_sendReport(uint8_t id, uint8_t type, uint8_t len, uint8_t *pD
       }
 
       // Send report notification
-      if (HidDev_sendNoti(pRpt->handle, len, pData) == SUCCESS)
+      status = HidDev_sendNoti(pRpt->handle, len, pData);
+      if (status == SUCCESS)
       {
         // Save the report just sent out
         lastReport.id = id;
         lastReport.type = type;
         lastReport.len = len;
         memcpy(lastReport.data, pData, len);
+
+        if (time != 0 && pHidDevCB && pHidDevCB->reportSentCB)
+        {
+          (*pHidDevCB->reportSentCB)(time);
+        }
       }
 
       // Start idle timer.
       HidDev_StartIdleTimer();
     }
   }
+
+  return status;
 }
 
 /*********************************************************************
@@ -1647,29 +1917,36 @@ static uint8_t HidDev_sendNoti(uint16_t handle, uint8_t len, uint8_t *pData)
  * @param   type  - HID report type.
  * @param   len   - Length of report.
  * @param   pData - Report data.
+ * @param   time  - Capture time, 0 if not measured.
  *
  * @return  None.
  */
 static void HidDev_enqueueReport(uint8_t id, uint8_t type, uint8_t len,
-                                 uint8_t *pData)
+                                 uint8_t *pData, uint32_t time)
 {
   // Enqueue only if bonded.
   if (HidDev_bondCount() > 0)
   {
-    // Update last index.
-    lastQIdx = (lastQIdx + 1) % HID_DEV_REPORT_Q_SIZE;
+    UInt key = Task_disable();
 
-    if (lastQIdx == firstQIdx)
+    if (reportQFull())
     {
-      // Queue overflow; discard oldest report.
-      firstQIdx = (firstQIdx + 1) % HID_DEV_REPORT_Q_SIZE;
+      // Queue overflow; make room without losing a key press or release.
+      hidDevReportQStats.overflows++;
+      HidDev_compactReportQ();
     }
 
+    // Update last index.
+    lastQIdx = reportQNext(lastQIdx);
+
     // Save report.
     hidDevReportQ[lastQIdx].id = id;
     hidDevReportQ[lastQIdx].type = type;
     hidDevReportQ[lastQIdx].len = len;
     memcpy(hidDevReportQ[lastQIdx].data, pData, len);
+    hidDevReportQ[lastQIdx].time = time;
+
+    Task_restore(key);
 
     if (hidDevConnSecure)
     {
@@ -1687,24 +1964,318 @@ static void HidDev_enqueueReport(uint8_t id, uint8_t type, uint8_t len,
  *
  * @brief   Dequeue a HID report to be sent out.
  *
- * @param   id    - HID report ID.
- * @param   type  - HID report type.
- * @param   len   - Length of report.
- * @param   pData - Report data.
+ * @param   pReport - Filled with the oldest report.
  *
- * @return  None.
+ * @return  TRUE if a report was dequeued, FALSE if the queue is empty.
  */
-static hidDevReport_t *HidDev_dequeueReport(void)
+static uint8_t HidDev_dequeueReport(hidDevReport_t *pReport)
 {
+  UInt key = Task_disable();
+
   if (reportQEmpty())
   {
-    return NULL;
+    Task_restore(key);
+    return FALSE;
   }
 
   // Update first index.
-  firstQIdx = (firstQIdx + 1) % HID_DEV_REPORT_Q_SIZE;
+  firstQIdx = reportQNext(firstQIdx);
+  *pReport = hidDevReportQ[firstQIdx];
+
+  // Later reports are merged against it until it is sent
+  reportInFlight = *pReport;
+  reportInFlightValid = TRUE;
+
+  Task_restore(key);
+  return TRUE;
+}
+
+/*********************************************************************
+ * @fn      HidDev_requeueReport
+ *
+ * @brief   Put a dequeued report that could not be sent back at the head
+ *          of the queue.
+ *
+ * @param   pReport - Report, as dequeued.
+ *
+ * @return  None.
+ */
+static void HidDev_requeueReport(hidDevReport_t *pReport)
+{
+  UInt key = Task_disable();
+
+  if (reportQFull())
+  {
+    hidDevReportQStats.overflows++;
+    HidDev_compactReportQ();
+  }
+
+  hidDevReportQ[firstQIdx] = *pReport;
+  firstQIdx = reportQPrev(firstQIdx);
+  reportInFlightValid = FALSE;
+
+  Task_restore(key);
+}
+
+/*********************************************************************
+ * @fn      HidDev_sendQueuedReports
+ *
+ * @brief   Send as many queued reports as the stack takes. Sending blocks
+ *          on ICall, the queue may be compacted meanwhile.
+ *
+ * @return  None.
+ */
+static void HidDev_sendQueuedReports(void)
+{
+  hidDevReport_t report;
+
+  while (HidDev_dequeueReport(&report))
+  {
+    // Send report.
+    if (reportFlowControlled(HidDev_sendReport(report.id, report.type,
+                                               report.len, report.data,
+                                               report.time)))
+    {
+      // Out of buffers; keep the report and try again later
+      HidDev_requeueReport(&report);
+      HidDev_pauseReports();
+      break;
+    }
+
+    // Sent or given up, lastReport has the host state again
+    reportInFlightValid = FALSE;
+  }
+}
+
+/*********************************************************************
+ * @fn      HidDev_pauseReports
+ *
+ * @brief   Stop sending reports until the next connection event, by which
+ *          the controller has sent and freed buffers. The number of
+ *          completed packets event does not reach the application, so
+ *          a clock of one connection interval stands in for it. The
+ *          interval is read each time the clock is armed, and the clock
+ *          is armed again when the connection parameters change.
+ *
+ * @return  None.
+ */
+static void HidDev_pauseReports(void)
+{
+  uint16_t interval;
+
+  hidDevReportQPaused = TRUE;
+
+  // One connection interval (1.25 ms units) in ms, rounded up, and a margin
+  GAPRole_GetParameter(GAPROLE_CONN_INTERVAL, &interval);
+  Util_restartClock(&reportResumeClock, (interval * 5 + 3) / 4 + 1);
+}
+
+/*********************************************************************
+ * @fn      HidDev_compactReportQ
+ *
+ * @brief   Free at least one slot in the full report queue. A report
+ *          whose changes the next report of its ID carries as well is
+ *          dropped first. Failing that, the reports of the ID queued
+ *          most are replaced by a release of all keys followed by their
+ *          current state, so no key is left pressed on the host. Only
+ *          when neither frees a slot is the oldest report discarded.
+ *          Called with the scheduler locked.
+ *
+ * @return  None.
+ */
+static void HidDev_compactReportQ(void)
+{
+  if (HidDev_mergeQueuedReport())
+  {
+    hidDevReportQStats.merged++;
+  }
+  else if (HidDev_collapseQueuedReports())
+  {
+    hidDevReportQStats.collapsed++;
+  }
+  else
+  {
+    firstQIdx = reportQNext(firstQIdx);
+    hidDevReportQStats.dropped++;
+  }
+}
+
+/*********************************************************************
+ * @fn      HidDev_mergeQueuedReport
+ *
+ * @brief   Drop the oldest queued report that the application merge
+ *          callback folds into the next report of the same ID and type.
+ *          A report is only considered when the host state before it is
+ *          known, from an earlier queued report, the one being sent, or
+ *          the last one sent.
+ *
+ * @return  TRUE if a report was dropped.
+ */
+static uint8_t HidDev_mergeQueuedReport(void)
+{
+  hidDevReport_t *pPrev;
+  hidDevReport_t *pFirst;
+  hidDevReport_t *pSecond;
+  uint8_t i, j;
+
+  if (pHidDevCB == NULL || pHidDevCB->reportMergeCB == NULL)
+  {
+    return FALSE;
+  }
+
+  for (i = reportQNext(firstQIdx); i != lastQIdx; i = reportQNext(i))
+  {
+    pFirst = &hidDevReportQ[i];
+
+    // State before this report
+    pPrev = NULL;
+    if (reportInFlightValid && reportInFlight.id == pFirst->id &&
+        reportInFlight.type == pFirst->type)
+    {
+      pPrev = &reportInFlight;
+    }
+    else if (lastReport.id == pFirst->id && lastReport.type == pFirst->type)
+    {
+      pPrev = &lastReport;
+    }
+    for (j = reportQNext(firstQIdx); j != i; j = reportQNext(j))
+    {
+      if (hidDevReportQ[j].id == pFirst->id &&
+          hidDevReportQ[j].type == pFirst->type)
+      {
+        pPrev = &hidDevReportQ[j];
+      }
+    }
+
+    // Next report of this ID
+    pSecond = NULL;
+    j = i;
+    do
+    {
+      j = reportQNext(j);
+      if (hidDevReportQ[j].id == pFirst->id &&
+          hidDevReportQ[j].type == pFirst->type)
+      {
+        pSecond = &hidDevReportQ[j];
+        break;
+      }
+    } while (j != lastQIdx);
+
+    if (pPrev == NULL || pSecond == NULL ||
+        pPrev->len != pFirst->len || pSecond->len != pFirst->len)
+    {
+      continue;
+    }
+
+    if ((*pHidDevCB->reportMergeCB)(pFirst->id, pFirst->type, pFirst->len,
+                                    pPrev->data, pFirst->data, pSecond->data))
+    {
+      // The merged report is as late as the oldest change it carries
+      if (pFirst->time != 0)
+      {
+        pSecond->time = pFirst->time;
+      }
+
+      HidDev_removeQueuedReport(i);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/*********************************************************************
+ * @fn      HidDev_collapseQueuedReports
+ *
+ * @brief   Replace the reports of the ID and type queued most by a report
+ *          with everything released, in place of the first of them, and
+ *          the last of them. Taps within these reports are lost, held
+ *          keys are not.
+ *
+ * @return  TRUE if a slot was freed.
+ */
+static uint8_t HidDev_collapseQueuedReports(void)
+{
+  uint8_t first = 0, last;
+  uint8_t count, maxCount = 0;
+  uint8_t i, j;
+
+  // Find the ID and type queued most, by its first report
+  for (i = reportQNext(firstQIdx); i != reportQNext(lastQIdx); i = reportQNext(i))
+  {
+    count = 0;
+    for (j = i; j != reportQNext(lastQIdx); j = reportQNext(j))
+    {
+      if (hidDevReportQ[j].id == hidDevReportQ[i].id &&
+          hidDevReportQ[j].type == hidDevReportQ[i].type)
+      {
+        count++;
+      }
+    }
+
+    if (count > maxCount)
+    {
+      maxCount = count;
+      first = i;
+    }
+  }
+
+  // Two reports are left behind
+  if (maxCount < 3)
+  {
+    return FALSE;
+  }
+
+  // Remove all but the first and last, then release everything in the first
+  last = first;
+  for (i = reportQNext(first); i != reportQNext(lastQIdx); i = reportQNext(i))
+  {
+    if (hidDevReportQ[i].id == hidDevReportQ[first].id &&
+        hidDevReportQ[i].type == hidDevReportQ[first].type)
+    {
+      last = i;
+    }
+  }
+
+  i = reportQNext(first);
+  while (i != last)
+  {
+    if (hidDevReportQ[i].id == hidDevReportQ[first].id &&
+        hidDevReportQ[i].type == hidDevReportQ[first].type)
+    {
+      HidDev_removeQueuedReport(i);
+      last = reportQPrev(last);
+    }
+    else
+    {
+      i = reportQNext(i);
+    }
+  }
+
+  hidDevReportQ[first].len = hidDevReportQ[last].len;
+  memset(hidDevReportQ[first].data, 0x00, hidDevReportQ[first].len);
+  hidDevReportQ[first].time = 0;
+
+  return TRUE;
+}
+
+/*********************************************************************
+ * @fn      HidDev_removeQueuedReport
+ *
+ * @brief   Remove a report from the queue, the reports after it move up.
+ *
+ * @param   idx - Queue index of the report.
+ *
+ * @return  None.
+ */
+static void HidDev_removeQueuedReport(uint8_t idx)
+{
+  for (; idx != lastQIdx; idx = reportQNext(idx))
+  {
+    hidDevReportQ[idx] = hidDevReportQ[reportQNext(idx)];
+  }
 
-  return (&(hidDevReportQ[firstQIdx]));
+  lastQIdx = reportQPrev(lastQIdx);
 }
 
 /*********************************************************************
@@ -1867,7 +2438,7 @@ static uint8_t HidDev_enqueueMsg(uint16_t event, uint8_t state, uint8_t *pData)
   hidDevEvt_t *pMsg;
 
   // Create dynamic pointer to message.
-  if (pMsg = ICall_malloc(sizeof(hidDevEvt_t)))
+  if ((pMsg = ICall_malloc(sizeof(hidDevEvt_t))) != NULL)
   {
     pMsg->hdr.event = event;
     pMsg->hdr.state = state;
@@ -80,6 +80,9 @@ extern "C"
                                           // the HID Dev GAP Bond Manager
                                           // Pairing State. Read Only.
                                           // Size is uint8_t.
+#define HIDDEV_REPORT_Q_STATS       0x03  // Reading this parameter will return
+                                          // the report queue counters. Read
+                                          // Only. Size is hidDevReportQStats_t.
 
 // HID read/write operation
 #define HID_DEV_OPER_WRITE          0  // Write operation
@@ -292,6 +295,15 @@ typedef struct
 
 } hidDevCfg_t;
 
+// HID report queue counters
+typedef struct
+{
+  uint16_t    overflows;        // Reports queued while the queue was full
+  uint16_t    merged;           // Reports folded into the next one, nothing lost
+  uint16_t    collapsed;        // Report IDs reduced to release all and their current state
+  uint16_t    dropped;          // Oldest reports discarded
+} hidDevReportQStats_t;
+
 /*********************************************************************
  * Global Variables
  */
@@ -320,11 +332,27 @@ typedef void (*hidDevPasscodeCB_t)(uint8_t  *deviceAddr,
                                    uint16_t connectionHandle,
                                    uint8_t uiInputs, uint8_t uiOutputs);
 
+// HID report sent callback, called when the stack accepts a notification
+// for a report queued with a non-zero time stamp.
+typedef void (*hidDevReportSentCB_t)(uint32_t time);
+
+// HID report merge callback, used to make room in a full report queue.
+// pFirst and pSecond are consecutive queued reports with the same ID, type
+// and length, pPrev is the report the host has before pFirst. Returns TRUE
+// if pSecond, which may be updated, carries every press and release of
+// both, so that pFirst can be dropped.
+typedef uint8_t (*hidDevReportMergeCB_t)(uint8_t id, uint8_t type, uint8_t len,
+                                         const uint8_t *pPrev,
+                                         const uint8_t *pFirst,
+                                         uint8_t *pSecond);
+
 typedef struct
 {
-  hidDevReportCB_t    reportCB;
-  hidDevEvtCB_t       evtCB;
-  hidDevPasscodeCB_t  passcodeCB;
+  hidDevReportCB_t      reportCB;
+  hidDevEvtCB_t         evtCB;
+  hidDevPasscodeCB_t    passcodeCB;
+  hidDevReportSentCB_t  reportSentCB;
+  hidDevReportMergeCB_t reportMergeCB;
 } hidDevCB_t;
 
 
@@ -391,6 +419,24 @@ extern void HidDev_RegisterReports(uint8_t numReports, hidRptMap_t *pRpt);
 extern void HidDev_Report(uint8_t id, uint8_t type, uint8_t len,
                           uint8_t *pData);
 
+/*********************************************************************
+ * @fn      HidDev_ReportStamped
+ *
+ * @brief   Send a HID report carrying the time its input was captured.
+ *          The time is handed back through reportSentCB once the
+ *          notification is accepted by the stack.
+ *
+ * @param   id    - HID report ID.
+ * @param   type  - HID report type.
+ * @param   len   - Length of report.
+ * @param   pData - Report data.
+ * @param   time  - Capture time, 0 if not measured.
+ *
+ * @return  None.
+ */
+extern void HidDev_ReportStamped(uint8_t id, uint8_t type, uint8_t len,
+                                 uint8_t *pData, uint32_t time);
+
 /*********************************************************************
  * @fn      HidDev_Close
  *
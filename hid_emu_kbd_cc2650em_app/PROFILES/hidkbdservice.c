@@ -151,9 +151,46 @@ static CONST uint8 hidInfo[HID_INFORMATION_LEN] =
 // Keyboard report descriptor (using format for Boot interface descriptor)
 static CONST uint8 hidReportMap[] =
 {
+#ifdef KB_PS2_MOUSE
+  0x05, 0x01,     // Usage Page (Generic Desktop)
+  0x09, 0x02,     // Usage (Mouse)
+  0xA1, 0x01,     // Collection (Application)
+  0x85, HID_RPT_ID_MOUSE_IN,  // Report Id
+  0x09, 0x01,     //   Usage (Pointer)
+  0xA1, 0x00,     //   Collection (Physical)
+                  //
+                  //     Buttons
+  0x05, 0x09,     //     Usage Page (Buttons)
+  0x19, 0x01,     //     Usage Minimum (01) - Button 1
+  0x29, 0x03,     //     Usage Maximum (03) - Button 3
+  0x15, 0x00,     //     Logical Minimum (0)
+  0x25, 0x01,     //     Logical Maximum (1)
+  0x75, 0x01,     //     Report Size (1)
+  0x95, 0x03,     //     Report Count (3)
+  0x81, 0x02,     //     Input (Data, Variable, Absolute) - Button states
+  0x75, 0x05,     //     Report Size (5)
+  0x95, 0x01,     //     Report Count (1)
+  0x81, 0x01,     //     Input (Constant) - Padding or Reserved bits
+                  //
+                  //     Movement
+  0x05, 0x01,     //     Usage Page (Generic Desktop)
+  0x09, 0x30,     //     Usage (X)
+  0x09, 0x31,     //     Usage (Y)
+  0x09, 0x38,     //     Usage (Wheel)
+  0x15, 0x81,     //     Logical Minimum (-127)
+  0x25, 0x7F,     //     Logical Maximum (127)
+  0x75, 0x08,     //     Report Size (8)
+  0x95, 0x03,     //     Report Count (3)
+  0x81, 0x06,     //     Input (Data, Variable, Relative) - X, Y, Wheel
+                  //
+  0xC0,           //   End Collection
+  0xC0,           // End Collection
+                  //
+#endif
   0x05, 0x01,     // Usage Pg (Generic Desktop)
   0x09, 0x06,     // Usage (Keyboard)
   0xA1, 0x01,     // Collection: (Application)
+  0x85, HID_RPT_ID_KEY_IN,  // Report Id
                   //
   0x05, 0x07,     // Usage Pg (Key Codes)
   0x19, 0xE0,     // Usage Min (224)
@@ -166,11 +203,13 @@ static CONST uint8 hidReportMap[] =
   0x95, 0x08,     // Report Count (8)
   0x81, 0x02,     // Input: (Data, Variable, Absolute)
                   //
+#ifndef KB_NKRO
                   // Reserved byte
   0x95, 0x01,     // Report Count (1)
   0x75, 0x08,     // Report Size (8)
   0x81, 0x01,     // Input: (Constant)
                   //
+#endif
                   // LED report
   0x95, 0x05,     // Report Count (5)
   0x75, 0x01,     // Report Size (1)
@@ -184,6 +223,17 @@ static CONST uint8 hidReportMap[] =
   0x75, 0x03,     // Report Size (3)
   0x91, 0x01,     // Output: (Constant)
                   //
+#ifdef KB_NKRO
+                  // Key bitmap (HID_NKRO_KEY_BYTES bytes)
+  0x95, HID_NKRO_USAGE_MAX + 1,  // Report Count
+  0x75, 0x01,     // Report Size (1)
+  0x15, 0x00,     // Log Min (0)
+  0x25, 0x01,     // Log Max (1)
+  0x05, 0x07,     // Usage Pg (Key Codes)
+  0x19, 0x00,     // Usage Min (0)
+  0x29, HID_NKRO_USAGE_MAX,      // Usage Max
+  0x81, 0x02,     // Input: (Data, Variable, Absolute)
+#else
                   // Key arrays (6 bytes)
   0x95, 0x06,     // Report Count (6)
   0x75, 0x08,     // Report Size (8)
@@ -192,6 +242,23 @@ static CONST uint8 hidReportMap[] =
   0x05, 0x07,     // Usage Pg (Key Codes)
   0x19, 0x00,     // Usage Min (0)
   0x29, 0x65,     // Usage Max (101)
+  0x81, 0x00,     // Input: (Data, Array)
+#endif
+                  //
+  0xC0,           // End Collection
+                  //
+  0x05, 0x0C,     // Usage Pg (Consumer Devices)
+  0x09, 0x01,     // Usage (Consumer Control)
+  0xA1, 0x01,     // Collection (Application)
+  0x85, HID_RPT_ID_CC_IN,   // Report Id
+                  //
+                  // One usage, 0 when no key is down
+  0x15, 0x00,     // Log Min (0)
+  0x26, 0xFF, 0x03, // Log Max (1023)
+  0x19, 0x00,     // Usage Min (0)
+  0x2A, 0xFF, 0x03, // Usage Max (1023)
+  0x75, 0x10,     // Report Size (16)
+  0x95, 0x01,     // Report Count (1)
   0x81, 0x00,     // Input: (Data, Array)
                   //
   0xC0            // End Collection
@@ -250,6 +317,26 @@ static uint8 hidReportLedOut;
 static uint8 hidReportRefLedOut[HID_REPORT_REF_LEN] =
              { HID_RPT_ID_LED_OUT, HID_REPORT_TYPE_OUTPUT };
 
+// HID Report characteristic, consumer control input
+static uint8 hidReportCcInProps = GATT_PROP_READ | GATT_PROP_NOTIFY;
+static uint8 hidReportCcIn;
+static gattCharCfg_t *hidReportCcInClientCharCfg;
+
+// HID Report Reference characteristic descriptor, consumer control input
+static uint8 hidReportRefCcIn[HID_REPORT_REF_LEN] =
+             { HID_RPT_ID_CC_IN, HID_REPORT_TYPE_INPUT };
+
+#ifdef KB_PS2_MOUSE
+// HID Report characteristic, mouse input
+static uint8 hidReportMouseInProps = GATT_PROP_READ | GATT_PROP_NOTIFY;
+static uint8 hidReportMouseIn;
+static gattCharCfg_t *hidReportMouseInClientCharCfg;
+
+// HID Report Reference characteristic descriptor, mouse input
+static uint8 hidReportRefMouseIn[HID_REPORT_REF_LEN] =
+             { HID_RPT_ID_MOUSE_IN, HID_REPORT_TYPE_INPUT };
+#endif
+
 // HID Boot Keyboard Input Report
 static uint8 hidReportBootKeyInProps = GATT_PROP_READ | GATT_PROP_NOTIFY;
 static uint8 hidReportBootKeyIn;
@@ -425,6 +512,72 @@ static gattAttribute_t hidAttrTbl[] =
         hidReportRefLedOut
       },
 
+    // HID Report characteristic, consumer control input declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &hidReportCcInProps
+    },
+
+      // HID Report characteristic, consumer control input
+      {
+        { ATT_BT_UUID_SIZE, hidReportUUID },
+        GATT_PERMIT_ENCRYPT_READ,
+        0,
+        &hidReportCcIn
+      },
+
+      // HID Report characteristic client characteristic configuration
+      {
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_ENCRYPT_WRITE,
+        0,
+        (uint8 *) &hidReportCcInClientCharCfg
+      },
+
+      // HID Report Reference characteristic descriptor, consumer control input
+      {
+        { ATT_BT_UUID_SIZE, reportRefUUID },
+        GATT_PERMIT_READ,
+        0,
+        hidReportRefCcIn
+      },
+
+#ifdef KB_PS2_MOUSE
+    // HID Report characteristic, mouse input declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &hidReportMouseInProps
+    },
+
+      // HID Report characteristic, mouse input
+      {
+        { ATT_BT_UUID_SIZE, hidReportUUID },
+        GATT_PERMIT_ENCRYPT_READ,
+        0,
+        &hidReportMouseIn
+      },
+
+      // HID Report characteristic client characteristic configuration
+      {
+        { ATT_BT_UUID_SIZE, clientCharCfgUUID },
+        GATT_PERMIT_READ | GATT_PERMIT_ENCRYPT_WRITE,
+        0,
+        (uint8 *) &hidReportMouseInClientCharCfg
+      },
+
+      // HID Report Reference characteristic descriptor, mouse input
+      {
+        { ATT_BT_UUID_SIZE, reportRefUUID },
+        GATT_PERMIT_READ,
+        0,
+        hidReportRefMouseIn
+      },
+#endif
+
     // HID Boot Keyboard Input Report declaration
     {
       { ATT_BT_UUID_SIZE, characterUUID },
@@ -535,6 +688,16 @@ enum
   HID_REPORT_LED_OUT_DECL_IDX,    // HID Report characteristic, LED output declaration
   HID_REPORT_LED_OUT_IDX,         // HID Report characteristic, LED output
   HID_REPORT_REF_LED_OUT_IDX,     // HID Report Reference characteristic descriptor, LED output
+  HID_REPORT_CC_IN_DECL_IDX,      // HID Report characteristic, consumer control input declaration
+  HID_REPORT_CC_IN_IDX,           // HID Report characteristic, consumer control input
+  HID_REPORT_CC_IN_CCCD_IDX,      // HID Report characteristic client characteristic configuration
+  HID_REPORT_REF_CC_IN_IDX,       // HID Report Reference characteristic descriptor, consumer control input
+#ifdef KB_PS2_MOUSE
+  HID_REPORT_MOUSE_IN_DECL_IDX,   // HID Report characteristic, mouse input declaration
+  HID_REPORT_MOUSE_IN_IDX,        // HID Report characteristic, mouse input
+  HID_REPORT_MOUSE_IN_CCCD_IDX,   // HID Report characteristic client characteristic configuration
+  HID_REPORT_REF_MOUSE_IN_IDX,    // HID Report Reference characteristic descriptor, mouse input
+#endif
   HID_BOOT_KEY_IN_DECL_IDX,       // HID Boot Keyboard Input Report declaration
   HID_BOOT_KEY_IN_IDX,            // HID Boot Keyboard Input Report
   HID_BOOT_KEY_IN_CCCD_IDX,       // HID Boot Keyboard Input Report characteristic client characteristic configuration
@@ -619,11 +782,45 @@ bStatus_t HidKbd_AddService(void)
     return ( bleMemAllocError );
   }
 
+  hidReportCcInClientCharCfg = (gattCharCfg_t *)ICall_malloc(sizeof(gattCharCfg_t) *
+                                                             linkDBNumConns);
+  if (hidReportCcInClientCharCfg == NULL)
+  {
+    ICall_free(hidReportKeyInClientCharCfg);
+
+    ICall_free(hidReportBootKeyInClientCharCfg);
+
+    ICall_free(hidReportBootMouseInClientCharCfg);
+
+    return ( bleMemAllocError );
+  }
+
+#ifdef KB_PS2_MOUSE
+  hidReportMouseInClientCharCfg = (gattCharCfg_t *)ICall_malloc(sizeof(gattCharCfg_t) *
+                                                                linkDBNumConns);
+  if (hidReportMouseInClientCharCfg == NULL)
+  {
+    ICall_free(hidReportKeyInClientCharCfg);
+
+    ICall_free(hidReportBootKeyInClientCharCfg);
+
+    ICall_free(hidReportBootMouseInClientCharCfg);
+
+    ICall_free(hidReportCcInClientCharCfg);
+
+    return ( bleMemAllocError );
+  }
+#endif
+
   // Initialize Client Characteristic Configuration attributes
   GATTServApp_InitCharCfg(INVALID_CONNHANDLE, hidReportKeyInClientCharCfg);
   GATTServApp_InitCharCfg(INVALID_CONNHANDLE, hidReportBootKeyInClientCharCfg);
   GATTServApp_InitCharCfg(INVALID_CONNHANDLE,
                           hidReportBootMouseInClientCharCfg);
+  GATTServApp_InitCharCfg(INVALID_CONNHANDLE, hidReportCcInClientCharCfg);
+#ifdef KB_PS2_MOUSE
+  GATTServApp_InitCharCfg(INVALID_CONNHANDLE, hidReportMouseInClientCharCfg);
+#endif
 
   // Register GATT attribute list and CBs with GATT Server App
   status = GATTServApp_RegisterService(hidAttrTbl, GATT_NUM_ATTRS(hidAttrTbl),
@@ -683,6 +880,23 @@ bStatus_t HidKbd_AddService(void)
   // Battery level input report
   VOID Batt_GetParameter(BATT_PARAM_BATT_LEVEL_IN_REPORT, &(hidRptMap[6]));
 
+  // Consumer control input report, none in boot mode
+  hidRptMap[7].id = hidReportRefCcIn[0];
+  hidRptMap[7].type = hidReportRefCcIn[1];
+  hidRptMap[7].handle = hidAttrTbl[HID_REPORT_CC_IN_IDX].handle;
+  hidRptMap[7].pCccdAttr = &hidAttrTbl[HID_REPORT_CC_IN_CCCD_IDX];
+  hidRptMap[7].mode = HID_PROTOCOL_MODE_REPORT;
+
+#ifdef KB_PS2_MOUSE
+  // Mouse input report
+  // Same ID and type as boot mouse input report, in report mode
+  hidRptMap[8].id = hidReportRefMouseIn[0];
+  hidRptMap[8].type = hidReportRefMouseIn[1];
+  hidRptMap[8].handle = hidAttrTbl[HID_REPORT_MOUSE_IN_IDX].handle;
+  hidRptMap[8].pCccdAttr = &hidAttrTbl[HID_REPORT_MOUSE_IN_CCCD_IDX];
+  hidRptMap[8].mode = HID_PROTOCOL_MODE_REPORT;
+#endif
+
   // Setup report ID map
   HidDev_RegisterReports(HID_NUM_REPORTS, hidRptMap);
 
@@ -61,14 +61,27 @@ extern "C"
  */
 
 // Number of HID reports defined in the service
-#define HID_NUM_REPORTS          7
+#ifdef KB_PS2_MOUSE
+#define HID_NUM_REPORTS          9
+#else
+#define HID_NUM_REPORTS          8
+#endif
 
-// HID Report IDs for the service
-#define HID_RPT_ID_KEY_IN        0  // Keyboard input report ID
+// HID Report IDs for the service. The report map holds more than one
+// collection, so every report in it carries an ID.
+#define HID_RPT_ID_KEY_IN        2  // Keyboard input report ID
 #define HID_RPT_ID_MOUSE_IN      1  // Mouse input report ID
-#define HID_RPT_ID_LED_OUT       0  // LED output report ID
+#define HID_RPT_ID_LED_OUT       2  // LED output report ID
+#define HID_RPT_ID_CC_IN         3  // Consumer control input report ID
 #define HID_RPT_ID_FEATURE       0  // Feature report ID
 
+#ifdef KB_NKRO
+// N-key rollover keyboard input report: modifier byte, then one bit per key
+// usage from 0 to HID_NKRO_USAGE_MAX
+#define HID_NKRO_USAGE_MAX       0x8F
+#define HID_NKRO_KEY_BYTES       ((HID_NKRO_USAGE_MAX + 1) / 8)
+#endif
+
 // HID feature flags
 #define HID_KBD_FLAGS             HID_FLAGS_REMOTE_WAKE
 
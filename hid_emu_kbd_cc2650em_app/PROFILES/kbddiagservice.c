@@ -0,0 +1,240 @@
+/******************************************************************************
+
+ @file  kbddiagservice.c
+
+ @brief This file contains the Keyboard Diagnostics Service.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include "bcomdef.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gattservapp.h"
+#include "kbddiagservice.h"
+
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Keyboard diagnostics service
+CONST uint8 kbdDiagServUUID[ATT_UUID_SIZE] =
+{
+  KBD_DIAG_UUID_128(KBD_DIAG_SERV_UUID)
+};
+
+// Statistics characteristic
+CONST uint8 kbdDiagStatsUUID[ATT_UUID_SIZE] =
+{
+  KBD_DIAG_UUID_128(KBD_DIAG_STATS_UUID)
+};
+
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+/*********************************************************************
+ * EXTERNAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+// Application callback
+static kbdDiagStatsCB_t kbdDiagStatsCB = NULL;
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+
+// Keyboard Diagnostics Service attribute
+static CONST gattAttrType_t kbdDiagService = { ATT_UUID_SIZE, kbdDiagServUUID };
+
+// Statistics characteristic, value is supplied by the callback on read
+static uint8 kbdDiagStatsProps = GATT_PROP_READ;
+static uint8 kbdDiagStats = 0;
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+
+static gattAttribute_t kbdDiagAttrTbl[] =
+{
+  // Keyboard Diagnostics Service attribute
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&kbdDiagService                  /* pValue */
+  },
+
+    // Statistics declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &kbdDiagStatsProps
+    },
+
+      // Statistics characteristic
+      {
+        { ATT_UUID_SIZE, kbdDiagStatsUUID },
+        GATT_PERMIT_ENCRYPT_READ,
+        0,
+        &kbdDiagStats
+      }
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t kbdDiagReadAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                   uint8_t *pValue, uint16_t *pLen,
+                                   uint16_t offset, uint16_t maxLen,
+                                   uint8_t method);
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+
+// Service Callbacks
+CONST gattServiceCBs_t kbdDiagCBs =
+{
+  kbdDiagReadAttrCB,  // Read callback function pointer
+  NULL,               // Write callback function pointer
+  NULL                // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      KbdDiag_AddService
+ *
+ * @brief   Initializes the Keyboard Diagnostics Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t KbdDiag_AddService(void)
+{
+  // Register GATT attribute list and CBs with GATT Server App
+  return GATTServApp_RegisterService(kbdDiagAttrTbl,
+                                     GATT_NUM_ATTRS(kbdDiagAttrTbl),
+                                     GATT_MAX_ENCRYPT_KEY_SIZE,
+                                     &kbdDiagCBs);
+}
+
+/*********************************************************************
+ * @fn      KbdDiag_Register
+ *
+ * @brief   Register the statistics read callback with the Keyboard
+ *          Diagnostics Service.
+ *
+ * @param   pfnStatsCB - Callback function.
+ *
+ * @return  None.
+ */
+void KbdDiag_Register(kbdDiagStatsCB_t pfnStatsCB)
+{
+  kbdDiagStatsCB = pfnStatsCB;
+}
+
+/*********************************************************************
+ * @fn          kbdDiagReadAttrCB
+ *
+ * @brief       GATT read callback. The statistics are longer than one
+ *              ATT_MTU, so blob reads are supported.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t kbdDiagReadAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                   uint8_t *pValue, uint16_t *pLen,
+                                   uint16_t offset, uint16_t maxLen,
+                                   uint8_t method)
+{
+  uint8 *pStats;
+  uint16 statsLen;
+
+  if (pAttr->pValue != &kbdDiagStats || kbdDiagStatsCB == NULL)
+  {
+    return (ATT_ERR_ATTR_NOT_FOUND);
+  }
+
+  pStats = (*kbdDiagStatsCB)(&statsLen);
+
+  if (offset > statsLen)
+  {
+    return (ATT_ERR_INVALID_OFFSET);
+  }
+
+  *pLen = MIN(maxLen, statsLen - offset);
+  memcpy(pValue, pStats + offset, *pLen);
+
+  return (SUCCESS);
+}
+
+
+/*********************************************************************
+*********************************************************************/
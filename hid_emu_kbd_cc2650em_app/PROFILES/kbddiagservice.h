@@ -0,0 +1,120 @@
+/******************************************************************************
+
+ @file  kbddiagservice.h
+
+ @brief This file contains the Keyboard Diagnostics Service definitions
+        and prototypes.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+#ifndef KBDDIAGSERVICE_H
+#define KBDDIAGSERVICE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Keyboard Diagnostics Service UUIDs, 16 bit values within the vendor
+// specific base 0000XXXX-4B42-4447-9A1F-6E0C2D9B8A51
+#define KBD_DIAG_SERV_UUID                0xD1A0
+#define KBD_DIAG_STATS_UUID               0xD1A1
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+// Expand a 16 bit value into the 128 bit vendor specific UUID
+#define KBD_DIAG_UUID_128(uuid)   0x51, 0x8A, 0x9B, 0x2D, 0x0C, 0x6E, 0x1F, 0x9A, \
+                                  0x47, 0x44, 0x42, 0x4B, LO_UINT16(uuid),    \
+                                  HI_UINT16(uuid), 0x00, 0x00
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+// Statistics read callback, returns the current statistics and sets their
+// length
+typedef uint8 *(*kbdDiagStatsCB_t)(uint16 *pLen);
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      KbdDiag_AddService
+ *
+ * @brief   Initializes the Keyboard Diagnostics Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+extern bStatus_t KbdDiag_AddService(void);
+
+/*********************************************************************
+ * @fn      KbdDiag_Register
+ *
+ * @brief   Register the statistics read callback with the Keyboard
+ *          Diagnostics Service.
+ *
+ * @param   pfnStatsCB - Callback function.
+ *
+ * @return  None.
+ */
+extern void KbdDiag_Register(kbdDiagStatsCB_t pfnStatsCB);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KBDDIAGSERVICE_H */
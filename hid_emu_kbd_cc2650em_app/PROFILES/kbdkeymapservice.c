@@ -0,0 +1,277 @@
+/******************************************************************************
+
+ @file  kbdkeymapservice.c
+
+ @brief This file contains the Keyboard Keymap Service.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include "bcomdef.h"
+#include "att.h"
+#include "gatt.h"
+#include "gatt_uuid.h"
+#include "gattservapp.h"
+#include "kbdkeymapservice.h"
+
+
+/*********************************************************************
+ * MACROS
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+// Keyboard keymap service
+CONST uint8 kbdKeymapServUUID[ATT_UUID_SIZE] =
+{
+  KBD_KEYMAP_UUID_128(KBD_KEYMAP_SERV_UUID)
+};
+
+// Keymap characteristic
+CONST uint8 kbdKeymapUUID[ATT_UUID_SIZE] =
+{
+  KBD_KEYMAP_UUID_128(KBD_KEYMAP_UUID)
+};
+
+/*********************************************************************
+ * EXTERNAL VARIABLES
+ */
+
+/*********************************************************************
+ * EXTERNAL FUNCTIONS
+ */
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+
+// Application callbacks
+static kbdKeymapCBs_t *kbdKeymapAppCBs = NULL;
+
+/*********************************************************************
+ * Profile Attributes - variables
+ */
+
+// Keyboard Keymap Service attribute
+static CONST gattAttrType_t kbdKeymapService = { ATT_UUID_SIZE, kbdKeymapServUUID };
+
+// Keymap characteristic, value is handled by the callbacks
+static uint8 kbdKeymapProps = GATT_PROP_READ | GATT_PROP_WRITE;
+static uint8 kbdKeymap = 0;
+
+/*********************************************************************
+ * Profile Attributes - Table
+ */
+
+static gattAttribute_t kbdKeymapAttrTbl[] =
+{
+  // Keyboard Keymap Service attribute
+  {
+    { ATT_BT_UUID_SIZE, primaryServiceUUID }, /* type */
+    GATT_PERMIT_READ,                         /* permissions */
+    0,                                        /* handle */
+    (uint8 *)&kbdKeymapService                /* pValue */
+  },
+
+    // Keymap declaration
+    {
+      { ATT_BT_UUID_SIZE, characterUUID },
+      GATT_PERMIT_READ,
+      0,
+      &kbdKeymapProps
+    },
+
+      // Keymap characteristic
+      {
+        { ATT_UUID_SIZE, kbdKeymapUUID },
+        GATT_PERMIT_ENCRYPT_READ | GATT_PERMIT_ENCRYPT_WRITE,
+        0,
+        &kbdKeymap
+      }
+};
+
+/*********************************************************************
+ * LOCAL FUNCTIONS
+ */
+static bStatus_t kbdKeymapReadAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                     uint8_t *pValue, uint16_t *pLen,
+                                     uint16_t offset, uint16_t maxLen,
+                                     uint8_t method);
+static bStatus_t kbdKeymapWriteAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                      uint8_t *pValue, uint16_t len,
+                                      uint16_t offset, uint8_t method);
+
+/*********************************************************************
+ * PROFILE CALLBACKS
+ */
+
+// Service Callbacks
+CONST gattServiceCBs_t kbdKeymapCBs =
+{
+  kbdKeymapReadAttrCB,  // Read callback function pointer
+  kbdKeymapWriteAttrCB, // Write callback function pointer
+  NULL                  // Authorization callback function pointer
+};
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      KbdKeymap_AddService
+ *
+ * @brief   Initializes the Keyboard Keymap Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+bStatus_t KbdKeymap_AddService(void)
+{
+  // Register GATT attribute list and CBs with GATT Server App
+  return GATTServApp_RegisterService(kbdKeymapAttrTbl,
+                                     GATT_NUM_ATTRS(kbdKeymapAttrTbl),
+                                     GATT_MAX_ENCRYPT_KEY_SIZE,
+                                     &kbdKeymapCBs);
+}
+
+/*********************************************************************
+ * @fn      KbdKeymap_Register
+ *
+ * @brief   Register the application callbacks with the Keyboard Keymap
+ *          Service.
+ *
+ * @param   pCBs - Callback functions.
+ *
+ * @return  None.
+ */
+void KbdKeymap_Register(kbdKeymapCBs_t *pCBs)
+{
+  kbdKeymapAppCBs = pCBs;
+}
+
+/*********************************************************************
+ * @fn          kbdKeymapReadAttrCB
+ *
+ * @brief       GATT read callback. The configuration can be longer than
+ *              one ATT_MTU, so blob reads are supported.
+ *
+ * @param       connHandle - connection message was received on
+ * @param       pAttr - pointer to attribute
+ * @param       pValue - pointer to data to be read
+ * @param       pLen - length of data to be read
+ * @param       offset - offset of the first octet to be read
+ * @param       maxLen - maximum length of data to be read
+ * @param       method - type of read message
+ *
+ * @return      SUCCESS, blePending or Failure
+ */
+static bStatus_t kbdKeymapReadAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                     uint8_t *pValue, uint16_t *pLen,
+                                     uint16_t offset, uint16_t maxLen,
+                                     uint8_t method)
+{
+  uint8 *pKeymap;
+  uint16 keymapLen;
+
+  if (pAttr->pValue != &kbdKeymap || kbdKeymapAppCBs == NULL ||
+      kbdKeymapAppCBs->pfnReadCB == NULL)
+  {
+    return (ATT_ERR_ATTR_NOT_FOUND);
+  }
+
+  pKeymap = (*kbdKeymapAppCBs->pfnReadCB)(&keymapLen);
+
+  if (offset > keymapLen)
+  {
+    return (ATT_ERR_INVALID_OFFSET);
+  }
+
+  *pLen = MIN(maxLen, keymapLen - offset);
+  memcpy(pValue, pKeymap + offset, *pLen);
+
+  return (SUCCESS);
+}
+
+/*********************************************************************
+ * @fn      kbdKeymapWriteAttrCB
+ *
+ * @brief   GATT write callback. Each write is one command, so long
+ *          writes are not supported.
+ *
+ * @param   connHandle - connection message was received on
+ * @param   pAttr - pointer to attribute
+ * @param   pValue - pointer to data to be written
+ * @param   len - length of data
+ * @param   offset - offset of the first octet to be written
+ * @param   method - type of write message
+ *
+ * @return  SUCCESS, blePending or Failure
+ */
+static bStatus_t kbdKeymapWriteAttrCB(uint16_t connHandle, gattAttribute_t *pAttr,
+                                      uint8_t *pValue, uint16_t len,
+                                      uint16_t offset, uint8_t method)
+{
+  if (pAttr->pValue != &kbdKeymap || kbdKeymapAppCBs == NULL ||
+      kbdKeymapAppCBs->pfnWriteCB == NULL)
+  {
+    return (ATT_ERR_ATTR_NOT_FOUND);
+  }
+
+  if (offset != 0)
+  {
+    return (ATT_ERR_ATTR_NOT_LONG);
+  }
+
+  return (*kbdKeymapAppCBs->pfnWriteCB)(pValue, len);
+}
+
+
+/*********************************************************************
+*********************************************************************/
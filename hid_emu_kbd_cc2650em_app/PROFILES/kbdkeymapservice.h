@@ -0,0 +1,138 @@
+/******************************************************************************
+
+ @file  kbdkeymapservice.h
+
+ @brief This file contains the Keyboard Keymap Service definitions and
+        prototypes.
+
+ Group: WCS, BTS
+ Target Device: CC2650, CC2640, CC1350
+
+ ******************************************************************************
+ 
+ Copyright (c) 2016, Texas Instruments Incorporated
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+
+ *  Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+
+ *  Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+ *  Neither the name of Texas Instruments Incorporated nor the names of
+    its contributors may be used to endorse or promote products derived
+    from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ *****************************************************************************/
+
+#ifndef KBDKEYMAPSERVICE_H
+#define KBDKEYMAPSERVICE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*********************************************************************
+ * INCLUDES
+ */
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Keyboard Keymap Service UUIDs, 16 bit values within the same vendor
+// specific base as the Keyboard Diagnostics Service
+#define KBD_KEYMAP_SERV_UUID              0xD1B0
+#define KBD_KEYMAP_UUID                   0xD1B1
+
+// Keymap characteristic writes:
+// - 1 byte, KBD_KEYMAP_CMD_CLEAR: remove all entries
+// - 4 bytes, layer, usage, action LSB, action MSB: configure one key
+// Reads return the result of the last change (SUCCESS, bleNoResources when
+// all entries are in use, or the error storing it), a reserved byte, then
+// the whole configuration.
+#define KBD_KEYMAP_CMD_CLEAR              0x00
+#define KBD_KEYMAP_ENTRY_LEN              4
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+/*********************************************************************
+ * MACROS
+ */
+
+// Expand a 16 bit value into the 128 bit vendor specific UUID
+#define KBD_KEYMAP_UUID_128(uuid) 0x51, 0x8A, 0x9B, 0x2D, 0x0C, 0x6E, 0x1F, 0x9A, \
+                                  0x47, 0x44, 0x42, 0x4B, LO_UINT16(uuid),    \
+                                  HI_UINT16(uuid), 0x00, 0x00
+
+/*********************************************************************
+ * Profile Callbacks
+ */
+
+// Keymap read callback, returns the configuration and sets its length
+typedef uint8 *(*kbdKeymapReadCB_t)(uint16 *pLen);
+
+// Keymap write callback, called from the stack task. Returns SUCCESS or
+// an ATT error code.
+typedef bStatus_t (*kbdKeymapWriteCB_t)(uint8 *pValue, uint16 len);
+
+typedef struct
+{
+  kbdKeymapReadCB_t   pfnReadCB;    // Called when the keymap is read
+  kbdKeymapWriteCB_t  pfnWriteCB;   // Called when the keymap is written
+} kbdKeymapCBs_t;
+
+/*********************************************************************
+ * API FUNCTIONS
+ */
+
+/*********************************************************************
+ * @fn      KbdKeymap_AddService
+ *
+ * @brief   Initializes the Keyboard Keymap Service by registering
+ *          GATT attributes with the GATT server.
+ *
+ * @return  Success or Failure
+ */
+extern bStatus_t KbdKeymap_AddService(void);
+
+/*********************************************************************
+ * @fn      KbdKeymap_Register
+ *
+ * @brief   Register the application callbacks with the Keyboard Keymap
+ *          Service.
+ *
+ * @param   pCBs - Callback functions.
+ *
+ * @return  None.
+ */
+extern void KbdKeymap_Register(kbdKeymapCBs_t *pCBs);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KBDKEYMAPSERVICE_H */
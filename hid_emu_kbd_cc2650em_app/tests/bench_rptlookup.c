@@ -0,0 +1,236 @@
+/******************************************************************************
+
+ @file  bench_rptlookup.c
+
+ @brief Report table lookups of HidDev with and without the ID and handle
+        indexes. Checks that both paths find the same report as a plain
+        table scan, including a table too long to index, then times them.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hiddev.c"
+
+// Fits both indexes: 7 IDs of each type in both modes, 56 handles
+#define RPTLOOKUP_SMALL         (HID_DEV_RPT_ID_MAX * HID_REPORT_TYPE_FEATURE * 2)
+// Too many reports to index
+#define RPTLOOKUP_LARGE         160
+#define RPTLOOKUP_HANDLE_BASE   0x20
+#define RPTLOOKUP_ROUNDS        200000
+
+static hidRptMap_t rptMap[RPTLOOKUP_LARGE];
+static gattAttribute_t cccAttr[RPTLOOKUP_LARGE];
+static uint8_t numRpts;
+static uint16_t maxHandle;
+
+static volatile uintptr_t sink;
+
+// Reports cycle through the IDs, then the types, then the modes. Input
+// reports get a CCC handle right after their own.
+static void buildMap(uint8_t num)
+{
+  uint16_t handle = RPTLOOKUP_HANDLE_BASE;
+  uint8_t i;
+
+  for (i = 0; i < num; i++)
+  {
+    hidRptMap_t *p = &rptMap[i];
+
+    p->id = i % HID_DEV_RPT_ID_MAX + 1;
+    p->type = (i / HID_DEV_RPT_ID_MAX) % HID_REPORT_TYPE_FEATURE + 1;
+    p->mode = (i / (HID_DEV_RPT_ID_MAX * HID_REPORT_TYPE_FEATURE)) % 2;
+    p->handle = handle++;
+    p->pCccdAttr = NULL;
+
+    if (p->type == HID_REPORT_TYPE_INPUT)
+    {
+      cccAttr[i].handle = handle++;
+      p->pCccdAttr = &cccAttr[i];
+    }
+  }
+
+  numRpts = num;
+  maxHandle = handle;
+  HidDev_RegisterReports(num, rptMap);
+}
+
+/*********************************************************************
+ * REFERENCE
+ */
+
+static hidRptMap_t *refById(uint8_t id, uint8_t type)
+{
+  uint8_t i;
+
+  for (i = 0; i < numRpts; i++)
+  {
+    if (rptMap[i].id == id && rptMap[i].type == type && rptMap[i].mode == hidProtocolMode)
+    {
+      return &rptMap[i];
+    }
+  }
+
+  return NULL;
+}
+
+static hidRptMap_t *refByHandle(uint16_t handle)
+{
+  uint8_t i;
+
+  for (i = 0; i < numRpts; i++)
+  {
+    if (rptMap[i].handle == handle && rptMap[i].mode == hidProtocolMode)
+    {
+      return &rptMap[i];
+    }
+  }
+
+  return NULL;
+}
+
+static hidRptMap_t *refByCccdHandle(uint16_t handle)
+{
+  uint8_t i;
+
+  for (i = 0; i < numRpts; i++)
+  {
+    if (rptMap[i].pCccdAttr != NULL && rptMap[i].pCccdAttr->handle == handle)
+    {
+      return &rptMap[i];
+    }
+  }
+
+  return NULL;
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+// Every ID (one past the index too), type and handle, in both modes
+static int checkLookups(const char *name)
+{
+  uint8_t mode, type;
+  uint16_t id, handle;
+
+  for (mode = HID_PROTOCOL_MODE_BOOT; mode <= HID_PROTOCOL_MODE_REPORT; mode++)
+  {
+    hidProtocolMode = mode;
+
+    for (type = HID_REPORT_TYPE_INPUT; type <= HID_REPORT_TYPE_FEATURE; type++)
+    {
+      for (id = 0; id <= HID_DEV_RPT_ID_MAX + 1; id++)
+      {
+        if (HidDev_reportById(id, type) != refById(id, type))
+        {
+          printf("FAIL %s: mode %u type %u ID %u\n", name, mode, type, id);
+          return 1;
+        }
+      }
+    }
+
+    for (handle = 0; handle <= maxHandle + 1; handle++)
+    {
+      if (HidDev_reportByHandle(handle) != refByHandle(handle) ||
+          HidDev_reportByCccdHandle(handle) != refByCccdHandle(handle))
+      {
+        printf("FAIL %s: mode %u handle 0x%04X\n", name, mode, handle);
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// ns per lookup for the IDs and handles in use, as reports are sent and
+// written by the host
+static void timeLookups(double *pById, double *pByHandle)
+{
+  uint32_t round;
+  uint8_t i;
+  double start;
+
+  hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
+
+  start = now();
+  for (round = 0; round < RPTLOOKUP_ROUNDS; round++)
+  {
+    for (i = 1; i <= HID_DEV_RPT_ID_MAX; i++)
+    {
+      sink += (uintptr_t)HidDev_reportById(i, HID_REPORT_TYPE_INPUT);
+    }
+  }
+  *pById = (now() - start) / (RPTLOOKUP_ROUNDS * HID_DEV_RPT_ID_MAX);
+
+  start = now();
+  for (round = 0; round < RPTLOOKUP_ROUNDS; round++)
+  {
+    for (i = 0; i < HID_DEV_RPT_ID_MAX; i++)
+    {
+      sink += (uintptr_t)HidDev_reportByHandle(maxHandle - 1 - 2 * i);
+    }
+  }
+  *pByHandle = (now() - start) / (RPTLOOKUP_ROUNDS * HID_DEV_RPT_ID_MAX);
+}
+
+static int benchmark(const char *name, uint8_t num)
+{
+  double idxId, idxHandle, scanId, scanHandle;
+
+  buildMap(num);
+  if (checkLookups(name))
+  {
+    return 1;
+  }
+  timeLookups(&idxId, &idxHandle);
+
+  // Same table through the scan
+  hidDevRptIdIdxValid = FALSE;
+  hidDevRptHandleIdxValid = FALSE;
+  if (checkLookups(name))
+  {
+    return 1;
+  }
+  timeLookups(&scanId, &scanHandle);
+
+  printf("%s (%u reports): by ID %.2f ns, by handle %.2f ns; scan %.2f / %.2f ns\n",
+         name, num, idxId, idxHandle, scanId, scanHandle);
+  return 0;
+}
+
+int main(void)
+{
+  buildMap(RPTLOOKUP_SMALL);
+  if (!hidDevRptIdIdxValid || !hidDevRptHandleIdxValid)
+  {
+    printf("FAIL %u reports are not indexed\n", RPTLOOKUP_SMALL);
+    return EXIT_FAILURE;
+  }
+
+  buildMap(RPTLOOKUP_LARGE);
+  if (hidDevRptIdIdxValid || hidDevRptHandleIdxValid)
+  {
+    printf("FAIL %u reports are indexed\n", RPTLOOKUP_LARGE);
+    return EXIT_FAILURE;
+  }
+
+  if (benchmark("indexed", RPTLOOKUP_SMALL) || benchmark("too long", RPTLOOKUP_LARGE))
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+
+ @file  app.c
+
+ @brief Host implementations of the stand-ins declared in app.h. Reports
+        are kept rather than sent; the keyboard driver only keeps the
+        callbacks it is given.
+
+ *****************************************************************************/
+
+#include "app.h"
+#include "hiddev.h"
+#include "hidkbdservice.h"
+#include "LED.h"
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+
+hostReport_t hostReports[HOST_REPORTS];
+unsigned hostNumReports = 0;
+
+keysPressedCB_t hostKeyCB = NULL;
+keysBatchCB_t hostBatchCB = NULL;
+
+/*********************************************************************
+ * KEYBOARD
+ */
+
+void Keyboard_init(keysPressedCB_t appKeyCB)
+{
+  hostKeyCB = appKeyCB;
+}
+
+void Keyboard_registerBatchCB(keysBatchCB_t appBatchCB)
+{
+  hostBatchCB = appBatchCB;
+}
+
+void Keyboard_changeLedState(uint8_t state)
+{
+}
+
+void LED_init()
+{
+}
+
+/*********************************************************************
+ * HID
+ */
+
+void HidDev_Register(hidDevCfg_t *pCfg, hidDevCB_t *pCBs)
+{
+}
+
+void HidDev_StartDevice(void)
+{
+}
+
+void HidDev_ReportStamped(uint8_t id, uint8_t type, uint8_t len,
+                          uint8_t *pData, uint32_t time)
+{
+  hostReport_t *p;
+
+  if (hostNumReports == HOST_REPORTS || len > HOST_REPORT_LEN)
+  {
+    System_abort("report not kept");
+    return;
+  }
+
+  p = &hostReports[hostNumReports++];
+  p->id = id;
+  p->len = len;
+  memcpy(p->data, pData, len);
+  p->time = time;
+}
+
+void HidDev_Report(uint8_t id, uint8_t type, uint8_t len, uint8_t *pData)
+{
+  HidDev_ReportStamped(id, type, len, pData, 0);
+}
+
+const hostReport_t *hostLastReport(uint8_t id)
+{
+  unsigned n = hostNumReports;
+
+  while (n-- > 0)
+  {
+    if (hostReports[n].id == id)
+    {
+      return &hostReports[n];
+    }
+  }
+
+  return NULL;
+}
+
+bStatus_t HidKbd_AddService(void)
+{
+  return SUCCESS;
+}
+
+uint8 HidKbd_SetParameter(uint8 id, uint8 type, uint16 uuid, uint8 len,
+                          void *pValue)
+{
+  return SUCCESS;
+}
+
+uint8 HidKbd_GetParameter(uint8 id, uint8 type, uint16 uuid, uint8 *pLen,
+                          void *pValue)
+{
+  return SUCCESS;
+}
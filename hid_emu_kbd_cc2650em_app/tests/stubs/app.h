@@ -0,0 +1,43 @@
+/******************************************************************************
+
+ @file  app.h
+
+ @brief Host stand-ins for the modules the application task calls into:
+        the keyboard driver, the LEDs, HidDev and the HID keyboard service.
+        Used by the tests that build hidemukbd.c.
+
+ *****************************************************************************/
+
+#ifndef APP_H
+#define APP_H
+
+#include "ble.h"
+#include "Keyboard.h"
+
+/*********************************************************************
+ * HOST CONTROL
+ */
+
+// Reports handed to HidDev, the newest last
+#define HOST_REPORTS            256
+#define HOST_REPORT_LEN         32
+
+typedef struct
+{
+  uint8_t id;
+  uint8_t len;
+  uint8_t data[HOST_REPORT_LEN];
+  uint32_t time;
+} hostReport_t;
+
+extern hostReport_t hostReports[HOST_REPORTS];
+extern unsigned hostNumReports;
+
+// Callbacks given to the keyboard driver
+extern keysPressedCB_t hostKeyCB;
+extern keysBatchCB_t hostBatchCB;
+
+// Newest report of an ID, NULL if none was sent
+const hostReport_t *hostLastReport(uint8_t id);
+
+#endif /* APP_H */
@@ -0,0 +1,299 @@
+/******************************************************************************
+
+ @file  ble.c
+
+ @brief Host implementations of the stand-ins declared in ble.h, and of the
+        GAP role and service modules the profile code calls into. The
+        device is always bonded, connected and has notifications enabled.
+
+ *****************************************************************************/
+
+#include <stdlib.h>
+
+#include "ble.h"
+#include "util.h"
+#include "peripheral.h"
+#include "battservice.h"
+#include "devinfoservice.h"
+#include "scanparamservice.h"
+#include "hiddev.h"
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+
+bStatus_t (*hostNotificationCB)(uint16 handle, uint8 *pValue, uint16 len) = NULL;
+
+uint16 hostConnInterval = 6;
+
+gapRolesParamUpdateCB_t *hostParamUpdateCB = NULL;
+
+hostSnvItem_t hostSnv[HOST_SNV_ITEMS];
+
+// Defined by the HID service
+uint8_t hidReportMapLen = 0;
+uint8_t hidProtocolMode = HID_PROTOCOL_MODE_REPORT;
+
+/*********************************************************************
+ * GATT
+ */
+
+uint8 *GATT_bm_alloc(uint16 connHandle, uint8 opcode, uint16 size, uint16 *pSizeAlloc)
+{
+  return malloc(size);
+}
+
+void GATT_bm_free(gattMsg_t *pMsg, uint8 opcode)
+{
+  if (opcode == ATT_HANDLE_VALUE_NOTI)
+  {
+    free(pMsg->handleValueNoti.pValue);
+  }
+}
+
+bStatus_t GATT_Notification(uint16 connHandle, attHandleValueNoti_t *pNoti, uint8 authenticated)
+{
+  bStatus_t status = SUCCESS;
+
+  if (hostNotificationCB != NULL)
+  {
+    status = (*hostNotificationCB)(pNoti->handle, pNoti->pValue, pNoti->len);
+  }
+
+  // The stack frees the value it takes
+  if (status == SUCCESS)
+  {
+    free(pNoti->pValue);
+  }
+
+  return status;
+}
+
+uint16 GATTServApp_ReadCharCfg(uint16 connHandle, gattCharCfg_t *charCfgTbl)
+{
+  return GATT_CLIENT_CFG_NOTIFY;
+}
+
+bStatus_t GATTServApp_ProcessCCCWriteReq(uint16 connHandle, gattAttribute_t *pAttr,
+                                         uint8 *pValue, uint16 len, uint16 offset,
+                                         uint16 validCfg)
+{
+  return SUCCESS;
+}
+
+bStatus_t GATTServApp_AddService(uint32 services)
+{
+  return SUCCESS;
+}
+
+bStatus_t GGS_AddService(uint32 services)
+{
+  return SUCCESS;
+}
+
+bStatus_t GGS_SetParameter(uint8 param, uint8 len, void *value)
+{
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * GAP
+ */
+
+bStatus_t GAP_SetParamValue(uint16 paramID, uint16 paramValue)
+{
+  return SUCCESS;
+}
+
+bStatus_t GAPRole_SetParameter(uint16_t param, uint8_t len, void *pValue)
+{
+  return SUCCESS;
+}
+
+bStatus_t GAPRole_GetParameter(uint16_t param, void *pValue)
+{
+  switch (param)
+  {
+    case GAPROLE_CONN_INTERVAL:
+      *(uint16_t *)pValue = hostConnInterval;
+      break;
+
+    case GAPROLE_STATE:
+      *(uint8_t *)pValue = GAPROLE_CONNECTED;
+      break;
+
+    default:
+      break;
+  }
+
+  return SUCCESS;
+}
+
+bStatus_t GAPRole_StartDevice(gapRolesCBs_t *pAppCallbacks)
+{
+  return SUCCESS;
+}
+
+void GAPRole_RegisterAppCBs(gapRolesParamUpdateCB_t *pParamUpdateCB)
+{
+  hostParamUpdateCB = pParamUpdateCB;
+}
+
+bStatus_t GAPRole_TerminateConnection(void)
+{
+  return SUCCESS;
+}
+
+bStatus_t GAPBondMgr_SetParameter(uint16 param, uint8 len, void *pValue)
+{
+  return SUCCESS;
+}
+
+bStatus_t GAPBondMgr_GetParameter(uint16 param, void *pValue)
+{
+  if (param == GAPBOND_BOND_COUNT)
+  {
+    *(uint8 *)pValue = 1;
+  }
+
+  return SUCCESS;
+}
+
+bStatus_t GAPBondMgr_Register(gapBondCBs_t *pCB)
+{
+  return SUCCESS;
+}
+
+bStatus_t GAPBondMgr_PasscodeRsp(uint16 connectionHandle, uint8 status, uint32 passcode)
+{
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * HCI
+ */
+
+hciStatus_t HCI_EXT_ConnEventNoticeCmd(uint16 connHandle, uint8 taskID, uint16 taskEvent)
+{
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * SERVICES
+ */
+
+bStatus_t Batt_AddService(void)
+{
+  return SUCCESS;
+}
+
+void Batt_Register(battServiceCB_t pfnServiceCB)
+{
+}
+
+bStatus_t Batt_MeasLevel(void)
+{
+  return SUCCESS;
+}
+
+bStatus_t Batt_SetParameter(uint8 param, uint8 len, void *value)
+{
+  return SUCCESS;
+}
+
+bStatus_t DevInfo_AddService(void)
+{
+  return SUCCESS;
+}
+
+bStatus_t ScanParam_AddService(void)
+{
+  return SUCCESS;
+}
+
+void ScanParam_Register(scanParamServiceCB_t pfnServiceCB)
+{
+}
+
+void ScanParam_RefreshNotify(uint16 connHandle)
+{
+}
+
+/*********************************************************************
+ * SNV
+ */
+
+uint8 osal_snv_read(uint8 id, uint8 len, void *pBuf)
+{
+  if (hostSnv[id].len < len)
+  {
+    return FAILURE;
+  }
+
+  memcpy(pBuf, hostSnv[id].data, len);
+  return SUCCESS;
+}
+
+uint8 osal_snv_write(uint8 id, uint8 len, void *pBuf)
+{
+  memcpy(hostSnv[id].data, pBuf, len);
+  hostSnv[id].len = len;
+  return SUCCESS;
+}
+
+/*********************************************************************
+ * ICALL
+ */
+
+ICall_Errno ICall_registerApp(ICall_EntityID *pEntity, ICall_Semaphore *pMsgSem)
+{
+  return ICALL_ERRNO_SUCCESS;
+}
+
+ICall_Errno ICall_wait(uint32_t milliseconds)
+{
+  return ICALL_ERRNO_SUCCESS;
+}
+
+ICall_Errno ICall_fetchServiceMsg(ICall_ServiceEnum *pSrc, ICall_EntityID *pDest, void **pMsg)
+{
+  return -1;
+}
+
+void *ICall_malloc(uint_t size)
+{
+  return malloc(size);
+}
+
+void ICall_free(void *pMsg)
+{
+  free(pMsg);
+}
+
+void ICall_freeMsg(void *pMsg)
+{
+  free(pMsg);
+}
+
+/*********************************************************************
+ * UTIL QUEUE
+ */
+
+Queue_Handle Util_constructQueue(Queue_Struct *pQueue)
+{
+  Queue_construct(pQueue, NULL);
+
+  return Queue_handle(pQueue);
+}
+
+uint8_t Util_enqueueMsg(Queue_Handle msgQueue, Semaphore_Handle sem, uint8_t *pMsg)
+{
+  ICall_free(pMsg);
+
+  return FALSE;
+}
+
+uint8_t *Util_dequeueMsg(Queue_Handle msgQueue)
+{
+  return NULL;
+}
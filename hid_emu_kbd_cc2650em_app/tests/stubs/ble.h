@@ -0,0 +1,270 @@
+/******************************************************************************
+
+ @file  ble.h
+
+ @brief Host stand-ins for the BLE stack, GATT server and ICall
+        declarations used by the profile modules under test. Stack calls
+        are recorded or answered by tests/stubs/ble.c.
+
+ *****************************************************************************/
+
+#ifndef BLE_H
+#define BLE_H
+
+#include "host.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+#define SUCCESS                         0x00
+#define FAILURE                         0x01
+#define INVALIDPARAMETER                0x02
+#define MSG_BUFFER_NOT_AVAIL            0x0C
+#define bleMemAllocError                0x13
+#define bleNotConnected                 0x14
+#define blePending                      0x17
+#define bleInvalidRange                 0x18
+#define bleNoResources                  0x1A
+#define bleAlreadyInRequestedMode       0x11
+
+#define B_ADDR_LEN                      6
+#define INVALID_CONNHANDLE              0xFFFF
+#define KEYLEN                          16
+
+#define ATT_BT_UUID_SIZE                2
+#define ATT_UUID_SIZE                   16
+#define ATT_HANDLE_VALUE_NOTI           0x1B
+
+#define ATT_ERR_INVALID_HANDLE          0x01
+#define ATT_ERR_INVALID_OFFSET          0x07
+#define ATT_ERR_ATTR_NOT_FOUND          0x0A
+#define ATT_ERR_ATTR_NOT_LONG           0x0B
+#define ATT_ERR_INVALID_VALUE_SIZE      0x0D
+#define ATT_ERR_UNLIKELY                0x0E
+#define ATT_ERR_INSUFFICIENT_RESOURCES  0x11
+#define ATT_ERR_INVALID_VALUE           0x80
+
+#define GATT_CLIENT_CFG_NOTIFY          0x0001
+#define GATT_CFG_NO_OPERATION           0x0000
+#define GATT_ALL_SERVICES               0xFFFFFFFF
+#define GATT_MSG_EVENT                  0xB0
+
+#define GATT_PERMIT_READ                0x01
+#define GATT_PERMIT_WRITE               0x02
+#define GATT_PERMIT_ENCRYPT_READ        0x04
+#define GATT_PERMIT_ENCRYPT_WRITE       0x40
+#define GATT_PROP_READ                  0x02
+#define GATT_PROP_WRITE_NO_RSP          0x04
+#define GATT_PROP_WRITE                 0x08
+#define GATT_PROP_NOTIFY                0x10
+
+#define GAPBOND_PAIRING_MODE            0x400
+#define GAPBOND_MITM_PROTECTION         0x402
+#define GAPBOND_IO_CAPABILITIES         0x403
+#define GAPBOND_BONDING_ENABLED         0x406
+#define GAPBOND_ERASE_ALLBONDS          0x410
+#define GAPBOND_BOND_COUNT              0x40B
+#define GAPBOND_AUTO_SYNC_WL            0x40C
+
+#define GAPBOND_PAIRING_MODE_INITIATE   0x02
+#define GAPBOND_IO_CAP_NO_INPUT_NO_OUTPUT 0x03
+#define GAPBOND_DEFAULT_PASSCODE        0x408
+
+#define GAPBOND_PAIRING_STATE_STARTED   0x00
+#define GAPBOND_PAIRING_STATE_COMPLETE  0x01
+#define GAPBOND_PAIRING_STATE_BONDED    0x02
+
+#define SMP_PAIRING_FAILED_CONFIRM_VALUE 0x04
+
+#define ICALL_TIMEOUT_FOREVER           0xFFFFFFFF
+#define ICALL_ERRNO_SUCCESS             0
+#define ICALL_SERVICE_CLASS_BLE         0x0010
+
+#define BLE_NVID_CUST_START             0x80
+
+#define GAP_DEVICE_NAME_LEN             21
+#define GAP_APPEARE_HID_KEYBOARD        0x03C1
+#define GAP_ADTYPE_FLAGS                0x01
+#define GAP_ADTYPE_16BIT_MORE           0x02
+#define GAP_ADTYPE_LOCAL_NAME_COMPLETE  0x09
+#define GAP_ADTYPE_APPEARANCE           0x19
+#define GAP_ADTYPE_FLAGS_LIMITED        0x01
+#define GAP_ADTYPE_FLAGS_BREDR_NOT_SUPPORTED 0x04
+#define GGS_DEVICE_NAME_ATT             0
+
+#define TGAP_LIM_DISC_ADV_INT_MIN       6
+#define TGAP_LIM_DISC_ADV_INT_MAX       7
+#define TGAP_LIM_ADV_TIMEOUT            0
+#define TGAP_CONN_PAUSE_PERIPHERAL      30
+#define GAP_FILTER_POLICY_ALL           0x00
+#define GAP_FILTER_POLICY_WHITE         0x03
+
+#define LO_UINT16(a)                    ((a) & 0xFF)
+#define HI_UINT16(a)                    (((a) >> 8) & 0xFF)
+#define BUILD_UINT16(loByte, hiByte)    ((uint16)(((loByte) & 0xFF) + (((hiByte) & 0xFF) << 8)))
+#ifndef MIN
+#define MIN(n, m)                       (((n) < (m)) ? (n) : (m))
+#endif
+#ifndef MAX
+#define MAX(n, m)                       (((n) < (m)) ? (m) : (n))
+#endif
+
+#define GATT_NUM_ATTRS(attrs)           (sizeof(attrs) / sizeof(attrs[0]))
+#define GATT_CCC_TBL(pValue)            ((gattCharCfg_t *)(*((gattCharCfg_t **)(pValue))))
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+
+typedef uint8_t hciStatus_t;
+
+typedef struct
+{
+  uint8 len;
+  const uint8 *uuid;
+} gattAttrType_t;
+
+typedef struct
+{
+  gattAttrType_t type;
+  uint8 permissions;
+  uint16 handle;
+  uint8 *pValue;
+} gattAttribute_t;
+
+typedef struct
+{
+  uint16 connHandle;
+  uint8 value;
+} gattCharCfg_t;
+
+typedef struct
+{
+  uint16 handle;
+  uint16 len;
+  uint8 *pValue;
+} attHandleValueNoti_t;
+
+typedef union
+{
+  attHandleValueNoti_t handleValueNoti;
+} gattMsg_t;
+
+typedef struct
+{
+  uint8 event;
+  uint8 status;
+} ICall_Hdr;
+
+typedef struct
+{
+  ICall_Hdr hdr;
+  uint16 connHandle;
+  uint8 method;
+  gattMsg_t msg;
+} gattMsgEvent_t;
+
+typedef struct
+{
+  ICall_Hdr hdr;
+} ICall_HciExtEvt;
+
+typedef struct
+{
+  uint16 signature;
+  uint32 event_flag;
+} ICall_Stack_Event;
+
+typedef uint8_t ICall_EntityID;
+typedef void *ICall_Semaphore;
+typedef int ICall_Errno;
+typedef int ICall_ServiceEnum;
+
+typedef void (*pfnPasscodeCB_t)(uint8 *deviceAddr, uint16 connectionHandle,
+                                uint8 uiInputs, uint8 uiOutputs);
+typedef void (*pfnPairStateCB_t)(uint16 connectionHandle, uint8 state,
+                                 uint8 status);
+
+typedef struct
+{
+  pfnPasscodeCB_t passcodeCB;
+  pfnPairStateCB_t pairStateCB;
+} gapBondCBs_t;
+
+/*********************************************************************
+ * FUNCTIONS
+ */
+
+// GATT
+uint8 *GATT_bm_alloc(uint16 connHandle, uint8 opcode, uint16 size, uint16 *pSizeAlloc);
+void GATT_bm_free(gattMsg_t *pMsg, uint8 opcode);
+bStatus_t GATT_Notification(uint16 connHandle, attHandleValueNoti_t *pNoti, uint8 authenticated);
+bStatus_t GATT_InitClient(void);
+bStatus_t GATT_RegisterForInd(uint8 taskId);
+
+// GATT server application
+uint16 GATTServApp_ReadCharCfg(uint16 connHandle, gattCharCfg_t *charCfgTbl);
+bStatus_t GATTServApp_InitCharCfg(uint16 connHandle, gattCharCfg_t *charCfgTbl);
+bStatus_t GATTServApp_RegisterService(gattAttribute_t *pAttrs, uint16 numAttrs,
+                                      uint8 encKeySize, const void *pServiceCBs);
+bStatus_t GATTServApp_ProcessCCCWriteReq(uint16 connHandle, gattAttribute_t *pAttr,
+                                         uint8 *pValue, uint16 len, uint16 offset,
+                                         uint16 validCfg);
+void GATTServApp_SendServiceChangedInd(uint16 connHandle, uint8 taskId);
+bStatus_t GGS_AddService(uint32 services);
+bStatus_t GGS_SetParameter(uint8 param, uint8 len, void *value);
+bStatus_t GATTServApp_AddService(uint32 services);
+
+// GAP
+bStatus_t GAP_SetParamValue(uint16 paramID, uint16 paramValue);
+
+// Bond manager
+bStatus_t GAPBondMgr_SetParameter(uint16 param, uint8 len, void *pValue);
+bStatus_t GAPBondMgr_GetParameter(uint16 param, void *pValue);
+bStatus_t GAPBondMgr_Register(gapBondCBs_t *pCB);
+bStatus_t GAPBondMgr_PasscodeRsp(uint16 connectionHandle, uint8 status, uint32 passcode);
+
+// HCI
+hciStatus_t HCI_EXT_ConnEventNoticeCmd(uint16 connHandle, uint8 taskID, uint16 taskEvent);
+
+// SNV
+uint8 osal_snv_read(uint8 id, uint8 len, void *pBuf);
+uint8 osal_snv_write(uint8 id, uint8 len, void *pBuf);
+
+// ICall
+ICall_Errno ICall_registerApp(ICall_EntityID *pEntity, ICall_Semaphore *pMsgSem);
+ICall_Errno ICall_wait(uint32_t milliseconds);
+ICall_Errno ICall_fetchServiceMsg(ICall_ServiceEnum *pSrc, ICall_EntityID *pDest, void **pMsg);
+ICall_Errno ICall_signal(ICall_Semaphore msgSem);
+void *ICall_malloc(uint_t size);
+void ICall_free(void *pMsg);
+void ICall_freeMsg(void *pMsg);
+
+/*********************************************************************
+ * HOST CONTROL
+ */
+
+// Called for each notification the code sends, the stack takes the value
+// on SUCCESS. Without it every notification succeeds.
+extern bStatus_t (*hostNotificationCB)(uint16 handle, uint8 *pValue, uint16 len);
+
+// Connection interval read as GAPROLE_CONN_INTERVAL, in 1.25 ms units
+extern uint16 hostConnInterval;
+
+// Set by GAPRole_RegisterAppCBs
+extern void (**hostParamUpdateCB)(uint16_t connInterval, uint16_t connSlaveLatency,
+                                  uint16_t connTimeout);
+
+// SNV items by id, empty ones have length 0
+#define HOST_SNV_ITEMS                  256
+
+typedef struct
+{
+  uint8 len;
+  uint8 data[255];
+} hostSnvItem_t;
+
+extern hostSnvItem_t hostSnv[HOST_SNV_ITEMS];
+
+#endif /* BLE_H */
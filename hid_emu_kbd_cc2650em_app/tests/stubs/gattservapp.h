@@ -0,0 +1 @@
+#include "ble.h"
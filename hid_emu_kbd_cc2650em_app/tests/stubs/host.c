@@ -0,0 +1,403 @@
+/******************************************************************************
+
+ @file  host.c
+
+ @brief Host implementations of the stand-ins declared in host.h.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "host.h"
+#include "util.h"
+#include "LED.h"
+
+/*********************************************************************
+ * GLOBAL VARIABLES
+ */
+
+uint32_t Clock_tickPeriod = 10;
+
+hostPin_t hostPins[HOST_PINS];
+unsigned hostAborts = 0;
+unsigned hostSemaphorePosts = 0;
+uint32_t hostTicks = 0;
+uint8_t hostUartData[HOST_UART_SIZE];
+size_t hostUartLen = 0;
+
+/*********************************************************************
+ * CLOCK
+ */
+
+void Clock_start(Clock_Handle handle)
+{
+  handle->active = true;
+}
+
+void Clock_stop(Clock_Handle handle)
+{
+  handle->active = false;
+}
+
+bool Clock_isActive(Clock_Handle handle)
+{
+  return handle->active;
+}
+
+uint32_t Clock_getTicks(void)
+{
+  return hostTicks;
+}
+
+Clock_Handle Util_constructClock(Clock_Struct *pClock, Clock_FuncPtr clockCB,
+                                 uint32_t clockDuration, uint32_t clockPeriod,
+                                 uint8_t startFlag, UArg arg)
+{
+  pClock->fxn = clockCB;
+  pClock->arg = arg;
+  pClock->timeout = clockDuration;
+  pClock->active = startFlag;
+
+  return pClock;
+}
+
+void Util_startClock(Clock_Struct *pClock)
+{
+  pClock->active = true;
+}
+
+void Util_restartClock(Clock_Struct *pClock, uint32_t clockTimeout)
+{
+  pClock->timeout = clockTimeout;
+  pClock->active = true;
+}
+
+void Util_restartClockMicro(Clock_Struct *pClock, uint32_t clockTimeout)
+{
+  pClock->timeout = clockTimeout;
+  pClock->active = true;
+}
+
+bool Util_isActive(Clock_Struct *pClock)
+{
+  return pClock->active;
+}
+
+void Util_stopClock(Clock_Struct *pClock)
+{
+  pClock->active = false;
+}
+
+bool hostClockFire(Clock_Struct *pClock)
+{
+  if (!pClock->active)
+  {
+    return false;
+  }
+
+  pClock->active = false;
+  pClock->fxn(pClock->arg);
+
+  return true;
+}
+
+/*********************************************************************
+ * TASK, SEMAPHORE, SWI, HWI, QUEUE
+ */
+
+void Task_Params_init(Task_Params *params)
+{
+  memset(params, 0, sizeof(*params));
+}
+
+void Task_construct(Task_Struct *task, Task_FuncPtr fxn, Task_Params *params,
+                    void *eb)
+{
+  // Tests call the task body's steps themselves
+}
+
+void Task_sleep(uint32_t ticks)
+{
+}
+
+UInt Task_disable(void)
+{
+  return 0;
+}
+
+void Task_restore(UInt key)
+{
+}
+
+void Semaphore_Params_init(Semaphore_Params *params)
+{
+  memset(params, 0, sizeof(*params));
+}
+
+void Semaphore_construct(Semaphore_Struct *sem, int count,
+                         Semaphore_Params *params)
+{
+  sem->count = count;
+}
+
+bool Semaphore_pend(Semaphore_Handle sem, uint32_t timeout)
+{
+  return true;
+}
+
+void Semaphore_post(Semaphore_Handle sem)
+{
+  hostSemaphorePosts++;
+}
+
+UInt Hwi_disable(void)
+{
+  return 0;
+}
+
+void Hwi_restore(UInt key)
+{
+}
+
+void Queue_construct(Queue_Struct *queue, void *params)
+{
+  queue->head = NULL;
+}
+
+bool Queue_empty(Queue_Handle queue)
+{
+  return true;
+}
+
+/*********************************************************************
+ * SYSTEM
+ */
+
+void System_abort(const char *str)
+{
+  // The target halts here, tests count it and go on
+  hostAborts++;
+}
+
+void System_printf(const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+int System_snprintf(char *buf, size_t n, const char *fmt, ...)
+{
+  va_list args;
+  int len;
+
+  va_start(args, fmt);
+  len = vsnprintf(buf, n, fmt, args);
+  va_end(args);
+
+  return len;
+}
+
+void CPUdelay(uint32_t cycles)
+{
+}
+
+void LED_changeState(PIN_Id pinId, uint8_t state)
+{
+}
+
+/*********************************************************************
+ * PIN
+ */
+
+PIN_Handle PIN_open(PIN_State *state, const PIN_Config *pinList)
+{
+  state->intCb = NULL;
+
+  for (; PIN_ID(*pinList) != PIN_TERMINATE; pinList++)
+  {
+    hostPin_t *pin = &hostPins[PIN_ID(*pinList)];
+
+    pin->handle = state;
+    pin->outputEn = (*pinList & PIN_GPIO_OUTPUT_EN) != 0;
+    pin->outputVal = (*pinList & PIN_GPIO_HIGH) != 0;
+    pin->inputEn = (*pinList & PIN_INPUT_DIS) == 0;
+    pin->irq = *pinList & PIN_BM_IRQ;
+    pin->deviceLevel = 1;
+  }
+
+  return state;
+}
+
+void PIN_close(PIN_Handle handle)
+{
+}
+
+PIN_Status PIN_setConfig(PIN_Handle handle, uint32_t bmMask, PIN_Config pinCfg)
+{
+  hostPin_t *pin = &hostPins[PIN_ID(pinCfg)];
+
+  if (bmMask & PIN_BM_IRQ)
+  {
+    pin->irq = pinCfg & PIN_BM_IRQ;
+  }
+  if (bmMask & PIN_BM_INPUT_EN)
+  {
+    pin->inputEn = (pinCfg & PIN_INPUT_DIS) == 0;
+  }
+  if (bmMask & PIN_BM_GPIO_OUTPUT_EN)
+  {
+    pin->outputEn = (pinCfg & PIN_GPIO_OUTPUT_EN) != 0;
+  }
+
+  return PIN_SUCCESS;
+}
+
+PIN_Status PIN_registerIntCb(PIN_Handle handle, PIN_IntCb cb)
+{
+  handle->intCb = cb;
+
+  return PIN_SUCCESS;
+}
+
+void PINCC26XX_setOutputValue(PIN_Id pinId, uint32_t val)
+{
+  hostPins[pinId].outputVal = val;
+}
+
+uint32_t PINCC26XX_getInputValue(PIN_Id pinId)
+{
+  return hostLineLevel(pinId);
+}
+
+void PINCC26XX_clrPendInterrupt(PIN_Id pinId)
+{
+}
+
+bool hostDriving(PIN_Id pinId)
+{
+  return hostPins[pinId].outputEn;
+}
+
+uint32_t hostLineLevel(PIN_Id pinId)
+{
+  hostPin_t *pin = &hostPins[pinId];
+
+  if (pin->outputEn && pin->outputVal == 0)
+  {
+    return 0;
+  }
+
+  return pin->deviceLevel;
+}
+
+void hostDeviceClock(PIN_Id clkPin, uint32_t level)
+{
+  hostPin_t *pin = &hostPins[clkPin];
+  uint32_t before = hostLineLevel(clkPin);
+  uint32_t after;
+
+  pin->deviceLevel = level;
+  after = hostLineLevel(clkPin);
+
+  if (before == after || pin->handle == NULL || pin->handle->intCb == NULL)
+  {
+    return;
+  }
+
+  if ((after == 0 && (pin->irq & PIN_IRQ_NEGEDGE)) ||
+      (after == 1 && (pin->irq & PIN_IRQ_POSEDGE)))
+  {
+    pin->handle->intCb(pin->handle, clkPin);
+  }
+}
+
+/*********************************************************************
+ * GPTIMER
+ */
+
+#define HOST_TIMERS             4
+
+static struct GPTimerCC26XX_Object_s hostTimers[HOST_TIMERS];
+
+void GPTimerCC26XX_Params_init(GPTimerCC26XX_Params *params)
+{
+  memset(params, 0, sizeof(*params));
+}
+
+GPTimerCC26XX_Handle GPTimerCC26XX_open(unsigned int index,
+                                        const GPTimerCC26XX_Params *params)
+{
+  return (index < HOST_TIMERS) ? &hostTimers[index] : NULL;
+}
+
+void GPTimerCC26XX_setLoadValue(GPTimerCC26XX_Handle handle,
+                                GPTimerCC26XX_Value loadValue)
+{
+  handle->loadValue = loadValue;
+}
+
+void GPTimerCC26XX_registerInterrupt(GPTimerCC26XX_Handle handle,
+                                     GPTimerCC26XX_HwiFxn callback,
+                                     GPTimerCC26XX_IntMask intMask)
+{
+  handle->fxn = callback;
+}
+
+void GPTimerCC26XX_start(GPTimerCC26XX_Handle handle)
+{
+  handle->active = true;
+}
+
+void GPTimerCC26XX_stop(GPTimerCC26XX_Handle handle)
+{
+  handle->active = false;
+}
+
+bool hostTimerFire(GPTimerCC26XX_Handle handle)
+{
+  if (!handle->active)
+  {
+    return false;
+  }
+
+  handle->active = false;
+  handle->fxn(handle, GPT_INT_TIMEOUT);
+
+  return true;
+}
+
+/*********************************************************************
+ * UART
+ */
+
+void UART_Params_init(UART_Params *params)
+{
+  memset(params, 0, sizeof(*params));
+}
+
+UART_Handle UART_open(unsigned int index, UART_Params *params)
+{
+  return (UART_Handle)&hostUartData;
+}
+
+int UART_write(UART_Handle handle, const void *buf, size_t size)
+{
+  if (size > HOST_UART_SIZE - hostUartLen)
+  {
+    size = HOST_UART_SIZE - hostUartLen;
+  }
+
+  memcpy(&hostUartData[hostUartLen], buf, size);
+  hostUartLen += size;
+
+  return size;
+}
+
+int UART_read(UART_Handle handle, void *buf, size_t size)
+{
+  return 0;
+}
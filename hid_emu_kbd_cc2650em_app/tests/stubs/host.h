@@ -0,0 +1,315 @@
+/******************************************************************************
+
+ @file  host.h
+
+ @brief Host stand-ins for the TI-RTOS, driver and board declarations used
+        by the application modules under test. Only what the tests reach is
+        modeled: clocks run when a test fires them, pins keep the levels the
+        code and the simulated device drive.
+
+ *****************************************************************************/
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/*********************************************************************
+ * TYPES
+ */
+
+typedef uintptr_t UArg;
+typedef char Char;
+typedef int Int;
+typedef unsigned int UInt;
+typedef unsigned int uint_t;
+typedef bool Bool;
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef uint8_t bStatus_t;
+typedef uint8_t status_t;
+
+#define TRUE                    1
+#define FALSE                   0
+#define CONST                   const
+#define VOID                    (void)
+
+#define BIOS_WAIT_FOREVER       (~0u)
+#define BIOS_NO_WAIT            0
+
+/*********************************************************************
+ * CLOCK
+ */
+
+typedef void (*Clock_FuncPtr)(UArg arg);
+
+typedef struct
+{
+  Clock_FuncPtr fxn;
+  UArg arg;
+  uint32_t timeout;
+  bool active;
+} Clock_Struct;
+
+typedef Clock_Struct *Clock_Handle;
+
+#define Clock_handle(pClock)    (pClock)
+
+extern uint32_t Clock_tickPeriod;
+
+void Clock_start(Clock_Handle handle);
+void Clock_stop(Clock_Handle handle);
+bool Clock_isActive(Clock_Handle handle);
+uint32_t Clock_getTicks(void);
+
+/*********************************************************************
+ * TASK, SEMAPHORE, SWI, HWI, QUEUE
+ */
+
+typedef void (*Task_FuncPtr)(UArg a0, UArg a1);
+typedef void (*Swi_FuncPtr)(UArg a0, UArg a1);
+
+typedef struct { int unused; } Task_Struct;
+typedef struct { int unused; } Hwi_Struct;
+typedef struct { int unused; } Queue_Elem;
+typedef struct { int count; } Semaphore_Struct;
+typedef struct { Swi_FuncPtr fxn; int posted; } Swi_Struct;
+typedef struct { Queue_Elem *head; } Queue_Struct;
+
+typedef Semaphore_Struct *Semaphore_Handle;
+typedef Swi_Struct *Swi_Handle;
+typedef Queue_Struct *Queue_Handle;
+
+typedef struct { void *stack; size_t stackSize; int priority; UArg arg0; UArg arg1; } Task_Params;
+typedef struct { int mode; } Semaphore_Params;
+typedef struct { UArg arg0; UArg arg1; int priority; } Swi_Params;
+
+#define Semaphore_Mode_COUNTING 0
+#define Semaphore_Mode_BINARY   1
+
+#define Semaphore_handle(pSem)  (pSem)
+#define Swi_handle(pSwi)        (pSwi)
+#define Queue_handle(pQueue)    (pQueue)
+
+void Task_Params_init(Task_Params *params);
+void Task_construct(Task_Struct *task, Task_FuncPtr fxn, Task_Params *params, void *eb);
+void Task_sleep(uint32_t ticks);
+UInt Task_disable(void);
+void Task_restore(UInt key);
+
+void Semaphore_Params_init(Semaphore_Params *params);
+void Semaphore_construct(Semaphore_Struct *sem, int count, Semaphore_Params *params);
+bool Semaphore_pend(Semaphore_Handle sem, uint32_t timeout);
+void Semaphore_post(Semaphore_Handle sem);
+
+void Swi_Params_init(Swi_Params *params);
+void Swi_construct(Swi_Struct *swi, Swi_FuncPtr fxn, Swi_Params *params, void *eb);
+void Swi_post(Swi_Handle swi);
+
+UInt Hwi_disable(void);
+void Hwi_restore(UInt key);
+
+void Queue_construct(Queue_Struct *queue, void *params);
+bool Queue_empty(Queue_Handle queue);
+
+/*********************************************************************
+ * SYSTEM
+ */
+
+void System_abort(const char *str);
+void System_printf(const char *fmt, ...);
+int System_snprintf(char *buf, size_t n, const char *fmt, ...);
+void CPUdelay(uint32_t cycles);
+
+/*********************************************************************
+ * PIN
+ */
+
+typedef uint32_t PIN_Config;
+typedef uint32_t PIN_Id;
+typedef int PIN_Status;
+typedef struct PIN_State_s PIN_State;
+typedef PIN_State *PIN_Handle;
+typedef void (*PIN_IntCb)(PIN_Handle handle, PIN_Id pinId);
+
+struct PIN_State_s
+{
+  PIN_IntCb intCb;
+};
+
+#define PIN_ID(cfg)             ((cfg) & 0xFF)
+#define PIN_TERMINATE           0xFE
+#define PIN_UNASSIGNED          0xFF
+
+#define PIN_GPIO_OUTPUT_DIS     0
+#define PIN_GPIO_OUTPUT_EN      (1 << 23)
+#define PIN_GPIO_LOW            0
+#define PIN_GPIO_HIGH           (1 << 22)
+#define PIN_INPUT_EN            0
+#define PIN_INPUT_DIS           (1 << 29)
+#define PIN_NOPULL              0
+#define PIN_PULLUP              (1 << 13)
+#define PIN_PUSHPULL            0
+#define PIN_OPENDRAIN           (1 << 14)
+#define PIN_IRQ_DIS             0
+#define PIN_IRQ_NEGEDGE         (1 << 16)
+#define PIN_IRQ_POSEDGE         (2 << 16)
+#define PIN_IRQ_BOTHEDGES       (3 << 16)
+
+#define PIN_BM_INPUT_EN         PIN_INPUT_DIS
+#define PIN_BM_GPIO_OUTPUT_EN   PIN_GPIO_OUTPUT_EN
+#define PIN_BM_IRQ              (7 << 16)
+
+#define PIN_SUCCESS             0
+
+PIN_Handle PIN_open(PIN_State *state, const PIN_Config *pinList);
+void PIN_close(PIN_Handle handle);
+PIN_Status PIN_setConfig(PIN_Handle handle, uint32_t bmMask, PIN_Config pinCfg);
+PIN_Status PIN_registerIntCb(PIN_Handle handle, PIN_IntCb cb);
+void PINCC26XX_setOutputValue(PIN_Id pinId, uint32_t val);
+uint32_t PINCC26XX_getInputValue(PIN_Id pinId);
+void PINCC26XX_clrPendInterrupt(PIN_Id pinId);
+
+#define PINCC26XX_DIO13         13
+#define PINCC26XX_DIO14         14
+#define PINCC26XX_DIO15         15
+#define PINCC26XX_DIO21         21
+#define PINCC26XX_DIO22         22
+
+#define Board_LED0              6
+#define Board_LED1              7
+#define Board_UART              0
+#define Board_SPI1              1
+#define Board_GPTIMER0A         0
+#define Board_GPTIMER1A         2
+
+/*********************************************************************
+ * GPTIMER
+ */
+
+typedef struct GPTimerCC26XX_Object_s *GPTimerCC26XX_Handle;
+typedef uint32_t GPTimerCC26XX_IntMask;
+typedef uint32_t GPTimerCC26XX_Value;
+typedef void (*GPTimerCC26XX_HwiFxn)(GPTimerCC26XX_Handle handle,
+                                     GPTimerCC26XX_IntMask interruptMask);
+
+struct GPTimerCC26XX_Object_s
+{
+  GPTimerCC26XX_HwiFxn fxn;
+  GPTimerCC26XX_Value loadValue;
+  bool active;
+};
+
+typedef struct
+{
+  int width;
+  int mode;
+  int debugStallMode;
+} GPTimerCC26XX_Params;
+
+#define GPT_CONFIG_16BIT        0
+#define GPT_MODE_ONESHOT_UP     1
+#define GPTimerCC26XX_DEBUG_STALL_OFF 0
+#define GPT_INT_TIMEOUT         1
+
+void GPTimerCC26XX_Params_init(GPTimerCC26XX_Params *params);
+GPTimerCC26XX_Handle GPTimerCC26XX_open(unsigned int index,
+                                        const GPTimerCC26XX_Params *params);
+void GPTimerCC26XX_setLoadValue(GPTimerCC26XX_Handle handle,
+                                GPTimerCC26XX_Value loadValue);
+void GPTimerCC26XX_registerInterrupt(GPTimerCC26XX_Handle handle,
+                                     GPTimerCC26XX_HwiFxn callback,
+                                     GPTimerCC26XX_IntMask intMask);
+void GPTimerCC26XX_start(GPTimerCC26XX_Handle handle);
+void GPTimerCC26XX_stop(GPTimerCC26XX_Handle handle);
+
+/*********************************************************************
+ * UART
+ */
+
+typedef struct UART_Config_s *UART_Handle;
+typedef void (*UART_Callback)(UART_Handle handle, void *buf, size_t count);
+
+typedef struct
+{
+  uint32_t baudRate;
+  int readMode;
+  int readDataMode;
+  int writeDataMode;
+  int readEcho;
+  UART_Callback readCallback;
+} UART_Params;
+
+#define UART_MODE_BLOCKING      0
+#define UART_MODE_CALLBACK      1
+#define UART_DATA_BINARY        0
+#define UART_DATA_TEXT          1
+#define UART_ECHO_OFF           0
+#define UART_ECHO_ON            1
+
+void UART_Params_init(UART_Params *params);
+UART_Handle UART_open(unsigned int index, UART_Params *params);
+int UART_write(UART_Handle handle, const void *buf, size_t size);
+int UART_read(UART_Handle handle, void *buf, size_t size);
+
+/*********************************************************************
+ * DISPLAY
+ */
+
+typedef void *Display_Handle;
+
+/*********************************************************************
+ * HOST CONTROL
+ */
+
+// Pin as seen by the code, and as driven by the simulated device
+typedef struct
+{
+  bool outputEn;
+  uint32_t outputVal;
+  bool inputEn;
+  uint32_t irq;
+  PIN_Handle handle;
+  uint32_t deviceLevel;
+} hostPin_t;
+
+#define HOST_PINS               32
+
+extern hostPin_t hostPins[HOST_PINS];
+extern unsigned hostAborts;
+extern unsigned hostSemaphorePosts;
+
+// Returned by Clock_getTicks
+extern uint32_t hostTicks;
+
+// Bytes written to any UART
+#define HOST_UART_SIZE          4096
+
+extern uint8_t hostUartData[HOST_UART_SIZE];
+extern size_t hostUartLen;
+
+// Run the callback of an active clock, TRUE if it ran
+bool hostClockFire(Clock_Struct *pClock);
+
+// Run the interrupt of a started one-shot timer, TRUE if it ran
+bool hostTimerFire(GPTimerCC26XX_Handle handle);
+
+// Level of a line: low if either side drives it low, else pulled up
+uint32_t hostLineLevel(PIN_Id pinId);
+
+// Is the host driving a line
+bool hostDriving(PIN_Id pinId);
+
+// Drive a clock edge from the device side, running the pin callback if
+// its interrupt is enabled for the edge
+void hostDeviceClock(PIN_Id clkPin, uint32_t level);
+
+#endif /* HOST_H */
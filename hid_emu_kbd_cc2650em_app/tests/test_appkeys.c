@@ -0,0 +1,232 @@
+/******************************************************************************
+
+ @file  test_appkeys.c
+
+ @brief Key events handed from the keyboard task to the application task
+        through the event ring. A change the ring has no room for must
+        still reach the host, after the changes queued before it, so that
+        a released key is never left down.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hidemukbd.c"
+
+#include "app.h"
+
+#define KEY_A                   0x04
+#define KEY_B                   0x05
+#define KEY_C                   0x06
+#define MOD_LSHIFT              0x02
+
+/*********************************************************************
+ * APPLICATION TASK
+ */
+
+// One pass of the task loop after a wakeup, then connection events until
+// nothing is left to send
+static void appRun(void)
+{
+  while (evtReadPos != evtWritePos)
+  {
+    HidEmuKbd_processAppMsg(&evtRing[evtReadPos & HIDEMUKBD_EVT_RING_MASK]);
+    evtReadPos++;
+  }
+
+  if (keyChangesUnsent)
+  {
+    HidEmuKbd_applyUnsentKeys();
+  }
+
+  if (!keyReportInFlight)
+  {
+    HidEmuKbd_sendKeyReport();
+  }
+
+  while (keyReportInFlight)
+  {
+    HidEmuKbd_connEventEnd();
+  }
+}
+
+// Keyboard task: the same key pressed again until the ring is full
+static void fillRing(uint8_t key)
+{
+  keyEvent_t events[HIDEMUKBD_EVT_RING_SIZE];
+  uint8_t n;
+
+  for (n = 0; n < HIDEMUKBD_EVT_RING_SIZE; n++)
+  {
+    events[n].event = BOARD_KEY_CHANGE_EVT;
+    events[n].key = key;
+    events[n].time = 0;
+  }
+
+  hostBatchCB(HIDEMUKBD_EVT_RING_SIZE, events);
+}
+
+// Keys down in the last keyboard report
+static int keyDown(uint8_t key)
+{
+  const hostReport_t *p = hostLastReport(HID_RPT_ID_KEY_IN);
+  uint8_t i;
+
+  for (i = 2; p != NULL && i < p->len; i++)
+  {
+    if (p->data[i] == key)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int keysUp(void)
+{
+  const hostReport_t *p = hostLastReport(HID_RPT_ID_KEY_IN);
+  uint8_t i;
+
+  for (i = 0; p != NULL && i < p->len; i++)
+  {
+    if (p->data[i] != 0)
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+// A release that finds the ring full
+static int testBreakOnFullRing(void)
+{
+  uint16_t drops = evtRingDrops;
+
+  fillRing(KEY_A);
+  hostKeyCB(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_A, 0);
+
+  if (evtRingDrops == drops || !keyChangesUnsent)
+  {
+    printf("FAIL break on full ring: the ring had room\n");
+    return 1;
+  }
+
+  appRun();
+  if (!keysUp() || keyChangesUnsent)
+  {
+    printf("FAIL break on full ring: key left down\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+// Once a change is kept off the ring the ones after it are kept too,
+// even when the ring has room again
+static int testKeptInOrder(void)
+{
+  fillRing(KEY_B);
+  hostKeyCB(BOARD_KEY_CHANGE_EVT, KEY_C, 0);
+
+  // The application task takes one event, then the keyboard task runs
+  HidEmuKbd_processAppMsg(&evtRing[evtReadPos & HIDEMUKBD_EVT_RING_MASK]);
+  evtReadPos++;
+  hostKeyCB(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_C, 0);
+
+  if ((uint8_t)(evtWritePos - evtReadPos) != HIDEMUKBD_EVT_RING_SIZE - 1)
+  {
+    printf("FAIL kept in order: a release overtook its press\n");
+    return 1;
+  }
+
+  appRun();
+  if (!keyDown(KEY_B) || keyDown(KEY_C))
+  {
+    printf("FAIL kept in order: B and C are %u %u\n", keyDown(KEY_B), keyDown(KEY_C));
+    return 1;
+  }
+
+  // Ring back in use
+  hostKeyCB(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_B, 0);
+  if (keyChangesUnsent || evtReadPos == evtWritePos)
+  {
+    printf("FAIL kept in order: ring not used after the kept changes\n");
+    return 1;
+  }
+
+  appRun();
+  if (!keysUp())
+  {
+    printf("FAIL kept in order: key left down\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+// Modifiers and consumer keys are kept by their own index
+static int testModifierAndConsumer(void)
+{
+  const hostReport_t *p;
+
+  fillRing(KEY_A);
+  hostKeyCB(BOARD_MOD_CHANGE_EVT, MOD_LSHIFT, 0);
+  hostKeyCB(BOARD_CONSUMER_CHANGE_EVT, 1, 0);
+  hostKeyCB(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_A, 0);
+  appRun();
+
+  p = hostLastReport(HID_RPT_ID_KEY_IN);
+  if (p->data[0] != MOD_LSHIFT || keyDown(KEY_A))
+  {
+    printf("FAIL modifier: report %02X, A %u\n", p->data[0], keyDown(KEY_A));
+    return 1;
+  }
+
+  p = hostLastReport(HID_RPT_ID_CC_IN);
+  if (p == NULL || BUILD_UINT16(p->data[0], p->data[1]) != consumerUsage[1])
+  {
+    printf("FAIL consumer key not pressed\n");
+    return 1;
+  }
+
+  fillRing(KEY_A);
+  hostKeyCB(BOARD_CONSUMER_CHANGE_EVT | BOARD_BREAK_CODE_EVT, 1, 0);
+  hostKeyCB(BOARD_MOD_CHANGE_EVT | BOARD_BREAK_CODE_EVT, MOD_LSHIFT, 0);
+  hostKeyCB(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_A, 0);
+  appRun();
+
+  p = hostLastReport(HID_RPT_ID_CC_IN);
+  if (!keysUp() || p->data[0] != 0 || p->data[1] != 0)
+  {
+    printf("FAIL modifier and consumer key left down\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(void)
+{
+  HidEmuKbd_init();
+
+  if (hostKeyCB == NULL || hostBatchCB == NULL)
+  {
+    printf("FAIL keyboard callbacks not registered\n");
+    return EXIT_FAILURE;
+  }
+
+  if (testBreakOnFullRing() || testKeptInOrder() || testModifierAndConsumer())
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/******************************************************************************
+
+ @file  test_decoder.c
+
+ @brief Tests of the scan code set 2 decoder: single, E0, F0 and E0 F0
+        sequences, Pause (E1), PrintScreen, bytes with no key, and a fuzz
+        run that checks the decoder always finds its way back. Ends with
+        a decoding benchmark.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Keyboard.c"
+
+#define DECODER_EVENTS_MAX      64
+#define DECODER_FUZZ_RUNS       200000
+#define DECODER_BENCH_BYTES     50000000u
+
+// Events reported by the decoder
+static struct {
+	uint8_t event;
+	uint8_t key;
+} events[DECODER_EVENTS_MAX];
+static uint8_t numEvents = 0;
+
+static void keyHandler(uint8_t event, uint8_t key, uint32_t time)
+{
+	if (numEvents < DECODER_EVENTS_MAX) {
+		events[numEvents].event = event;
+		events[numEvents].key = key;
+	}
+	numEvents++;
+}
+
+static void feed(const uint8_t *bytes, uint8_t len)
+{
+	uint8_t i;
+
+	numEvents = 0;
+	for (i = 0; i < len; i++) {
+		decoderFeed(bytes[i]);
+	}
+}
+
+// The bytes must report exactly the events given as (event, key) pairs
+static int expect(const char *name, const uint8_t *bytes, uint8_t len,
+				  const uint8_t *pairs, uint8_t numPairs)
+{
+	uint8_t i;
+
+	feed(bytes, len);
+	if (numEvents != numPairs) {
+		printf("FAIL %s: %u events, expected %u\n", name, numEvents, numPairs);
+		return 1;
+	}
+	for (i = 0; i < numPairs; i++) {
+		if (events[i].event != pairs[2 * i] || events[i].key != pairs[2 * i + 1]) {
+			printf("FAIL %s: event %u is 0x%02X/0x%02X, expected 0x%02X/0x%02X\n",
+					name, i, events[i].event, events[i].key, pairs[2 * i], pairs[2 * i + 1]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#define EXPECT(name, bytes, pairs)	\
+		expect(name, bytes, sizeof(bytes), pairs, sizeof(pairs) / 2)
+#define EXPECT_NONE(name, bytes)	\
+		expect(name, bytes, sizeof(bytes), NULL, 0)
+
+#define KEY_MAKE		BOARD_KEY_CHANGE_EVT
+#define KEY_BREAK		(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT)
+#define MOD_MAKE		BOARD_MOD_CHANGE_EVT
+#define MOD_BREAK		(BOARD_MOD_CHANGE_EVT | BOARD_BREAK_CODE_EVT)
+#define CC_MAKE			BOARD_CONSUMER_CHANGE_EVT
+#define CC_BREAK		(BOARD_CONSUMER_CHANGE_EVT | BOARD_BREAK_CODE_EVT)
+
+// Bytes that bring the decoder back to DEC_IDLE from any state: the longest
+// sequence left is the rest of Pause, 0x00 is no key in every table
+static const uint8_t resync[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+static int testSequences(void)
+{
+	static const uint8_t aMake[] = { 0x1C };
+	static const uint8_t aMakeEv[] = { KEY_MAKE, 0x04 };
+	static const uint8_t aBreak[] = { 0xF0, 0x1C };
+	static const uint8_t aBreakEv[] = { KEY_BREAK, 0x04 };
+	static const uint8_t upMake[] = { 0xE0, 0x75 };
+	static const uint8_t upMakeEv[] = { KEY_MAKE, 0x52 };
+	static const uint8_t upBreak[] = { 0xE0, 0xF0, 0x75 };
+	static const uint8_t upBreakEv[] = { KEY_BREAK, 0x52 };
+	static const uint8_t kp8[] = { 0x75, 0xF0, 0x75 };
+	static const uint8_t kp8Ev[] = { KEY_MAKE, 0x60, KEY_BREAK, 0x60 };
+	static const uint8_t shift[] = { 0x12, 0xF0, 0x12 };
+	static const uint8_t shiftEv[] = { MOD_MAKE, 0x02, MOD_BREAK, 0x02 };
+	static const uint8_t rCtrl[] = { 0xE0, 0x14, 0xE0, 0xF0, 0x14 };
+	static const uint8_t rCtrlEv[] = { MOD_MAKE, 0x10, MOD_BREAK, 0x10 };
+	static const uint8_t pause[] = { 0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77 };
+	static const uint8_t pauseEv[] = { KEY_MAKE, PAUSE_HID, KEY_BREAK, PAUSE_HID };
+	static const uint8_t pauseA[] = { 0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77, 0x1C };
+	static const uint8_t pauseAEv[] = { KEY_MAKE, PAUSE_HID, KEY_BREAK, PAUSE_HID, KEY_MAKE, 0x04 };
+	static const uint8_t prtSc[] = { 0xE0, 0x12, 0xE0, 0x7C, 0xE0, 0xF0, 0x7C, 0xE0, 0xF0, 0x12 };
+	static const uint8_t prtScEv[] = { KEY_MAKE, 0x46, KEY_BREAK, 0x46 };
+	static const uint8_t doubleE0[] = { 0xE0, 0xE0, 0x75 };
+	static const uint8_t doubleF0[] = { 0xF0, 0xF0, 0x1C };
+	static const uint8_t breakThenE0[] = { 0xF0, 0xE0, 0x75 };
+	static const uint8_t cut[] = { 0xE0, 0xF0, 0xE1, 0x14, 0x77, 0xE1, 0xF0, 0x14, 0xF0, 0x77 };
+	static const uint8_t mute[] = { 0xE0, 0x23, 0xE0, 0xF0, 0x23 };
+	static const uint8_t muteEv[] = { CC_MAKE, CONSUMER_KEY_0x23, CC_BREAK, CONSUMER_KEY_0x23 };
+	static const uint8_t noKey[] = { 0x00, 0x02, 0x5F, 0xAA, 0xFA, 0xFC, 0xFF, 0xF0, 0x00, 0xE0, 0x00, 0xE0, 0x01, 0xE0, 0xF0, 0x5F };
+
+	return EXPECT("make", aMake, aMakeEv) ||
+		   EXPECT("break", aBreak, aBreakEv) ||
+		   EXPECT("E0 make", upMake, upMakeEv) ||
+		   EXPECT("E0 F0 break", upBreak, upBreakEv) ||
+		   EXPECT("keypad is not E0", kp8, kp8Ev) ||
+		   EXPECT("modifier", shift, shiftEv) ||
+		   EXPECT("E0 modifier", rCtrl, rCtrlEv) ||
+		   EXPECT("pause", pause, pauseEv) ||
+		   EXPECT("pause then key", pauseA, pauseAEv) ||
+		   EXPECT("printscreen", prtSc, prtScEv) ||
+		   EXPECT("E0 E0", doubleE0, upMakeEv) ||
+		   EXPECT("F0 F0", doubleF0, aBreakEv) ||
+		   EXPECT("F0 E0", breakThenE0, upMakeEv) ||
+		   EXPECT("E1 cuts E0 F0", cut, pauseEv) ||
+		   EXPECT("consumer", mute, muteEv) ||
+		   EXPECT_NONE("no key", noKey);
+}
+
+// After any bytes the resync bytes must leave the decoder idle, so a plain
+// make and break decode again and nothing reported is a zero usage
+static int testFuzz(void)
+{
+	static const uint8_t aMakeBreak[] = { 0x1C, 0xF0, 0x1C };
+	uint8_t bytes[24];
+	uint32_t run;
+	uint8_t i, len;
+
+	srand(1);
+	for (run = 0; run < DECODER_FUZZ_RUNS; run++) {
+		len = rand() % sizeof(bytes);
+		for (i = 0; i < len; i++) {
+			// Favor the prefixes, they drive the state changes
+			switch (rand() % 6) {
+				case 0: bytes[i] = EXT_CODE; break;
+				case 1: bytes[i] = BREAK_CODE; break;
+				case 2: bytes[i] = PAUSE_CODE; break;
+				default: bytes[i] = rand(); break;
+			}
+		}
+
+		feed(bytes, len);
+		for (i = 0; i < numEvents && i < DECODER_EVENTS_MAX; i++) {
+			if (events[i].key == 0) {
+				printf("FAIL fuzz: zero usage reported in run %u\n", (unsigned)run);
+				return 1;
+			}
+		}
+
+		feed(resync, sizeof(resync));
+		if (expect("fuzz resync", aMakeBreak, sizeof(aMakeBreak),
+				   (const uint8_t[]){ KEY_MAKE, 0x04, KEY_BREAK, 0x04 }, 2)) {
+			printf("     after run %u\n", (unsigned)run);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void benchmark(void)
+{
+	// Typing: make, break, a shifted key and an E0 key
+	static const uint8_t stream[] = { 0x1C, 0xF0, 0x1C, 0x12, 0x32, 0xF0, 0x32, 0xF0, 0x12,
+									  0xE0, 0x75, 0xE0, 0xF0, 0x75 };
+	struct timespec start, end;
+	uint32_t i;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < DECODER_BENCH_BYTES; i++) {
+		decoderFeed(stream[i % sizeof(stream)]);
+		numEvents = 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	printf("decoder: %.2f ns/byte on the host\n", ns / DECODER_BENCH_BYTES);
+}
+
+int main(void)
+{
+	appKeyChangeHandler = keyHandler;
+
+	if (testSequences() || testFuzz()) {
+		return EXIT_FAILURE;
+	}
+	benchmark();
+
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
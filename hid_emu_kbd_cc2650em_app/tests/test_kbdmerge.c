@@ -0,0 +1,272 @@
+/******************************************************************************
+
+ @file  test_kbdmerge.c
+
+ @brief Tests of HidEmuKbd_reportMergeCB, the rule HidDev uses to drop a
+        queued report when its queue is full. A report may only go if the
+        host, seeing the report before it and the one after it, misses no
+        key change. Built with KB_NKRO, so both the 6 key boot array and
+        the key bitmap are checked.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hidemukbd.c"
+
+#include "app.h"
+
+#define MERGE_RUNS              200000
+
+#define KEY_A                   0x04
+#define KEY_B                   0x05
+#define KEY_C                   0x06
+#define KEY_D                   0x07
+#define KEY_E                   0x08
+#define KEY_F                   0x09
+#define KEY_G                   0x0A
+#define MOD_LCTRL               0x01
+#define MOD_LSHIFT              0x02
+
+#define NO_KEY                  0x00
+
+// Boot keyboard report: modifiers, reserved, 6 key array
+#define BOOT(mod, k0, k1, k2, k3, k4, k5) { mod, 0, k0, k1, k2, k3, k4, k5 }
+
+static uint8_t merge(uint8_t id, uint8_t len, const uint8_t *pPrev,
+                     const uint8_t *pFirst, const uint8_t *pSecond)
+{
+  uint8_t second[HID_KEYBOARD_IN_RPT_LEN];
+
+  memcpy(second, pSecond, len);
+  return HidEmuKbd_reportMergeCB(id, HID_REPORT_TYPE_INPUT, len, pPrev,
+                                 pFirst, second);
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+typedef struct
+{
+  const char *name;
+  uint8_t reports[3][HID_BOOT_KEYBOARD_IN_RPT_LEN];
+  uint8_t expected;
+} bootCase_t;
+
+static const bootCase_t bootCases[] =
+{
+  { "press then press",
+    { BOOT(0, 0, 0, 0, 0, 0, 0), BOOT(0, KEY_A, 0, 0, 0, 0, 0), BOOT(0, KEY_A, KEY_B, 0, 0, 0, 0) }, TRUE },
+  { "tap",
+    { BOOT(0, 0, 0, 0, 0, 0, 0), BOOT(0, KEY_A, 0, 0, 0, 0, 0), BOOT(0, 0, 0, 0, 0, 0, 0) }, FALSE },
+  { "release then press",
+    { BOOT(0, KEY_A, 0, 0, 0, 0, 0), BOOT(0, 0, 0, 0, 0, 0, 0), BOOT(0, KEY_A, 0, 0, 0, 0, 0) }, FALSE },
+  { "make of one, break of another",
+    { BOOT(0, KEY_A, 0, 0, 0, 0, 0), BOOT(0, KEY_A, KEY_B, 0, 0, 0, 0), BOOT(0, 0, KEY_B, 0, 0, 0, 0) }, TRUE },
+  { "key moved in the array",
+    { BOOT(0, KEY_A, KEY_B, 0, 0, 0, 0), BOOT(0, KEY_B, 0, 0, 0, 0, 0), BOOT(0, KEY_C, KEY_B, 0, 0, 0, 0) }, TRUE },
+  { "key moved, then released",
+    { BOOT(0, KEY_A, KEY_B, 0, 0, 0, 0), BOOT(0, KEY_B, 0, 0, 0, 0, 0), BOOT(0, 0, 0, 0, 0, 0, 0) }, TRUE },
+  { "modifier tap",
+    { BOOT(0, 0, 0, 0, 0, 0, 0), BOOT(MOD_LSHIFT, 0, 0, 0, 0, 0, 0), BOOT(0, 0, 0, 0, 0, 0, 0) }, FALSE },
+  { "two modifiers",
+    { BOOT(0, 0, 0, 0, 0, 0, 0), BOOT(MOD_LSHIFT, 0, 0, 0, 0, 0, 0), BOOT(MOD_LSHIFT | MOD_LCTRL, 0, 0, 0, 0, 0, 0) }, TRUE },
+  { "shifted tap",
+    { BOOT(MOD_LSHIFT, 0, 0, 0, 0, 0, 0), BOOT(MOD_LSHIFT, KEY_A, 0, 0, 0, 0, 0), BOOT(0, KEY_A, 0, 0, 0, 0, 0) }, TRUE },
+  { "full array, one replaced",
+    { BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, 0),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_G) }, TRUE },
+  { "full array, tap of the last",
+    { BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, 0),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F) }, FALSE },
+  { "full array, released in any slot",
+    { BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F),
+      BOOT(0, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, 0),
+      BOOT(0, KEY_B, KEY_C, KEY_D, KEY_E, 0, 0) }, TRUE },
+  { "rollover and back",
+    { BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F),
+      BOOT(0, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER,
+           HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F) }, FALSE },
+  { "press, then rollover",
+    { BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, 0),
+      BOOT(0, KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F),
+      BOOT(0, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER,
+           HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER, HID_KEY_ERROR_ROLLOVER) }, FALSE },
+};
+
+static int testBootCases(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < sizeof(bootCases) / sizeof(bootCases[0]); i++)
+  {
+    const bootCase_t *c = &bootCases[i];
+
+    if (merge(HID_RPT_ID_KEY_IN, HID_BOOT_KEYBOARD_IN_RPT_LEN, c->reports[0],
+              c->reports[1], c->reports[2]) != c->expected)
+    {
+      printf("FAIL boot array, %s: %s\n", c->name, c->expected ? "kept" : "dropped");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// Does a key change twice from prev to first to second
+static uint8_t bootKeyTwice(const uint8_t *reports[3], uint8_t key)
+{
+  uint8_t in[3] = { 0, 0, 0 };
+  uint8_t j, i;
+
+  for (j = 0; j < 3; j++)
+  {
+    for (i = 2; i < HID_BOOT_KEYBOARD_IN_RPT_LEN; i++)
+    {
+      in[j] |= (reports[j][i] == key);
+    }
+  }
+
+  return in[0] != in[1] && in[1] != in[2];
+}
+
+// Random boot arrays of a few keys: a report may go exactly when no key or
+// modifier changes twice
+static int testBootRandom(void)
+{
+  uint8_t r[3][HID_BOOT_KEYBOARD_IN_RPT_LEN];
+  const uint8_t *reports[3] = { r[0], r[1], r[2] };
+  uint32_t run, merged = 0;
+  uint8_t expected, j, i, key;
+
+  srand(1);
+  for (run = 0; run < MERGE_RUNS; run++)
+  {
+    memset(r, 0, sizeof(r));
+    for (j = 0; j < 3; j++)
+    {
+      r[j][0] = rand() & (MOD_LSHIFT | MOD_LCTRL);
+      for (i = 2; i < HID_BOOT_KEYBOARD_IN_RPT_LEN; i++)
+      {
+        // A key is in at most one slot
+        key = (rand() % 2) ? KEY_A + rand() % 8 : NO_KEY;
+        if (key != NO_KEY && HidEmuKbd_keyInArray(r[j], key))
+        {
+          key = NO_KEY;
+        }
+        r[j][i] = key;
+      }
+    }
+
+    expected = !((r[0][0] ^ r[1][0]) & (r[1][0] ^ r[2][0]));
+    for (key = KEY_A; key < KEY_A + 8; key++)
+    {
+      if (bootKeyTwice(reports, key))
+      {
+        expected = FALSE;
+      }
+    }
+
+    if (merge(HID_RPT_ID_KEY_IN, HID_BOOT_KEYBOARD_IN_RPT_LEN, r[0], r[1], r[2]) != expected)
+    {
+      printf("FAIL boot array run %u: %s\n", run, expected ? "kept" : "dropped");
+      return 1;
+    }
+    merged += expected;
+  }
+
+  if (merged == 0)
+  {
+    printf("FAIL boot array: nothing merged\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+// Key bitmap: any bit, the last one too, decides on its own
+static int testBitmap(void)
+{
+  uint8_t prev[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
+  uint8_t first[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
+  uint8_t second[HID_KEYBOARD_IN_RPT_LEN] = { 0 };
+  uint8_t last = HID_KEYBOARD_IN_RPT_LEN - 1;
+
+  first[1] = 0x10;
+  second[1] = 0x10;
+  second[last] = 0x80;
+  if (!merge(HID_RPT_ID_KEY_IN, HID_KEYBOARD_IN_RPT_LEN, prev, first, second))
+  {
+    printf("FAIL bitmap: press then press kept\n");
+    return 1;
+  }
+
+  first[last] = 0x80;
+  second[last] = 0;
+  if (merge(HID_RPT_ID_KEY_IN, HID_KEYBOARD_IN_RPT_LEN, prev, first, second))
+  {
+    printf("FAIL bitmap: tap of the last usage dropped\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+// One usage at a time
+static int testConsumer(void)
+{
+  static const struct
+  {
+    const char *name;
+    uint16_t usage[3];
+    uint8_t expected;
+  } cases[] =
+  {
+    { "tap",                  { 0, 0x00E9, 0 },           FALSE },
+    { "held",                 { 0, 0x00E9, 0x00E9 },      TRUE  },
+    { "release, press",       { 0x00E9, 0, 0x00E2 },      TRUE  },
+    { "release, press again", { 0x00E9, 0, 0x00E9 },      FALSE },
+    { "press over another",   { 0x00E9, 0x00E2, 0x00E9 }, FALSE },
+  };
+  uint8_t r[3][HID_CC_IN_RPT_LEN];
+  uint8_t i, j;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    for (j = 0; j < 3; j++)
+    {
+      r[j][0] = LO_UINT16(cases[i].usage[j]);
+      r[j][1] = HI_UINT16(cases[i].usage[j]);
+    }
+
+    if (merge(HID_RPT_ID_CC_IN, HID_CC_IN_RPT_LEN, r[0], r[1], r[2]) != cases[i].expected)
+    {
+      printf("FAIL consumer, %s: %s\n", cases[i].name, cases[i].expected ? "kept" : "dropped");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(void)
+{
+  if (hidEmuKbdHidCBs.reportMergeCB != HidEmuKbd_reportMergeCB)
+  {
+    printf("FAIL merge callback not registered\n");
+    return EXIT_FAILURE;
+  }
+
+  if (testBootCases() || testBootRandom() || testBitmap() || testConsumer())
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
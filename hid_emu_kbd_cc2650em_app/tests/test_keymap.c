@@ -0,0 +1,248 @@
+/******************************************************************************
+
+ @file  test_keymap.c
+
+ @brief Tests of the keymap lookup against a plain scan of the entries,
+        for random configurations with transparent entries on any layer,
+        and of the changes written over GATT: a full keymap, keys held
+        across a change, and the configuration reloaded from SNV.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Keymap.c"
+
+#define KEYMAP_RUNS				2000
+
+#define KEY_A					0x04
+#define KEY_B					0x05
+#define KEY_C					0x06
+
+// Key events passed on by the keymap
+static uint8_t numEvents = 0;
+static uint8_t lastEvent, lastKey;
+
+static void keyHandler(uint8_t event, uint8_t key, uint32_t time)
+{
+	lastEvent = event;
+	lastKey = key;
+	numEvents++;
+}
+
+// Action of a key found by scanning the entries, layer by layer
+static uint16_t refLookup(uint8_t layer, uint8_t usage)
+{
+	const keymapConfig_t *config = &keymapState.config;
+	uint8_t i;
+
+	do {
+		for (i = 0; i < config->numEntries; i++) {
+			if (config->entries[i].layer == layer && config->entries[i].usage == usage &&
+				KEYMAP_ACTION_TYPE(config->entries[i].action) != KEYMAP_TRANSPARENT) {
+				return config->entries[i].action;
+			}
+		}
+	} while (layer-- > 0);
+
+	return KEYMAP_KEY_ACTION(usage);
+}
+
+static int checkLookups(const char *name)
+{
+	uint8_t layer;
+	uint16_t usage;
+
+	for (layer = 0; layer < KB_KEYMAP_LAYERS; layer++) {
+		for (usage = 0; usage < KEYMAP_USAGE_COUNT; usage++) {
+			if (keymapLookup(layer, usage) != refLookup(layer, usage)) {
+				printf("FAIL %s: layer %u usage 0x%02X is 0x%04X, expected 0x%04X\n", name,
+					   layer, usage, keymapLookup(layer, usage), refLookup(layer, usage));
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void clearConfig(void)
+{
+	Keymap_clear();
+	numEvents = 0;
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+// Configurations as SNV may hold them, transparent entries included, on
+// few keys so that they stack up over the layers
+static int testRandomLookups(void)
+{
+	keymapConfig_t *config = &keymapState.config;
+	keymapEntry_t *e;
+	uint16_t run;
+	uint8_t i, j, n;
+
+	srand(1);
+	for (run = 0; run < KEYMAP_RUNS; run++) {
+		n = rand() % (KB_KEYMAP_MAX_ENTRIES + 1);
+		config->numEntries = 0;
+		for (i = 0; i < n; i++) {
+			e = &config->entries[config->numEntries];
+			e->layer = rand() % KB_KEYMAP_LAYERS;
+			e->usage = (rand() % 2) ? KEY_A + rand() % 8 : rand() % KEYMAP_USAGE_COUNT;
+			e->action = (rand() % 4) ? KEYMAP_KEY_ACTION(rand() % KEYMAP_USAGE_COUNT) :
+									   KEYMAP_TRANSPARENT_ACTION;
+
+			// One entry per layer and key
+			for (j = 0; j < config->numEntries; j++) {
+				if (config->entries[j].layer == e->layer && config->entries[j].usage == e->usage) {
+					break;
+				}
+			}
+			if (j == config->numEntries) {
+				config->numEntries++;
+			}
+		}
+
+		keymapIndex();
+		if (checkLookups("random")) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// The last entry is refused when the keymap is applied, and read back
+static int testFull(void)
+{
+	keymapEntry_t entry = { 1, 0, KEYMAP_KEY_ACTION(KEY_B) };
+	keymapState_t *state;
+	uint16_t len;
+	uint8_t i;
+
+	clearConfig();
+	for (i = 0; i < KB_KEYMAP_MAX_ENTRIES; i++) {
+		entry.usage = KEY_A + i;
+		if (Keymap_setEntry(&entry) != SUCCESS) {
+			printf("FAIL full: entry %u refused\n", i);
+			return 1;
+		}
+	}
+
+	entry.usage = KEY_A + i;
+	state = (keymapState_t *)Keymap_getConfig(&len);
+	if (Keymap_setEntry(&entry) != bleNoResources || state->status != bleNoResources ||
+		state->config.numEntries != KB_KEYMAP_MAX_ENTRIES) {
+		printf("FAIL full: entry past the last taken\n");
+		return 1;
+	}
+
+	// A key configured already changes in place, a removed one frees room
+	entry.usage = KEY_A;
+	entry.action = KEYMAP_KEY_ACTION(KEY_C);
+	if (Keymap_setEntry(&entry) != SUCCESS || keymapLookup(1, KEY_A) != entry.action) {
+		printf("FAIL full: configured key not changed\n");
+		return 1;
+	}
+	entry.action = KEYMAP_TRANSPARENT_ACTION;
+	if (Keymap_setEntry(&entry) != SUCCESS) {
+		printf("FAIL full: key not removed\n");
+		return 1;
+	}
+	entry.usage = KEY_A + KB_KEYMAP_MAX_ENTRIES;
+	entry.action = KEYMAP_KEY_ACTION(KEY_C);
+	if (Keymap_setEntry(&entry) != SUCCESS) {
+		printf("FAIL full: freed entry not taken\n");
+		return 1;
+	}
+
+	return checkLookups("full");
+}
+
+// A key held across a change is released as what it was pressed as
+static int testHeldAcrossChange(void)
+{
+	keymapEntry_t entry = { 0, KEY_A, KEYMAP_KEY_ACTION(KEY_B) };
+
+	clearConfig();
+	Keymap_setEntry(&entry);
+	Keymap_keyEvent(BOARD_KEY_CHANGE_EVT, KEY_A, 0);
+	if (numEvents != 1 || lastKey != KEY_B) {
+		printf("FAIL held: remapped key not pressed\n");
+		return 1;
+	}
+
+	entry.action = KEYMAP_KEY_ACTION(KEY_C);
+	Keymap_setEntry(&entry);
+	if (numEvents != 2 || lastEvent != (BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT) ||
+		lastKey != KEY_B) {
+		printf("FAIL held: released as 0x%02X\n", lastKey);
+		return 1;
+	}
+
+	// Its own release comes after the change, already released
+	Keymap_keyEvent(BOARD_KEY_CHANGE_EVT | BOARD_BREAK_CODE_EVT, KEY_A, 0);
+	if (numEvents != 2) {
+		printf("FAIL held: released twice\n");
+		return 1;
+	}
+	return 0;
+}
+
+// The stored configuration is reloaded as it was
+static int testReload(void)
+{
+	keymapEntry_t entries[] = {
+		{ 2, KEY_C, KEYMAP_KEY_ACTION(KEY_A) },
+		{ 0, KEY_C, KEYMAP_MO(2) },
+		{ 1, KEY_A, KEYMAP_TAP_HOLD_ACTION(KEY_B, 1) },
+		{ 3, KEY_B, KEYMAP_TG(3) },
+	};
+	uint16_t before[KB_KEYMAP_LAYERS][KEYMAP_USAGE_COUNT];
+	uint8_t layer, i;
+	uint16_t usage;
+
+	clearConfig();
+	for (i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+		Keymap_setEntry(&entries[i]);
+	}
+	for (layer = 0; layer < KB_KEYMAP_LAYERS; layer++) {
+		for (usage = 0; usage < KEYMAP_USAGE_COUNT; usage++) {
+			before[layer][usage] = keymapLookup(layer, usage);
+		}
+	}
+
+	memset(&keymapState, 0, sizeof(keymapState));
+	Keymap_init(keyHandler);
+	if (keymapState.config.numEntries != sizeof(entries) / sizeof(entries[0])) {
+		printf("FAIL reload: %u entries\n", keymapState.config.numEntries);
+		return 1;
+	}
+	for (layer = 0; layer < KB_KEYMAP_LAYERS; layer++) {
+		for (usage = 0; usage < KEYMAP_USAGE_COUNT; usage++) {
+			if (keymapLookup(layer, usage) != before[layer][usage]) {
+				printf("FAIL reload: layer %u usage 0x%02X changed\n", layer, usage);
+				return 1;
+			}
+		}
+	}
+	return checkLookups("reload");
+}
+
+int main(void)
+{
+	Keymap_init(keyHandler);
+
+	if (checkLookups("empty") || testRandomLookups() || testFull() ||
+		testHeldAcrossChange() || testReload()) {
+		return EXIT_FAILURE;
+	}
+
+	printf("keymap lookup: %u bytes of RAM besides the configuration\n",
+		   (unsigned)sizeof(keymapConfigured));
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
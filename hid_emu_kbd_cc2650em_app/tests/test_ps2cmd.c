@@ -0,0 +1,151 @@
+/******************************************************************************
+
+ @file  test_ps2cmd.c
+
+ @brief Tests of the PS/2 command engine against devices that do not
+        answer. Timers run one at a time as their callbacks come due, a
+        silent device never clocks a frame in or out. Every transfer must
+        end in bounded time with both lines given back, and a keyboard
+        lost at runtime must be reset again rather than stop the firmware.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Keyboard.c"
+
+// Timer expiries after which a port counts as stuck
+#define PS2CMD_MAX_EXPIRIES     1000
+
+static void keyHandler(uint8_t event, uint8_t key, uint32_t time)
+{
+}
+
+// Run the port timers until none is pending, -1 if they never stop
+static int runClocks(ps2Port_t *port)
+{
+	int expiries = 0;
+
+	while (expiries < PS2CMD_MAX_EXPIRIES) {
+		if (!hostClockFire(&port->lineClock) && !hostClockFire(&port->cmdClock)) {
+			return expiries;
+		}
+		expiries++;
+	}
+	return -1;
+}
+
+// Both lines belong to the device again and reception is armed
+static int expectReleased(const char *name, ps2Port_t *port)
+{
+	if (hostDriving(port->clkPin) || hostDriving(port->dataPin)) {
+		printf("FAIL %s: host still drives %s\n", name,
+				hostDriving(port->clkPin) ? "clock" : "data");
+		return 1;
+	}
+	if (port->lineHeld != 0 || port->txActive != 0) {
+		printf("FAIL %s: lineHeld %u, txActive %u\n", name, port->lineHeld, port->txActive);
+		return 1;
+	}
+	if (hostPins[port->clkPin].irq != PIN_IRQ_NEGEDGE || port->pinsHandle->intCb != rxCallback) {
+		printf("FAIL %s: reception not armed\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+// The mouse is optional: its reset must fail and leave the port listening
+static int testAbsentMouse(void)
+{
+	if (runClocks(&mousePort) < 0) {
+		printf("FAIL absent mouse: timers never stop\n");
+		return 1;
+	}
+	if (mousePort.cmdFailures != 1 || mousePort.cmdState != KB_CMD_IDLE ||
+		mousePort.cmdReadPos != mousePort.cmdWritePos) {
+		printf("FAIL absent mouse: %u failures, state %u\n", mousePort.cmdFailures, mousePort.cmdState);
+		return 1;
+	}
+	return expectReleased("absent mouse", &mousePort);
+}
+
+// A resend request is no command, it still must not hold the lines forever
+static int testResend(void)
+{
+	uint16_t failures = mousePort.cmdFailures;
+
+	mousePort.rxResendPending = 1;
+	lineAcquire(&mousePort);
+	if (!mousePort.txActive || !hostDriving(mousePort.clkPin)) {
+		printf("FAIL resend: transfer not started\n");
+		return 1;
+	}
+
+	if (runClocks(&mousePort) < 0) {
+		printf("FAIL resend: timers never stop\n");
+		return 1;
+	}
+	if (mousePort.cmdFailures != failures || mousePort.rxResendPending != 0) {
+		printf("FAIL resend: %u failures\n", mousePort.cmdFailures - failures);
+		return 1;
+	}
+	return expectReleased("resend", &mousePort);
+}
+
+// Only a keyboard that never worked stops the firmware, a keyboard lost
+// later is reset again with growing delays
+static int testKeyboardLost(void)
+{
+	static const uint16_t backoff[] = { 1000, 2000, 4000, 8000, 16000, 16000 };
+	uint8_t i;
+
+	if (runClocks(&keyboardPort) < 0 || hostAborts != 1) {
+		printf("FAIL keyboard at power up: %u aborts\n", hostAborts);
+		return 1;
+	}
+	if (Util_isActive(&keyboardPort.reinitClock)) {
+		printf("FAIL keyboard at power up: reset retried\n");
+		return 1;
+	}
+
+	portReinit(&keyboardPort);
+	lineAcquire(&keyboardPort);
+	for (i = 0; i < sizeof(backoff) / sizeof(backoff[0]); i++) {
+		if (runClocks(&keyboardPort) < 0) {
+			printf("FAIL keyboard lost: timers never stop\n");
+			return 1;
+		}
+		if (hostAborts != 1) {
+			printf("FAIL keyboard lost: aborted at runtime\n");
+			return 1;
+		}
+		if (!Util_isActive(&keyboardPort.reinitClock) ||
+			keyboardPort.reinitClock.timeout != backoff[i]) {
+			printf("FAIL keyboard lost: reset %u not retried after %u ms\n", i, backoff[i]);
+			return 1;
+		}
+		if (expectReleased("keyboard lost", &keyboardPort)) {
+			return 1;
+		}
+
+		hostClockFire(&keyboardPort.reinitClock);
+		if (keyboardPort.reinits != i + 2 || !keyboardPort.txActive) {
+			printf("FAIL keyboard lost: reset %u not sent\n", i + 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	Keyboard_init(keyHandler);
+
+	if (testAbsentMouse() || testResend() || testKeyboardLost()) {
+		return EXIT_FAILURE;
+	}
+
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/******************************************************************************
+
+ @file  test_reportq.c
+
+ @brief Randomized model check of the HidDev report queue. Every report is
+        also kept in an unbounded reference queue. Notifications are
+        refused at random for flow control, and the application adds
+        reports while one is being sent, as it does while the HidDev task
+        blocks on ICall. Whatever the queue merges away, the host must end
+        on the same state as the reference. While it only merges, the host
+        must also see every key change the reference has.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hiddev.c"
+
+#define REPORTQ_RUNS            20000
+#define REPORTQ_STEPS           64
+#define REPORTQ_IDS             2
+#define REPORTQ_LEN             2
+#define REPORTQ_KEYS            (8 * REPORTQ_LEN)
+#define REPORTQ_MAX_REPORTS     (4 * REPORTQ_STEPS * 4)
+
+// Reports of one ID, as generated and as seen by the host
+typedef struct
+{
+  uint8_t state[REPORTQ_LEN];
+  uint16_t numSent;
+  uint16_t refEdges[REPORTQ_KEYS];
+  uint8_t host[REPORTQ_LEN];
+  uint16_t hostEdges[REPORTQ_KEYS];
+} reportModel_t;
+
+static reportModel_t model[REPORTQ_IDS];
+
+static gattCharCfg_t *cccTbl = NULL;
+static gattAttribute_t cccAttr[REPORTQ_IDS];
+static hidRptMap_t rptMap[REPORTQ_IDS];
+
+static uint8_t reportMerge(uint8_t id, uint8_t type, uint8_t len,
+                           const uint8_t *pPrev, const uint8_t *pFirst,
+                           uint8_t *pSecond);
+
+static hidDevCB_t reportCBs = { NULL, NULL, NULL, NULL, reportMerge };
+
+// Flow control and reports added while a notification is sent
+static unsigned pendingPercent;
+static unsigned sendingPercent;
+
+/*********************************************************************
+ * MODEL
+ */
+
+// Same rule as the keyboard: no bit may change twice
+static uint8_t reportMerge(uint8_t id, uint8_t type, uint8_t len,
+                           const uint8_t *pPrev, const uint8_t *pFirst,
+                           uint8_t *pSecond)
+{
+  uint8_t i;
+
+  for (i = 0; i < len; i++)
+  {
+    if ((pPrev[i] ^ pFirst[i]) & (pFirst[i] ^ pSecond[i]))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void countEdges(uint16_t *edges, const uint8_t *before, const uint8_t *after)
+{
+  uint8_t i;
+
+  for (i = 0; i < REPORTQ_KEYS; i++)
+  {
+    if ((before[i / 8] ^ after[i / 8]) & (1 << (i % 8)))
+    {
+      edges[i]++;
+    }
+  }
+}
+
+// Application: press or release one key
+static void appReport(void)
+{
+  uint8_t n = rand() % REPORTQ_IDS;
+  reportModel_t *m = &model[n];
+  uint8_t before[REPORTQ_LEN];
+  uint8_t key = rand() % REPORTQ_KEYS;
+
+  if (m->numSent == REPORTQ_MAX_REPORTS)
+  {
+    return;
+  }
+
+  memcpy(before, m->state, REPORTQ_LEN);
+  m->state[key / 8] ^= 1 << (key % 8);
+  countEdges(m->refEdges, before, m->state);
+  m->numSent++;
+
+  HidDev_Report(rptMap[n].id, HID_REPORT_TYPE_INPUT, REPORTQ_LEN, m->state);
+}
+
+// Host: takes the notification or refuses it for lack of buffers
+static bStatus_t hostNotification(uint16 handle, uint8 *pValue, uint16 len)
+{
+  reportModel_t *m = &model[handle - rptMap[0].handle];
+  unsigned r = rand() % 100;
+
+  // The application runs while the HidDev task waits on the stack. Its
+  // own sends come from the one task that makes reports.
+  while (reportInFlightValid && rand() % 100 < sendingPercent)
+  {
+    appReport();
+  }
+
+  if (r < pendingPercent)
+  {
+    return blePending;
+  }
+
+  countEdges(m->hostEdges, m->host, pValue);
+  memcpy(m->host, pValue, len);
+  return SUCCESS;
+}
+
+// HidDev task: resume after a pause and send
+static void hidDevTask(void)
+{
+  if (hidDevReportQPaused && rand() % 2)
+  {
+    hidDevReportQPaused = FALSE;
+  }
+
+  if (!hidDevReportQPaused)
+  {
+    HidDev_sendQueuedReports();
+  }
+}
+
+static void resetRun(void)
+{
+  firstQIdx = lastQIdx = 0;
+  memset(&lastReport, 0, sizeof(lastReport));
+  reportInFlightValid = FALSE;
+  hidDevReportQPaused = FALSE;
+  memset(&hidDevReportQStats, 0, sizeof(hidDevReportQStats));
+  memset(model, 0, sizeof(model));
+
+  pendingPercent = rand() % 60;
+  sendingPercent = rand() % 70;
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+// A pause lasts one connection interval, the one in use when it ends
+static int testResumeInterval(void)
+{
+  hidDevEvt_t update = { { HID_PARAM_UPDATE_EVT, 0 }, NULL };
+
+  HidDev_StartDevice();
+  if (hostParamUpdateCB != &hidDevParamUpdateCB)
+  {
+    printf("FAIL resume: parameter updates not followed\n");
+    return 1;
+  }
+
+  // 50 ms interval, rounded up plus the margin
+  hostConnInterval = 40;
+  HidDev_pauseReports();
+  if (reportResumeClock.timeout != 51)
+  {
+    printf("FAIL resume: %u ms after a pause at 50 ms\n", (unsigned)reportResumeClock.timeout);
+    return 1;
+  }
+
+  // Switched to 7.5 ms while paused
+  hostConnInterval = 6;
+  HidDev_processAppMsg(&update);
+  if (!hidDevReportQPaused || !Util_isActive(&reportResumeClock) ||
+      reportResumeClock.timeout != 9)
+  {
+    printf("FAIL resume: %u ms after a switch to 7.5 ms\n", (unsigned)reportResumeClock.timeout);
+    return 1;
+  }
+
+  // An update does not pause
+  hidDevReportQPaused = FALSE;
+  Util_stopClock(&reportResumeClock);
+  HidDev_processAppMsg(&update);
+  if (hidDevReportQPaused || Util_isActive(&reportResumeClock))
+  {
+    printf("FAIL resume: paused by a parameter update\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int checkRun(unsigned run, unsigned *pExact)
+{
+  uint8_t n, i;
+  bool exact = (hidDevReportQStats.collapsed == 0 && hidDevReportQStats.dropped == 0);
+
+  for (n = 0; n < REPORTQ_IDS; n++)
+  {
+    reportModel_t *m = &model[n];
+
+    if (memcmp(m->host, m->state, REPORTQ_LEN) != 0)
+    {
+      printf("FAIL run %u: ID %u ends on %02X%02X, expected %02X%02X\n", run, rptMap[n].id,
+             m->host[1], m->host[0], m->state[1], m->state[0]);
+      return 1;
+    }
+
+    for (i = 0; exact && i < REPORTQ_KEYS; i++)
+    {
+      if (m->hostEdges[i] != m->refEdges[i])
+      {
+        printf("FAIL run %u: ID %u key %u changed %u times, expected %u (%u merged)\n", run,
+               rptMap[n].id, i, m->hostEdges[i], m->refEdges[i], hidDevReportQStats.merged);
+        return 1;
+      }
+    }
+  }
+
+  *pExact += exact;
+  return 0;
+}
+
+int main(void)
+{
+  static hidDevCfg_t cfg = { 0, 0 };
+  unsigned run, step, exact = 0;
+  unsigned long merged = 0, overflows = 0;
+  uint8_t n;
+
+  for (n = 0; n < REPORTQ_IDS; n++)
+  {
+    cccAttr[n].pValue = (uint8 *)&cccTbl;
+    cccAttr[n].handle = 0x30 + n;
+    rptMap[n].handle = 0x20 + n;
+    rptMap[n].pCccdAttr = &cccAttr[n];
+    rptMap[n].id = n + 1;
+    rptMap[n].type = HID_REPORT_TYPE_INPUT;
+    rptMap[n].mode = HID_PROTOCOL_MODE_REPORT;
+  }
+  HidDev_Register(&cfg, &reportCBs);
+  HidDev_RegisterReports(REPORTQ_IDS, rptMap);
+
+  hidDevGapState = GAPROLE_CONNECTED;
+  hidDevConnSecure = TRUE;
+  hidDevReportReadyState = TRUE;
+  hostNotificationCB = hostNotification;
+
+  if (testResumeInterval())
+  {
+    return EXIT_FAILURE;
+  }
+
+  srand(1);
+  for (run = 0; run < REPORTQ_RUNS; run++)
+  {
+    resetRun();
+
+    for (step = 0; step < REPORTQ_STEPS; step++)
+    {
+      if (rand() % 3)
+      {
+        appReport();
+      }
+      else
+      {
+        hidDevTask();
+      }
+    }
+
+    // Drain, the host takes everything now
+    pendingPercent = 0;
+    sendingPercent = 0;
+    hidDevReportQPaused = FALSE;
+    hidDevTask();
+
+    if (!reportQEmpty() || checkRun(run, &exact))
+    {
+      return EXIT_FAILURE;
+    }
+
+    merged += hidDevReportQStats.merged;
+    overflows += hidDevReportQStats.overflows;
+  }
+
+  printf("%u runs, %u without lost taps checked exactly, %lu overflows, %lu merged\n",
+         REPORTQ_RUNS, exact, overflows, merged);
+  if (merged == 0 || exact < REPORTQ_RUNS / 4)
+  {
+    printf("FAIL too few merges checked\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
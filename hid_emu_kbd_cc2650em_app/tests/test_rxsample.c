@@ -0,0 +1,99 @@
+/******************************************************************************
+
+ @file  test_rxsample.c
+
+ @brief Tests of the KB_RX_GPTIMER receive path. The data line is sampled
+        by a one-shot timer after each clock edge, so a frame is under way
+        before its first sample is taken. A transfer the host wants to
+        start in that window must wait for the end of the frame.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Keyboard.c"
+
+static void keyHandler(uint8_t event, uint8_t key, uint32_t time)
+{
+}
+
+// Device side of one clock cycle: data is set up while the clock is high
+static void deviceBit(ps2Port_t *port, uint32_t data, bool sample)
+{
+	hostPins[port->dataPin].deviceLevel = data;
+	hostDeviceClock(port->clkPin, 0);
+	if (sample) {
+		hostTimerFire(port->rxSampleTimer);
+	}
+	hostDeviceClock(port->clkPin, 1);
+}
+
+// Leave the port idle and listening, as after the device's self test
+static void portListen(ps2Port_t *port)
+{
+	if (port->txActive == 1) {
+		txAbort(port);
+	}
+	port->cmdReadPos = port->cmdWritePos;
+	port->cmdState = KB_CMD_IDLE;
+	Util_stopClock(&port->lineClock);
+	Util_stopClock(&port->cmdClock);
+	rxReleaseClock(port);
+}
+
+// An LED change arrives between the start bit edge and its sample. The
+// frame must be received whole and the LED command sent after it.
+static int testAcquireBeforeSample(void)
+{
+	ps2Port_t *port = &keyboardPort;
+	uint8_t key = 0x1C;
+	uint32_t parity = 1;
+	uint8_t i;
+
+	portListen(port);
+
+	// Start bit edge, the sample is still due
+	hostPins[port->dataPin].deviceLevel = 0;
+	hostDeviceClock(port->clkPin, 0);
+
+	Keyboard_changeLedState(0x01);
+	if (port->lineHeld != 0 || port->txActive != 0 || hostDriving(port->clkPin)) {
+		printf("FAIL acquire before sample: host took the lines mid frame\n");
+		return 1;
+	}
+
+	hostTimerFire(port->rxSampleTimer);
+	hostDeviceClock(port->clkPin, 1);
+	for (i = 0; i < 8; i++) {
+		parity ^= (key >> i) & 1;
+		deviceBit(port, (key >> i) & 1, true);
+	}
+	deviceBit(port, parity, true);
+	deviceBit(port, 1, true);
+
+	if ((uint8_t)(port->bufferWritePos - port->bufferReadPos) != 1 ||
+		port->buffer[port->bufferReadPos & BOARD_KB_BUFFER_MASK] != key ||
+		port->rxResendPending != 0) {
+		printf("FAIL acquire before sample: frame not received\n");
+		return 1;
+	}
+	if (port->txActive != 1 || port->txByte != BOARD_LED_CHANGE_SEND_EVT ||
+		port->cmdState != KB_CMD_WAIT_ACK) {
+		printf("FAIL acquire before sample: LED command not sent after the frame\n");
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	Keyboard_init(keyHandler);
+
+	if (testAcquireBeforeSample()) {
+		return EXIT_FAILURE;
+	}
+
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
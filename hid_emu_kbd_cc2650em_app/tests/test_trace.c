@@ -0,0 +1,239 @@
+/******************************************************************************
+
+ @file  test_trace.c
+
+ @brief Round trip of KB_TRACE records: written by traceEvent, framed by
+        traceDrain onto the diagnostics UART, and read back by the
+        tracedump decoder with text and stray bytes in between.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Keyboard.c"
+
+#define TRACEDUMP_NO_MAIN
+#include "tracedump.c"
+
+#define TRACE_TEST_RECORDS      64
+#define TRACE_TEST_OVERFLOW     5
+
+// Records as written, and as decoded
+typedef struct
+{
+  uint8_t id;
+  uint8_t arg8;
+  uint16_t arg16;
+  uint32_t ticks;
+} traceTestRecord_t;
+
+static traceTestRecord_t written[TRACE_TEST_RECORDS];
+static unsigned numWritten = 0;
+
+static traceDumpRecord_t decoded[TRACE_TEST_RECORDS];
+static double decodedMicros[TRACE_TEST_RECORDS];
+static unsigned numDecoded = 0;
+
+static char text[256];
+static unsigned textLen = 0;
+
+static void record(uint8_t id, uint8_t arg8, uint16_t arg16, uint32_t ticks)
+{
+  hostTicks = ticks;
+  traceEvent(id, arg8, arg16);
+
+  written[numWritten].id = id;
+  written[numWritten].arg8 = arg8;
+  written[numWritten].arg16 = arg16;
+  written[numWritten].ticks = ticks;
+  numWritten++;
+}
+
+static void writeText(const char *str)
+{
+  UART_write(diagUart, str, strlen(str));
+}
+
+static void decodeUart(void)
+{
+  traceDumpDecoder_t dec;
+  traceDumpRecord_t rec;
+  size_t i;
+
+  memset(&dec, 0, sizeof(dec));
+
+  for (i = 0; i < hostUartLen; i++)
+  {
+    switch (traceDecodeByte(&dec, hostUartData[i], &rec))
+    {
+      case TRACEDUMP_TEXT:
+        if (textLen < sizeof(text) - 1)
+        {
+          text[textLen++] = hostUartData[i];
+        }
+        break;
+
+      case TRACEDUMP_RECORD:
+        if (numDecoded < TRACE_TEST_RECORDS)
+        {
+          decodedMicros[numDecoded] = traceDumpMicros(&dec, &rec);
+          decoded[numDecoded] = rec;
+        }
+        numDecoded++;
+        break;
+    }
+  }
+}
+
+/*********************************************************************
+ * TESTS
+ */
+
+#define CHECK_NAME(x)                                                 \
+  if (traceDumpName(TRACE_##x) == NULL ||                             \
+      strcmp(traceDumpName(TRACE_##x), #x) != 0 ||                    \
+      traceDumpName(TRACE_MOUSE | TRACE_##x) != traceDumpName(TRACE_##x)) \
+  {                                                                   \
+    printf("FAIL TRACE_%s is not named\n", #x);                       \
+    return 1;                                                         \
+  }
+
+static int testNames(void)
+{
+  CHECK_NAME(START);
+  CHECK_NAME(RX_BYTE);
+  CHECK_NAME(RX_ERROR);
+  CHECK_NAME(TX_BYTE);
+  CHECK_NAME(TX_NOACK);
+  CHECK_NAME(BUFFER_FULL);
+  CHECK_NAME(LOST);
+  CHECK_NAME(CMD_FAIL);
+  CHECK_NAME(RX_ABORT);
+  CHECK_NAME(REINIT);
+
+  if (traceDumpName(0) != NULL || traceDumpName(TRACE_REINIT + 1) != NULL)
+  {
+    printf("FAIL unknown ids are named\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static int testRoundTrip(void)
+{
+  // Ticks wrap after START
+  const uint32_t start = 0xFFFFFF00;
+  traceDumpDecoder_t dec;
+  unsigned i;
+  uint32_t ticks;
+  char line[128];
+
+  record(TRACE_START, TRACE_TIME_CLOCK, Clock_tickPeriod, start);
+  record(TRACE_RX_BYTE, 0x1C, 0, start + 0x10);
+  record(TRACE_RX_BYTE, TRACEDUMP_SYNC, 0, start + 0x20);
+  record(TRACE_MOUSE | TRACE_RX_ERROR, 0xFA, TRACE_RX_ERR_FRAME, start + 0x100);
+  record(TRACE_TX_NOACK, 0xED, KB_TX_RETRIES + 1, start + 0x180);
+  traceDrain();
+
+  // The statistics dump and a line glitch between records
+  writeText("rx frames: 12\n");
+  UART_write(diagUart, (const uint8_t[]){ TRACEDUMP_SYNC, 'x', TRACEDUMP_SYNC, TRACEDUMP_SYNC, '!' }, 5);
+
+  // Fill the ring past its end, the drain must report what was lost
+  ticks = start + 0x200;
+  for (i = 0; i < KB_TRACE_SIZE; i++)
+  {
+    record(TRACE_RX_BYTE, i, 0, ticks++);
+  }
+  for (i = 0; i < TRACE_TEST_OVERFLOW; i++)
+  {
+    hostTicks = ticks++;
+    traceEvent(TRACE_RX_BYTE, 0xFF, 0);
+  }
+  hostTicks = ticks;
+  traceDrain();
+  written[numWritten].id = TRACE_LOST;
+  written[numWritten].arg8 = 0;
+  written[numWritten].arg16 = TRACE_TEST_OVERFLOW;
+  written[numWritten].ticks = ticks;
+  numWritten++;
+
+  decodeUart();
+
+  if (numDecoded != numWritten)
+  {
+    printf("FAIL %u records decoded, %u written\n", numDecoded, numWritten);
+    return 1;
+  }
+
+  for (i = 0; i < numWritten; i++)
+  {
+    double us = (double)(uint32_t)(written[i].ticks - start) * Clock_tickPeriod;
+
+    if (decoded[i].id != written[i].id || decoded[i].arg8 != written[i].arg8 ||
+        decoded[i].arg16 != written[i].arg16 || decoded[i].time != written[i].ticks)
+    {
+      printf("FAIL record %u is %02X %02X %u 0x%08X\n", i, decoded[i].id,
+             decoded[i].arg8, decoded[i].arg16, decoded[i].time);
+      return 1;
+    }
+
+    if (decodedMicros[i] != us)
+    {
+      printf("FAIL record %u at %.1f us, expected %.1f\n", i, decodedMicros[i], us);
+      return 1;
+    }
+  }
+
+  text[textLen] = '\0';
+  if (strcmp(text, "rx frames: 12\nx!") != 0)
+  {
+    printf("FAIL text between records is \"%s\"\n", text);
+    return 1;
+  }
+
+  // Lines as the tool prints them
+  memset(&dec, 0, sizeof(dec));
+  for (i = 0; i < 5; i++)
+  {
+    traceDumpFormat(&dec, &decoded[i], line, sizeof(line));
+    printf("  %s\n", line);
+  }
+
+  return 0;
+}
+
+// Cycle timestamps are divided down by the CPU clock
+static int testCycles(void)
+{
+  traceDumpDecoder_t dec;
+  traceDumpRecord_t start = { TRACE_START, TRACE_TIME_CYCLES, 48, 1000 };
+  traceDumpRecord_t rx = { TRACE_RX_BYTE, 0x1C, 0, 1000 + 48 * 250 };
+  traceDumpRecord_t none = { TRACE_RX_BYTE, 0x1C, 0, 1000 };
+
+  memset(&dec, 0, sizeof(dec));
+  if (traceDumpMicros(&dec, &none) >= 0 ||
+      traceDumpMicros(&dec, &start) != 0 ||
+      traceDumpMicros(&dec, &rx) != 250)
+  {
+    printf("FAIL cycle timestamps\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(void)
+{
+  diagUart = UART_open(KB_DIAG_UART, NULL);
+
+  if (testNames() || testRoundTrip() || testCycles())
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf("PASS\n");
+  return EXIT_SUCCESS;
+}
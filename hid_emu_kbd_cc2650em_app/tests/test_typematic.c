@@ -0,0 +1,89 @@
+/******************************************************************************
+
+ @file  test_typematic.c
+
+ @brief Tests of KB_HOST_TYPEMATIC: repeated makes of a held key are not
+        reported. The keyboard forgets its held keys when it is reset or
+        plugged in again, so must the firmware, or the first press after
+        that is taken for a repeat.
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Keyboard.c"
+
+#define KEY_A_SCAN              0x1C
+#define KEY_A_HID               0x04
+
+static uint8_t numEvents = 0;
+static uint8_t lastEvent, lastKey;
+
+static void keyHandler(uint8_t event, uint8_t key, uint32_t time)
+{
+	lastEvent = event;
+	lastKey = key;
+	numEvents++;
+}
+
+// Task side: one make of A, 1 if it was reported
+static int pressA(void)
+{
+	numEvents = 0;
+	decoderFeed(KEY_A_SCAN);
+	return numEvents == 1 && lastEvent == BOARD_KEY_CHANGE_EVT && lastKey == KEY_A_HID;
+}
+
+static int testRepeat(void)
+{
+	if (!pressA()) {
+		printf("FAIL repeat: first make not reported\n");
+		return 1;
+	}
+	if (pressA()) {
+		printf("FAIL repeat: repeated make reported\n");
+		return 1;
+	}
+	return 0;
+}
+
+// A is held when the link fails, the keyboard is reset
+static int testReinit(void)
+{
+	portReinit(&keyboardPort);
+	if (!pressA()) {
+		printf("FAIL reinit: make after the reset taken for a repeat\n");
+		return 1;
+	}
+	return 0;
+}
+
+// A is held when the keyboard is unplugged, it reports its self test
+// when plugged in again
+static int testHotPlug(void)
+{
+	ps2Port_t *port = &keyboardPort;
+
+	port->cmdReadPos = port->cmdWritePos;
+	port->cmdState = KB_CMD_IDLE;
+	rxFrameComplete(port, BOARD_TEST_PASSED, 0);
+
+	if (!pressA()) {
+		printf("FAIL hot plug: make after the self test taken for a repeat\n");
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	Keyboard_init(keyHandler);
+
+	if (testRepeat() || testReinit() || testHotPlug()) {
+		return EXIT_FAILURE;
+	}
+
+	printf("PASS\n");
+	return EXIT_SUCCESS;
+}
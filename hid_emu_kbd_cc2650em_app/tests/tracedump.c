@@ -0,0 +1,273 @@
+/******************************************************************************
+
+ @file  tracedump.c
+
+ @brief Decoder for the KB_TRACE records written to the diagnostics UART.
+        Each record is framed by traceDrain (Keyboard.c) as
+
+          0xA5, id, arg8, arg16 (LE), timestamp (32 bit LE)
+
+        Bytes outside a frame, such as the KB_TIMING_STATS dump, are
+        passed through as they are. Timestamps are printed in microseconds
+        since the last TRACE_START record, which gives their unit.
+
+          tracedump [file]      decode a capture, or stdin
+
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define TRACEDUMP_SYNC          0xA5
+#define TRACEDUMP_FRAME_LEN     9
+#define TRACEDUMP_MOUSE         0x80
+
+// Record ids, as TRACE_* in Keyboard.c
+#define TRACEDUMP_START         0x01
+#define TRACEDUMP_IDS           0x0A
+
+// TRACE_START timestamp sources
+#define TRACEDUMP_TIME_CLOCK    0
+#define TRACEDUMP_TIME_CYCLES   1
+
+// traceDecodeByte results
+#define TRACEDUMP_NONE          0
+#define TRACEDUMP_TEXT          1
+#define TRACEDUMP_RECORD        2
+
+// One decoded record
+typedef struct
+{
+  uint8_t id;
+  uint8_t arg8;
+  uint16_t arg16;
+  uint32_t time;
+} traceDumpRecord_t;
+
+// Decoder state, zero to start
+typedef struct
+{
+  uint8_t frame[TRACEDUMP_FRAME_LEN];
+  uint8_t len;
+
+  // Timestamp unit from TRACE_START, none before the first one
+  bool haveStart;
+  uint8_t source;
+  uint16_t unit;
+  uint32_t lastTime;
+  uint64_t elapsed;
+} traceDumpDecoder_t;
+
+// Names and argument labels by id, NULL where the argument is unused
+static const struct
+{
+  const char *name;
+  const char *arg8;
+  const char *arg16;
+} traceDumpIds[TRACEDUMP_IDS + 1] =
+{
+  { NULL,          NULL,      NULL       },
+  { "START",       "source",  "unit"     },
+  { "RX_BYTE",     "byte",    NULL       },
+  { "RX_ERROR",    "byte",    "error"    },
+  { "TX_BYTE",     "byte",    NULL       },
+  { "TX_NOACK",    "byte",    "retries"  },
+  { "BUFFER_FULL", "byte",    "overflows"},
+  { "LOST",        NULL,      "records"  },
+  { "CMD_FAIL",    "cmd",     "failures" },
+  { "RX_ABORT",    "bit",     "aborted"  },
+  { "REINIT",      NULL,      "resets"   },
+};
+
+/*********************************************************************
+ * @fn      traceDumpName
+ *
+ * @brief   Name of a record id, without the mouse flag.
+ *
+ * @return  Name, NULL if the id is not known.
+ */
+static const char *traceDumpName(uint8_t id)
+{
+  id &= ~TRACEDUMP_MOUSE;
+
+  return (id <= TRACEDUMP_IDS) ? traceDumpIds[id].name : NULL;
+}
+
+/*********************************************************************
+ * @fn      traceDecodeByte
+ *
+ * @brief   Feed one byte to the decoder. A frame starts at a sync byte and
+ *          is dropped, looking for the next sync byte, if its id is not
+ *          known.
+ *
+ * @param   pDec    - Decoder state.
+ * @param   byte    - Byte from the UART.
+ * @param   pRecord - Record, when TRACEDUMP_RECORD is returned.
+ *
+ * @return  TRACEDUMP_TEXT if the byte is outside a frame, TRACEDUMP_RECORD
+ *          if it completes one, TRACEDUMP_NONE otherwise.
+ */
+static int traceDecodeByte(traceDumpDecoder_t *pDec, uint8_t byte,
+                           traceDumpRecord_t *pRecord)
+{
+  uint8_t *f = pDec->frame;
+
+  if (pDec->len == 0)
+  {
+    if (byte != TRACEDUMP_SYNC)
+    {
+      return TRACEDUMP_TEXT;
+    }
+
+    f[pDec->len++] = byte;
+    return TRACEDUMP_NONE;
+  }
+
+  if (pDec->len == 1 && traceDumpName(byte) == NULL)
+  {
+    // Not a frame after all, resync on this byte
+    pDec->len = 0;
+    return (byte == TRACEDUMP_SYNC) ? traceDecodeByte(pDec, byte, pRecord)
+                                    : TRACEDUMP_TEXT;
+  }
+
+  f[pDec->len++] = byte;
+  if (pDec->len < TRACEDUMP_FRAME_LEN)
+  {
+    return TRACEDUMP_NONE;
+  }
+
+  pDec->len = 0;
+  pRecord->id = f[1];
+  pRecord->arg8 = f[2];
+  pRecord->arg16 = f[3] | (f[4] << 8);
+  pRecord->time = f[5] | (f[6] << 8) | (f[7] << 16) | ((uint32_t)f[8] << 24);
+
+  return TRACEDUMP_RECORD;
+}
+
+/*********************************************************************
+ * @fn      traceDumpMicros
+ *
+ * @brief   Time of a record in microseconds since the last TRACE_START.
+ *          The 32 bit timestamps may wrap between records.
+ *
+ * @param   pDec    - Decoder state.
+ * @param   pRecord - Record, in order.
+ *
+ * @return  Microseconds, negative before the first TRACE_START.
+ */
+static double traceDumpMicros(traceDumpDecoder_t *pDec,
+                              const traceDumpRecord_t *pRecord)
+{
+  if ((pRecord->id & ~TRACEDUMP_MOUSE) == TRACEDUMP_START)
+  {
+    pDec->haveStart = true;
+    pDec->source = pRecord->arg8;
+    pDec->unit = pRecord->arg16;
+    pDec->lastTime = pRecord->time;
+    pDec->elapsed = 0;
+  }
+
+  if (!pDec->haveStart || pDec->unit == 0)
+  {
+    return -1;
+  }
+
+  pDec->elapsed += (uint32_t)(pRecord->time - pDec->lastTime);
+  pDec->lastTime = pRecord->time;
+
+  if (pDec->source == TRACEDUMP_TIME_CYCLES)
+  {
+    // Unit is the CPU clock in MHz
+    return (double)pDec->elapsed / pDec->unit;
+  }
+
+  // Unit is microseconds per tick
+  return (double)pDec->elapsed * pDec->unit;
+}
+
+/*********************************************************************
+ * @fn      traceDumpFormat
+ *
+ * @brief   One line for a record.
+ *
+ * @param   pDec    - Decoder state.
+ * @param   pRecord - Record, in order.
+ * @param   buf     - Line, without a newline.
+ * @param   size    - Size of buf.
+ */
+static void traceDumpFormat(traceDumpDecoder_t *pDec,
+                            const traceDumpRecord_t *pRecord,
+                            char *buf, size_t size)
+{
+  uint8_t id = pRecord->id & ~TRACEDUMP_MOUSE;
+  double us = traceDumpMicros(pDec, pRecord);
+  int len;
+
+  if (us < 0)
+  {
+    len = snprintf(buf, size, "%12s 0x%08X", "-", pRecord->time);
+  }
+  else
+  {
+    len = snprintf(buf, size, "%12.1f us", us);
+  }
+
+  len += snprintf(buf + len, size - len, "  %-5s %-11s",
+                  (pRecord->id & TRACEDUMP_MOUSE) ? "mouse" : "kbd",
+                  traceDumpIds[id].name);
+
+  if (traceDumpIds[id].arg8 != NULL)
+  {
+    len += snprintf(buf + len, size - len, " %s=0x%02X",
+                    traceDumpIds[id].arg8, pRecord->arg8);
+  }
+
+  if (traceDumpIds[id].arg16 != NULL)
+  {
+    snprintf(buf + len, size - len, " %s=%u",
+             traceDumpIds[id].arg16, pRecord->arg16);
+  }
+}
+
+#ifndef TRACEDUMP_NO_MAIN
+int main(int argc, char **argv)
+{
+  traceDumpDecoder_t dec;
+  traceDumpRecord_t record;
+  char line[128];
+  bool lineStart = true;
+  FILE *in = stdin;
+  int c;
+
+  if (argc > 1 && (in = fopen(argv[1], "rb")) == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  memset(&dec, 0, sizeof(dec));
+
+  while ((c = getc(in)) != EOF)
+  {
+    switch (traceDecodeByte(&dec, c, &record))
+    {
+      case TRACEDUMP_TEXT:
+        putchar(c);
+        lineStart = (c == '\n');
+        break;
+
+      case TRACEDUMP_RECORD:
+        traceDumpFormat(&dec, &record, line, sizeof(line));
+        printf("%s%s\n", lineStart ? "" : "\n", line);
+        lineStart = true;
+        break;
+    }
+  }
+
+  return 0;
+}
+#endif